@@ -0,0 +1,17 @@
+# cmake -DSPIRV_FILES=<file>,<file>,... -DOUTPUT=<source> -P EmbedSPIRV.cmake
+# writes a source file that registers the spir-v files at engine::EmbeddedShaders during static initialization
+string(REPLACE "," ";" SPIRV_FILES "${SPIRV_FILES}")
+
+set(SOURCE "// generated by engine/cmake/EmbedSPIRV.cmake, do not edit\n#include \"engine/core/EmbeddedShaders.h\"\n\nnamespace {\n")
+set(INDEX 0)
+foreach (SPIRV_FILE ${SPIRV_FILES})
+    get_filename_component(NAME ${SPIRV_FILE} NAME)
+    file(READ ${SPIRV_FILE} CONTENT HEX)
+    string(REGEX REPLACE "([0-9a-f][0-9a-f])" "0x\\1," CONTENT "${CONTENT}")
+    string(APPEND SOURCE "    const unsigned char spirv${INDEX}[] = {${CONTENT}};\n")
+    string(APPEND SOURCE "    [[maybe_unused]] const bool registered${INDEX} = engine::EmbeddedShaders::add(\"${NAME}\", spirv${INDEX}, sizeof(spirv${INDEX}));\n")
+    math(EXPR INDEX "${INDEX} + 1")
+endforeach ()
+string(APPEND SOURCE "}\n")
+
+file(WRITE ${OUTPUT} "${SOURCE}")
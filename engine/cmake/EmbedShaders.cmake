@@ -0,0 +1,42 @@
+# engine_embed_shaders(<target> SOURCE_DIR <dir> VARIANTS <variant>...)
+# compiles the shader variants with glslc at build time and links the spir-v into the target (see engine/core/EmbeddedShaders.h)
+# a variant is the shader file name followed by its defines separated by ':', e.g. lbvh_knn_query.comp:KNN_K=8
+# variants that are not embedded are compiled at runtime (see Shader)
+function(engine_embed_shaders TARGET)
+    cmake_parse_arguments(ARG "" "SOURCE_DIR" "VARIANTS" ${ARGN})
+    find_program(GLSLC_EXECUTABLE glslc REQUIRED)
+
+    file(GLOB SHADER_INCLUDES ${ARG_SOURCE_DIR}/*.glsl)
+    set(OUTPUT_DIR ${CMAKE_CURRENT_BINARY_DIR}/embedded_shaders)
+    set(SPIRV_FILES "")
+    foreach (VARIANT ${ARG_VARIANTS})
+        string(REPLACE ":" ";" VARIANT_PARTS ${VARIANT})
+        list(POP_FRONT VARIANT_PARTS SHADER_FILE)
+        # same file name as Shader::getOutputFileName, e.g. shader.comp.DEFINE_A.DEFINE_B=1.spv
+        set(OUTPUT_FILE_NAME ${SHADER_FILE})
+        set(DEFINE_FLAGS "")
+        foreach (DEFINE ${VARIANT_PARTS})
+            string(APPEND OUTPUT_FILE_NAME ".${DEFINE}")
+            list(APPEND DEFINE_FLAGS "-D${DEFINE}")
+        endforeach ()
+        string(APPEND OUTPUT_FILE_NAME ".spv")
+
+        add_custom_command(OUTPUT ${OUTPUT_DIR}/${OUTPUT_FILE_NAME}
+                COMMAND ${CMAKE_COMMAND} -E make_directory ${OUTPUT_DIR}
+                COMMAND ${GLSLC_EXECUTABLE} --target-spv=spv1.5 ${DEFINE_FLAGS} ${ARG_SOURCE_DIR}/${SHADER_FILE} -o ${OUTPUT_DIR}/${OUTPUT_FILE_NAME}
+                DEPENDS ${ARG_SOURCE_DIR}/${SHADER_FILE} ${SHADER_INCLUDES}
+                COMMENT "Compiling ${OUTPUT_FILE_NAME}"
+                VERBATIM)
+        list(APPEND SPIRV_FILES ${OUTPUT_DIR}/${OUTPUT_FILE_NAME})
+    endforeach ()
+
+    set(EMBED_SCRIPT ${CMAKE_CURRENT_FUNCTION_LIST_DIR}/EmbedSPIRV.cmake)
+    set(GENERATED_SOURCE ${OUTPUT_DIR}/EmbeddedShaders_${TARGET}.cpp)
+    string(REPLACE ";" "," SPIRV_FILES_ARGUMENT "${SPIRV_FILES}")
+    add_custom_command(OUTPUT ${GENERATED_SOURCE}
+            COMMAND ${CMAKE_COMMAND} -DSPIRV_FILES=${SPIRV_FILES_ARGUMENT} -DOUTPUT=${GENERATED_SOURCE} -P ${EMBED_SCRIPT}
+            DEPENDS ${SPIRV_FILES} ${EMBED_SCRIPT}
+            COMMENT "Embedding spir-v into ${TARGET}"
+            VERBATIM)
+    target_sources(${TARGET} PRIVATE ${GENERATED_SOURCE})
+endfunction()
@@ -8,9 +8,13 @@
 #include <vector>
 
 #include "GPUContext.h"
+#include "MemoryAllocator.h"
+#include "StagingRing.h"
 #include <vulkan/vulkan_core.h>
 
 namespace engine {
+    // the memory is sub-allocated from the MemoryAllocator of the GPUContext, host visible buffers stay mapped for their lifetime
+    // uploads and downloads go through the StagingRing of the GPUContext, the *Async variants return a handle to wait on instead of blocking
     class Buffer {
     public:
         struct BufferSettings {
@@ -26,7 +30,7 @@ namespace engine {
             createBuffer();
 
             //            m_gpuContext->getDebug()->setName(m_buffer, m_bufferSettings.m_name);
-            //            m_gpuContext->getDebug()->setName(m_bufferMemory, m_bufferSettings.m_name);
+            //            m_gpuContext->getDebug()->setName(m_allocation.m_memory, m_bufferSettings.m_name);
         }
 
         ~Buffer() {
@@ -37,62 +41,75 @@ namespace engine {
             if (m_buffer) {
                 vkDestroyBuffer(m_gpuContext->m_device, m_buffer, nullptr);
             }
-            if (m_bufferMemory) {
-                vkFreeMemory(m_gpuContext->m_device, m_bufferMemory, nullptr);
+            if (m_allocation.m_memory) {
+                m_gpuContext->m_memoryAllocator->free(m_allocation);
             }
             m_buffer = nullptr;
-            m_bufferMemory = nullptr;
         }
 
         static std::shared_ptr<Buffer> fillDeviceWithStagingBuffer(GPUContext *gpuContext, const BufferSettings &settings, void *data) { // upload
-            Buffer stagingBuffer(gpuContext, {settings.m_sizeBytes, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT});
+            auto buffer = std::make_shared<Buffer>(gpuContext, settings);
 
-            void *stagingMemory;
-            vkMapMemory(gpuContext->m_device, stagingBuffer.m_bufferMemory, 0, settings.m_sizeBytes, 0, &stagingMemory); // memory-mapped I/O
-            memcpy(stagingMemory, data, settings.m_sizeBytes);
-            vkUnmapMemory(gpuContext->m_device, stagingBuffer.m_bufferMemory);
+            buffer->uploadWithStagingBuffer(data); // copy contents from staging buffer to high performance memory on GPU, which cannot be accessed directly by the CPU (therefore the staging buffer)
 
-            auto buffer = std::make_shared<Buffer>(gpuContext, settings);
+            return buffer;
+        }
+
+        void uploadWithStagingBuffer(void *data) {
+            uploadWithStagingBuffer(data, m_bufferSettings.m_sizeBytes);
+        }
 
-            copyBuffer(gpuContext, stagingBuffer.m_buffer, buffer->m_buffer, settings.m_sizeBytes); // copy contents from staging buffer to high performance memory on GPU, which cannot be accessed directly by the CPU (therefore the staging buffer)
+        // only the first sizeBytes bytes of the buffer are written, e.g. if the buffer is allocated with a larger capacity
+        void uploadWithStagingBuffer(void *data, uint32_t sizeBytes) {
+            m_gpuContext->m_stagingRing->wait(uploadAsync(data, sizeBytes));
+        }
 
-            stagingBuffer.release();
+        StagingRing::TransferHandle uploadAsync(const void *data) {
+            return uploadAsync(data, m_bufferSettings.m_sizeBytes);
+        }
 
-            return buffer;
+        // data is copied to the staging ring before this returns, the transfer is batched with other transfers and submitted at the latest when the handle is waited on
+        StagingRing::TransferHandle uploadAsync(const void *data, uint32_t sizeBytes, uint32_t offsetBytes = 0) {
+            return m_gpuContext->m_stagingRing->upload(m_buffer, offsetBytes, data, sizeBytes);
         }
 
         void downloadWithStagingBuffer(void *data) {
-            Buffer stagingBuffer(m_gpuContext, {m_bufferSettings.m_sizeBytes, VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT});
+            downloadWithStagingBuffer(data, m_bufferSettings.m_sizeBytes);
+        }
 
-            copyBuffer(m_gpuContext, m_buffer, stagingBuffer.m_buffer, m_bufferSettings.m_sizeBytes); // copy contents from staging buffer to high performance memory on GPU, which cannot be accessed directly by the CPU (therefore the staging buffer)
+        // only the first sizeBytes bytes of the buffer are read, e.g. if the buffer is allocated with a larger capacity
+        void downloadWithStagingBuffer(void *data, uint32_t sizeBytes) {
+            m_gpuContext->m_stagingRing->wait(downloadAsync(data, sizeBytes));
+        }
 
-            stagingBuffer.download(data);
+        StagingRing::TransferHandle downloadAsync(void *data) {
+            return downloadAsync(data, m_bufferSettings.m_sizeBytes);
+        }
 
-            stagingBuffer.release();
+        // data has to stay valid until the handle is waited on (StagingRing::wait), it is written then
+        StagingRing::TransferHandle downloadAsync(void *data, uint32_t sizeBytes, uint32_t offsetBytes = 0) {
+            return m_gpuContext->m_stagingRing->download(m_buffer, offsetBytes, data, sizeBytes);
         }
 
         void download(void *data) {
-            void *stagingMemory;
-            vkMapMemory(m_gpuContext->m_device, m_bufferMemory, 0, m_bufferSettings.m_sizeBytes, 0, &stagingMemory); // memory-mapped I/O
-            memcpy(data, stagingMemory, m_bufferSettings.m_sizeBytes);
-            vkUnmapMemory(m_gpuContext->m_device, m_bufferMemory);
+            m_gpuContext->m_memoryAllocator->invalidate(m_allocation, 0, m_bufferSettings.m_sizeBytes);
+            memcpy(data, mapHostMemory(), m_bufferSettings.m_sizeBytes); // memory-mapped I/O
         }
 
         void updateHostMemory(uint32_t sizeBytes, void *data) {
-            void *memory;
-            vkMapMemory(m_gpuContext->m_device, m_bufferMemory, 0, sizeBytes, 0, &memory); // memory-mapped I/O
-            memcpy(memory, data, sizeBytes);
-            vkUnmapMemory(m_gpuContext->m_device, m_bufferMemory);
+            memcpy(mapHostMemory(), data, sizeBytes); // memory-mapped I/O
+            m_gpuContext->m_memoryAllocator->flush(m_allocation, 0, sizeBytes);
         }
 
+        // the memory is mapped persistently, no unmapHostMemory required
         void *mapHostMemory() {
-            void *memory;
-            vkMapMemory(m_gpuContext->m_device, m_bufferMemory, 0, m_bufferSettings.m_sizeBytes, 0, &memory); // memory-mapped I/O
-            return memory;
+            if (!m_allocation.m_mappedData) {
+                throw std::runtime_error("Buffer " + m_bufferSettings.m_name + " is not host visible!");
+            }
+            return m_allocation.m_mappedData;
         }
 
         void unmapHostMemory() {
-            vkUnmapMemory(m_gpuContext->m_device, m_bufferMemory);
         }
 
 
@@ -113,7 +130,7 @@ namespace engine {
         GPUContext *m_gpuContext;
 
         VkBuffer m_buffer = nullptr;
-        VkDeviceMemory m_bufferMemory = nullptr;
+        MemoryAllocator::Allocation m_allocation;
 
         BufferSettings m_bufferSettings;
 
@@ -131,48 +148,9 @@ namespace engine {
             VkMemoryRequirements memRequirements;
             vkGetBufferMemoryRequirements(m_gpuContext->m_device, m_buffer, &memRequirements);
 
-            VkMemoryAllocateInfo allocInfo{};
-            allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-            allocInfo.allocationSize = memRequirements.size;
-            allocInfo.memoryTypeIndex = findMemoryType(m_gpuContext->m_physicalDevice, memRequirements.memoryTypeBits, m_bufferSettings.m_memoryProperties);
-            VkMemoryAllocateFlagsInfo *pMemoryAllocateFlagsInfo = nullptr;
-            VkMemoryAllocateFlagsInfo memoryAllocateFlagsInfo{};
-            if (m_bufferSettings.m_memoryAllocateFlagBits.has_value()) {
-                memoryAllocateFlagsInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_FLAGS_INFO;
-                memoryAllocateFlagsInfo.flags = m_bufferSettings.m_memoryAllocateFlagBits.value();
-                pMemoryAllocateFlagsInfo = &memoryAllocateFlagsInfo;
-            }
-            allocInfo.pNext = pMemoryAllocateFlagsInfo;
-
-            if (vkAllocateMemory(m_gpuContext->m_device, &allocInfo, nullptr, &m_bufferMemory) != VK_SUCCESS) {
-                throw std::runtime_error("Failed to allocate buffer memory!");
-            }
-
-            vkBindBufferMemory(m_gpuContext->m_device, m_buffer, m_bufferMemory, 0);
-        }
-
-        static uint32_t findMemoryType(VkPhysicalDevice physicalDevice, uint32_t typeFilter, VkMemoryPropertyFlags properties) {
-            VkPhysicalDeviceMemoryProperties memProperties;
-            vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memProperties);
-
-            for (uint32_t i = 0; i < memProperties.memoryTypeCount; i++) {
-                if ((typeFilter & (1 << i)) && (memProperties.memoryTypes[i].propertyFlags & properties) == properties) {
-                    return i;
-                }
-            }
-
-            throw std::runtime_error("Failed to find suitable memory type!");
-        }
-
-        static void copyBuffer(GPUContext *gpuContext, VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size) {
-            VkBufferCopy copyRegion{};
-            copyRegion.srcOffset = 0; // optional
-            copyRegion.dstOffset = 0; // optional
-            copyRegion.size = size;
+            m_allocation = m_gpuContext->m_memoryAllocator->allocate(memRequirements, m_bufferSettings.m_memoryProperties, m_bufferSettings.m_memoryAllocateFlagBits.value_or(static_cast<VkMemoryAllocateFlagBits>(0)));
 
-            gpuContext->executeCommands([&](VkCommandBuffer commandBuffer) {
-                vkCmdCopyBuffer(commandBuffer, srcBuffer, dstBuffer, 1, &copyRegion);
-            });
+            vkBindBufferMemory(m_gpuContext->m_device, m_buffer, m_allocation.m_memory, m_allocation.m_offset);
         }
     };
 } // namespace engine
\ No newline at end of file
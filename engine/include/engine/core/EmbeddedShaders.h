@@ -0,0 +1,25 @@
+#pragma once
+
+#include <cstddef>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace engine {
+    // precompiled spir-v that is linked into the binary, i.e. glslc is not required at runtime (cmake option ENGINE_EMBED_SPIRV, see engine/cmake/EmbedShaders.cmake)
+    // the shaders are registered by their output file name, e.g. lbvh_ray_query.comp.ANY_HIT.spv (see Shader::getOutputFileName)
+    class EmbeddedShaders {
+    public:
+        // called by the generated source file during static initialization, the code has to outlive the program
+        static bool add(const std::string &name, const unsigned char *code, size_t sizeBytes);
+
+        // false if the shader is not embedded
+        static bool find(const std::string &name, std::vector<char> &code);
+
+    private:
+        EmbeddedShaders() = default;
+
+        static std::map<std::string, std::pair<const unsigned char *, size_t>> &registry();
+    };
+}
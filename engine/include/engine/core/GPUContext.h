@@ -1,6 +1,8 @@
 #pragma once
 
 #include <cstring>
+#include <filesystem>
+#include <fstream>
 #include <iostream>
 #include <optional>
 #include <regex>
@@ -10,8 +12,11 @@
 #include <vulkan/vulkan_core.h>
 
 #include "Queues.h"
+#include "StagingRing.h"
 
 namespace engine {
+    class MemoryAllocator;
+
     class GPUContext {
     public:
         explicit GPUContext(uint32_t requiredQueueFamilies);
@@ -22,6 +27,17 @@ namespace engine {
 
         VkPhysicalDevice m_physicalDevice = VK_NULL_HANDLE; // will be destroyed implicitly when instance is destroyed
 
+        // set before init to skip the interactive device selection (e.g. benchmarks in CI), m_deviceIndex takes precedence
+        std::optional<uint32_t> m_deviceIndex;
+        std::optional<VkPhysicalDeviceType> m_deviceType; // first device of this type, e.g. VK_PHYSICAL_DEVICE_TYPE_CPU for a software implementation (lavapipe)
+        bool m_validationLayers = true;                   // set before init, false e.g. for benchmarks (every call is validated) or if the layers are not installed
+
+        // properties of m_physicalDevice, queried at init, e.g. to specialize the work group and subgroup sizes of the shaders
+        VkPhysicalDeviceProperties m_deviceProperties{};
+        VkPhysicalDeviceSubgroupProperties m_subgroupProperties{};
+        VkPhysicalDeviceSubgroupSizeControlProperties m_subgroupSizeControlProperties{};
+        bool m_subgroupSizeControl = false; // subgroupSizeControl and computeFullSubgroups are supported (and enabled), i.e. a compute shader can require its subgroup size
+
         VkDevice m_device{};
         std::shared_ptr<Queues> m_queues;
 
@@ -37,6 +53,25 @@ namespace engine {
 
         VkCommandPool m_commandPool{};
 
+        // memory of all buffers (see Buffer), created at init and released at shutdown, i.e. all buffers have to be released before shutdown
+        std::shared_ptr<MemoryAllocator> m_memoryAllocator;
+
+        // staging memory of all uploads and downloads (see Buffer), created at init and released at shutdown
+        std::shared_ptr<StagingRing> m_stagingRing;
+        VkDeviceSize m_stagingRingSize = StagingRing::DEFAULT_SIZE; // set before init
+
+        // used by all passes, loaded from m_pipelineCachePath at init (if it matches the device) and saved at shutdown
+        VkPipelineCache m_pipelineCache = VK_NULL_HANDLE;
+        std::string m_pipelineCachePath; // set before init, empty for pipeline_cache.bin next to the executable
+
+        // true if the pipeline cache was loaded from disk, i.e. the pipelines are created without a full driver compile
+        [[nodiscard]] bool isPipelineCacheWarm() const {
+            return m_pipelineCacheWarm;
+        }
+
+        // the cache is also saved at shutdown, call this to persist it earlier (e.g. after all passes are created)
+        void savePipelineCache();
+
         void executeCommands(const std::function<void(VkCommandBuffer)> &recordCommands) {
             VkCommandBufferAllocateInfo allocInfo{};
             allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
@@ -82,9 +117,9 @@ namespace engine {
 
     private:
 #ifdef NDEBUG
-        const bool enableValidationLayers = true;
+        bool enableValidationLayers = true;
 #else
-        const bool enableValidationLayers = true;
+        bool enableValidationLayers = true;
 #endif
         const std::vector<const char *> validationLayers = {
                 "VK_LAYER_KHRONOS_validation"};
@@ -107,6 +142,12 @@ namespace engine {
         void createCommandPool();
         void createCommandBuffers();
 
+        bool m_pipelineCacheWarm = false;
+
+        void createPipelineCache();
+        void releasePipelineCache();
+        [[nodiscard]] bool isPipelineCacheCompatible(const std::vector<char> &data) const;
+
         const uint32_t MAX_FRAMES_IN_FLIGHT = 2;
     };
 } // namespace engine
\ No newline at end of file
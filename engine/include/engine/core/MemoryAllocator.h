@@ -0,0 +1,106 @@
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include <vulkan/vulkan_core.h>
+
+namespace engine {
+    // sub-allocates buffer memory from large blocks (one pool of blocks per memory type and allocate flags) instead of one vkAllocateMemory per buffer
+    // every block keeps a free list of ranges sorted by offset (first fit, adjacent ranges are merged on free); allocations larger than half a block get their own dedicated block
+    // host visible blocks are mapped persistently, i.e. several buffers of a block can be mapped at the same time
+    class MemoryAllocator {
+    public:
+        struct Allocation {
+            VkDeviceMemory m_memory = VK_NULL_HANDLE;
+            VkDeviceSize m_offset = 0;
+            VkDeviceSize m_size = 0;
+            void *m_mappedData = nullptr; // at m_offset, nullptr if the memory is not host visible
+            bool m_coherent = true;       // false if the host has to flush/invalidate, see flush and invalidate
+
+            uint32_t m_poolIndex = 0;
+            uint32_t m_blockIndex = 0;
+        };
+
+        struct Statistics {
+            uint32_t numBlocks = 0;             // live vkAllocateMemory allocations (including the dedicated ones)
+            uint32_t numDedicatedBlocks = 0;    // blocks with a single allocation that is larger than half of the block size
+            uint32_t numAllocations = 0;        // live sub-allocations, i.e. buffers
+            uint64_t totalBlockAllocations = 0; // vkAllocateMemory calls since creation
+            uint64_t totalAllocations = 0;      // allocate calls since creation
+            VkDeviceSize blockBytes = 0;        // size of all blocks
+            VkDeviceSize usedBytes = 0;         // size of all allocations (including the alignment padding between them)
+            uint32_t numFreeRanges = 0;
+            VkDeviceSize largestFreeRange = 0;
+            double fragmentation = 0;           // 1 - largest free range / free bytes, 0 if the free memory of the blocks is contiguous
+        };
+
+        MemoryAllocator(VkDevice device, VkPhysicalDevice physicalDevice, VkDeviceSize blockSize = DEFAULT_BLOCK_SIZE);
+
+        ~MemoryAllocator();
+
+        // frees all blocks, all allocations have to be freed before
+        void release();
+
+        Allocation allocate(const VkMemoryRequirements &memoryRequirements, VkMemoryPropertyFlags memoryProperties, VkMemoryAllocateFlags memoryAllocateFlags = 0);
+
+        void free(Allocation &allocation);
+
+        // only required for host visible memory without VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, no-ops otherwise
+        void flush(const Allocation &allocation, VkDeviceSize offset, VkDeviceSize size) const;
+
+        void invalidate(const Allocation &allocation, VkDeviceSize offset, VkDeviceSize size) const;
+
+        [[nodiscard]] Statistics getStatistics();
+
+        void printStatistics();
+
+        static constexpr VkDeviceSize DEFAULT_BLOCK_SIZE = 64 * 1024 * 1024; // smaller for small heaps (heap size / 8)
+
+    private:
+        struct Block {
+            VkDeviceMemory m_memory = VK_NULL_HANDLE;
+            VkDeviceSize m_size = 0;
+            void *m_mappedData = nullptr;
+            bool m_dedicated = false;
+            uint32_t m_numAllocations = 0;
+            std::map<VkDeviceSize, VkDeviceSize> m_freeRanges; // offset -> size
+        };
+
+        struct Pool {
+            uint32_t m_memoryTypeIndex;
+            VkMemoryAllocateFlags m_memoryAllocateFlags;
+            VkDeviceSize m_blockSize;
+            bool m_hostVisible;
+            bool m_coherent;
+            std::vector<Block> m_blocks; // released blocks stay in the vector (m_memory == VK_NULL_HANDLE) to keep the block indices of the allocations valid
+        };
+
+        VkDevice m_device;
+        VkPhysicalDeviceMemoryProperties m_memoryProperties{};
+        VkDeviceSize m_blockSize;
+        VkDeviceSize m_nonCoherentAtomSize;
+
+        std::vector<Pool> m_pools;
+        std::mutex m_mutex;
+
+        uint64_t m_totalBlockAllocations = 0;
+        uint64_t m_totalAllocations = 0;
+
+        static inline const char *PRINT_PREFIX = "[MemoryAllocator] ";
+
+        uint32_t findMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties) const;
+
+        uint32_t getPool(uint32_t memoryTypeIndex, VkMemoryAllocateFlags memoryAllocateFlags);
+
+        uint32_t createBlock(Pool &pool, VkDeviceSize size, bool dedicated);
+
+        void releaseBlock(Block &block);
+
+        static bool allocateFromBlock(Block &block, VkDeviceSize size, VkDeviceSize alignment, VkDeviceSize &offset);
+
+        static void freeToBlock(Block &block, VkDeviceSize offset, VkDeviceSize size);
+    };
+} // namespace engine
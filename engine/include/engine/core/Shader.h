@@ -1,15 +1,21 @@
 #pragma once
 
 #include <cassert>
+#include <cstdint>
 #include <filesystem>
 #include <fstream>
+#include <iomanip>
 #include <iostream>
 #include <map>
+#include <random>
+#include <set>
 #include <sstream>
 #include <stdexcept>
+#include <unistd.h>
 #include <vector>
 #include <vulkan/vulkan_core.h>
 
+#include "EmbeddedShaders.h"
 #include "SPIRV-Reflect/spirv_reflect.h"
 #include "Uniform.h"
 
@@ -30,15 +36,37 @@ namespace engine {
             }
         };
 
-        Shader(GPUContext *gpuContext, const std::string &inputPath, const std::string &fileName) : m_gpuContext(gpuContext) {
-            std::cout << "[Shader] Compiling " << inputPath << "/" << fileName << std::endl;
-
-            std::stringstream outputPath;
-            outputPath << std::filesystem::canonical("/proc/self/exe").remove_filename().c_str() << "resources/shaders";
-            compileShader(inputPath, outputPath.str(), fileName);
-            std::vector<char> code = readFile(outputPath.str() + "/" + fileName + ".spv");
+        // spir-v specialization constant id of the work group size x, i.e. declare layout (local_size_x_id = LOCAL_SIZE_X_CONSTANT_ID) in the shader to specialize it
+        static constexpr uint32_t LOCAL_SIZE_X_CONSTANT_ID = 0;
+
+        // specializationConstants: constant_id -> value (uint), set at pipeline creation, i.e. the same spir-v is used for all values
+        // requiredSubgroupSize: 0 or the subgroup size the pipeline is created with (requires GPUContext::m_subgroupSizeControl), all subgroups are full
+        Shader(GPUContext *gpuContext, const std::string &inputPath, const std::string &fileName, const std::vector<std::string> &defines = {}, const std::map<uint32_t, uint32_t> &specializationConstants = {}, uint32_t requiredSubgroupSize = 0) : m_gpuContext(gpuContext) {
+            std::string outputFileName = getOutputFileName(fileName, defines);
+            std::vector<char> code;
+            if (EmbeddedShaders::find(outputFileName, code)) {
+                std::cout << "[Shader] Loading embedded " << outputFileName << std::endl;
+            } else {
+                // content-addressed cache, glslc is only invoked if the source, one of its includes or the defines changed
+                std::stringstream outputPath;
+                outputPath << std::filesystem::canonical("/proc/self/exe").remove_filename().c_str() << "resources/shaders";
+                std::string cachedFileName = getCachedFileName(outputFileName, hashSource(inputPath, fileName, defines));
+                if (std::filesystem::exists(outputPath.str() + "/" + cachedFileName)) {
+                    std::cout << "[Shader] Loading cached " << cachedFileName << std::endl;
+                } else {
+                    std::cout << "[Shader] Compiling " << inputPath << "/" << fileName;
+                    for (const auto &define: defines) {
+                        std::cout << " -D" << define;
+                    }
+                    std::cout << std::endl;
+                    compileShader(inputPath, outputPath.str(), fileName, cachedFileName, defines);
+                    pruneCache(outputPath.str(), outputFileName, cachedFileName);
+                }
+                code = readFile(outputPath.str() + "/" + cachedFileName);
+            }
 
             reflect(code);
+            specialize(specializationConstants, requiredSubgroupSize);
 
             m_shaderModule = createShaderModule(code, m_gpuContext->m_device);
         }
@@ -60,6 +88,13 @@ namespace engine {
             shaderStageInfo.stage = shaderStage;
             shaderStageInfo.module = m_shaderModule;
             shaderStageInfo.pName = "main";
+            if (!m_specializationMapEntries.empty()) {
+                shaderStageInfo.pSpecializationInfo = &m_specializationInfo;
+            }
+            if (m_requiredSubgroupSizeInfo.requiredSubgroupSize != 0) {
+                shaderStageInfo.pNext = &m_requiredSubgroupSizeInfo;
+                shaderStageInfo.flags |= VK_PIPELINE_SHADER_STAGE_CREATE_REQUIRE_FULL_SUBGROUPS_BIT;
+            }
             return shaderStageInfo;
         }
 
@@ -84,6 +119,13 @@ namespace engine {
 
         VkExtent3D m_workGroupSize = {0, 0, 0};
 
+        std::vector<VkSpecializationMapEntry> m_specializationMapEntries;
+        std::vector<uint32_t> m_specializationData;
+        VkSpecializationInfo m_specializationInfo{};
+        VkPipelineShaderStageRequiredSubgroupSizeCreateInfo m_requiredSubgroupSizeInfo{.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_REQUIRED_SUBGROUP_SIZE_CREATE_INFO};
+
+        static constexpr const char *GLSLC_COMMAND = "glslc --target-spv=spv1.5"; // part of the cache key, i.e. changing the flags invalidates the cache
+
         static VkShaderModule createShaderModule(const std::vector<char> &code, VkDevice device) {
             VkShaderModuleCreateInfo createInfo{};
             createInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
@@ -111,11 +153,85 @@ namespace engine {
             return buffer;
         }
 
-        static void compileShader(const std::string &inputPath, const std::string &outputPath, const std::string &fileName) {
+        // every set of defines results in its own spir-v file, e.g. shader.comp.DEFINE_A.DEFINE_B=1.spv
+        static std::string getOutputFileName(const std::string &fileName, const std::vector<std::string> &defines) {
+            std::stringstream outputFileName;
+            outputFileName << fileName;
+            for (const auto &define: defines) {
+                outputFileName << "." << define;
+            }
+            outputFileName << ".spv";
+            return outputFileName.str();
+        }
+
+        // file name of the cache entry, e.g. shader.comp.DEFINE_A.DEFINE_B=1.0123456789abcdef.spv
+        static std::string getCachedFileName(const std::string &outputFileName, uint64_t hash) {
+            std::stringstream cachedFileName;
+            cachedFileName << outputFileName.substr(0, outputFileName.size() - 4) << "." << std::hex << std::setw(16) << std::setfill('0') << hash << ".spv";
+            return cachedFileName.str();
+        }
+
+        // FNV-1a
+        static uint64_t hash(uint64_t value, const std::string &data) {
+            for (const unsigned char c: data) {
+                value ^= c;
+                value *= 1099511628211ull;
+            }
+            return value;
+        }
+
+        // hash of the compiler flags, the defines, the source and all (transitively) included files
+        static uint64_t hashSource(const std::string &inputPath, const std::string &fileName, const std::vector<std::string> &defines) {
+            uint64_t sourceHash = hash(14695981039346656037ull, GLSLC_COMMAND);
+            for (const auto &define: defines) {
+                sourceHash = hash(sourceHash, " -D" + define);
+            }
+            std::set<std::filesystem::path> visited;
+            hashFile(std::filesystem::path(inputPath) / fileName, sourceHash, visited);
+            return sourceHash;
+        }
+
+        // follows #include "..." (GL_GOOGLE_include_directive) relative to the including file, every file is hashed once
+        static void hashFile(const std::filesystem::path &path, uint64_t &sourceHash, std::set<std::filesystem::path> &visited) {
+            const std::filesystem::path canonicalPath = std::filesystem::weakly_canonical(path);
+            if (!visited.insert(canonicalPath).second) {
+                return;
+            }
+            std::vector<char> content = readFile(canonicalPath.string());
+            const std::string source(content.begin(), content.end());
+            sourceHash = hash(sourceHash, canonicalPath.filename().string());
+            sourceHash = hash(sourceHash, source);
+
+            std::istringstream stream(source);
+            std::string line;
+            while (std::getline(stream, line)) {
+                const size_t begin = line.find_first_not_of(" \t");
+                if (begin == std::string::npos || line.compare(begin, 8, "#include") != 0) {
+                    continue;
+                }
+                const size_t open = line.find('"', begin + 8);
+                const size_t close = open == std::string::npos ? std::string::npos : line.find('"', open + 1);
+                if (close == std::string::npos) {
+                    continue;
+                }
+                hashFile(canonicalPath.parent_path() / line.substr(open + 1, close - open - 1), sourceHash, visited);
+            }
+        }
+
+        static void compileShader(const std::string &inputPath, const std::string &outputPath, const std::string &fileName, const std::string &outputFileName, const std::vector<std::string> &defines) {
             std::filesystem::create_directories(outputPath);
 
             std::stringstream cmd;
-            cmd << "glslc --target-spv=spv1.5 " << inputPath << "/" << fileName << " -o " << outputPath << "/" << fileName << ".spv";
+            cmd << GLSLC_COMMAND;
+            for (const auto &define: defines) {
+                cmd << " -D" << define;
+            }
+            // compile into a temporary file and rename it, i.e. a cache entry is never read partially written
+            // the temporary file is unique per compilation, several processes (e.g. parallel test runs) may compile the same shader into the same cache directory
+            std::random_device randomDevice;
+            std::stringstream temporaryFileName;
+            temporaryFileName << outputPath << "/" << outputFileName << "." << getpid() << "." << std::hex << randomDevice() << ".tmp";
+            cmd << " " << inputPath << "/" << fileName << " -o " << temporaryFileName.str();
 
             std::string cmd_output;
             char read_buffer[1024];
@@ -125,8 +241,29 @@ namespace engine {
             int cmd_ret = pclose(cmd_stream);
 
             if (cmd_ret != 0) {
+                std::filesystem::remove(temporaryFileName.str());
                 throw std::runtime_error("unable to compile");
             }
+            std::filesystem::rename(temporaryFileName.str(), outputPath + "/" + outputFileName);
+        }
+
+        // removes the entries of the same variant (file name and defines) with another hash, i.e. of older versions of the source, otherwise the cache grows with every change of a shader
+        // the entries of other variants are kept, errors are ignored (e.g. if another process removed the entry first)
+        static void pruneCache(const std::string &outputPath, const std::string &outputFileName, const std::string &cachedFileName) {
+            const std::string prefix = outputFileName.substr(0, outputFileName.size() - 4) + ".";
+            const size_t cachedFileNameSize = prefix.size() + 16 + 4; // prefix, hash and .spv, see getCachedFileName
+            std::error_code error;
+            for (const auto &entry: std::filesystem::directory_iterator(outputPath, error)) {
+                const std::string name = entry.path().filename().string();
+                if (name == cachedFileName || name.size() != cachedFileNameSize || name.compare(0, prefix.size(), prefix) != 0 || name.compare(cachedFileNameSize - 4, 4, ".spv") != 0) {
+                    continue;
+                }
+                if (name.find_first_not_of("0123456789abcdef", prefix.size()) != cachedFileNameSize - 4) {
+                    continue;
+                }
+                std::cout << "[Shader] Removing stale " << name << std::endl;
+                std::filesystem::remove(entry.path(), error);
+            }
         }
 
         void reflect(const std::vector<char> &code) {
@@ -178,6 +315,26 @@ namespace engine {
             }
         }
 
+        void specialize(const std::map<uint32_t, uint32_t> &specializationConstants, uint32_t requiredSubgroupSize) {
+            for (const auto &[constantID, value]: specializationConstants) {
+                m_specializationMapEntries.push_back({constantID, static_cast<uint32_t>(m_specializationData.size() * sizeof(uint32_t)), sizeof(uint32_t)});
+                m_specializationData.push_back(value);
+                if (constantID == LOCAL_SIZE_X_CONSTANT_ID) {
+                    // the reflected work group size is the default of the shader, the dispatch size has to use the specialized size
+                    m_workGroupSize.width = value;
+                }
+            }
+            m_specializationInfo.mapEntryCount = static_cast<uint32_t>(m_specializationMapEntries.size());
+            m_specializationInfo.pMapEntries = m_specializationMapEntries.data();
+            m_specializationInfo.dataSize = m_specializationData.size() * sizeof(uint32_t);
+            m_specializationInfo.pData = m_specializationData.data();
+
+            if (requiredSubgroupSize != 0 && !m_gpuContext->m_subgroupSizeControl) {
+                throw std::runtime_error("Subgroup size control is not supported!");
+            }
+            m_requiredSubgroupSizeInfo.requiredSubgroupSize = requiredSubgroupSize;
+        }
+
         void reflectWorkGroupSize(const SpvReflectShaderModule &module) {
             auto entryPoint = spvReflectGetEntryPoint(&module, "main");
             if (entryPoint != nullptr) {
@@ -0,0 +1,111 @@
+#pragma once
+
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include <vulkan/vulkan_core.h>
+
+namespace engine {
+    class GPUContext;
+    class Buffer;
+
+    // persistently mapped, host coherent staging buffer that is used as a ring for all uploads and downloads (see Buffer::uploadAsync and Buffer::downloadAsync)
+    // transfers are recorded into the open batch, a batch is submitted to the transfer queue with a fence when it is waited on, when submit is called or when it holds a quarter of the ring
+    // the region of a batch is reused after its fence is signaled, i.e. the staging memory is allocated once and transfers larger than the ring are split into chunks
+    class StagingRing {
+    public:
+        // identifies the batch that contains a transfer, all transfers of the batch and of the batches before are finished after wait
+        struct TransferHandle {
+            uint64_t m_batchId = 0; // 0 if there is nothing to wait for, value of the timeline semaphore after the batch finished
+        };
+
+        StagingRing(GPUContext *gpuContext, VkDeviceSize sizeBytes);
+
+        ~StagingRing();
+
+        // waits for all batches
+        void release();
+
+        // data is copied into the ring before upload returns
+        TransferHandle upload(VkBuffer dstBuffer, VkDeviceSize dstOffset, const void *data, VkDeviceSize sizeBytes);
+
+        // data has to stay valid until the transfer is waited on, it is written by wait
+        TransferHandle download(VkBuffer srcBuffer, VkDeviceSize srcOffset, void *data, VkDeviceSize sizeBytes);
+
+        // submits the open batch without waiting
+        TransferHandle submit();
+
+        void wait(TransferHandle handle);
+
+        [[nodiscard]] bool isFinished(TransferHandle handle);
+
+        // signaled with the batch id when a batch finished, i.e. a submission on another queue can wait for a submitted transfer on the GPU instead of on the host
+        [[nodiscard]] VkSemaphore getTimelineSemaphore() const {
+            return m_timelineSemaphore;
+        }
+
+        struct Statistics {
+            uint64_t numSubmits = 0;
+            uint64_t numTransfers = 0;
+            uint64_t numStalls = 0; // waits for a batch because the ring was full
+            uint64_t uploadedBytes = 0;
+            uint64_t downloadedBytes = 0;
+        };
+
+        [[nodiscard]] Statistics getStatistics();
+
+        [[nodiscard]] VkDeviceSize getSizeBytes() const {
+            return m_sizeBytes;
+        }
+
+        static constexpr VkDeviceSize DEFAULT_SIZE = 64 * 1024 * 1024;
+
+    private:
+        struct PendingDownload {
+            VkDeviceSize m_ringOffset;
+            void *m_data;
+            VkDeviceSize m_sizeBytes;
+        };
+
+        struct Batch {
+            uint64_t m_id = 0;
+            VkCommandBuffer m_commandBuffer = VK_NULL_HANDLE;
+            VkFence m_fence = VK_NULL_HANDLE;
+            VkDeviceSize m_sizeBytes = 0; // ring bytes of the batch including the bytes skipped at the end of the ring
+            VkDeviceSize m_end = 0;       // ring offset after the last region of the batch
+            std::vector<PendingDownload> m_downloads;
+        };
+
+        GPUContext *m_gpuContext;
+        VkDeviceSize m_sizeBytes;
+        std::shared_ptr<Buffer> m_buffer;
+        char *m_mappedData = nullptr;
+
+        VkCommandPool m_commandPool = VK_NULL_HANDLE;
+        VkSemaphore m_timelineSemaphore = VK_NULL_HANDLE;
+        std::vector<std::pair<VkCommandBuffer, VkFence>> m_freeCommandBuffers; // of retired batches
+
+        std::deque<Batch> m_submittedBatches; // in submission order
+        Batch m_openBatch;                    // m_commandBuffer is VK_NULL_HANDLE as long as nothing is recorded
+        uint64_t m_nextBatchId = 1;
+        uint64_t m_finishedBatchId = 0; // all batches up to this id are retired
+
+        VkDeviceSize m_head = 0;      // next free byte
+        VkDeviceSize m_tail = 0;      // first byte of the oldest batch in flight
+        VkDeviceSize m_usedBytes = 0; // between tail and head (including skipped bytes), distinguishes a full from an empty ring
+
+        Statistics m_statistics;
+        std::mutex m_mutex;
+
+        static constexpr VkDeviceSize ALIGNMENT = 16;
+
+        VkDeviceSize allocate(VkDeviceSize sizeBytes);
+
+        void beginBatch();
+
+        void submitOpenBatch();
+
+        void retireOldestBatch();
+    };
+} // namespace engine
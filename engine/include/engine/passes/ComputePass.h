@@ -8,9 +8,24 @@ namespace engine {
         explicit ComputePass(GPUContext *gpuContext) : Pass(gpuContext) {
         }
 
+        // GPU work a submission waits for, the value is ignored for binary semaphores
+        struct SemaphoreWait {
+            VkSemaphore m_semaphore;
+            uint64_t m_value;
+            VkPipelineStageFlags m_stageMask = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+        };
+
         void create() override {
             Pass::create();
             m_workGroupCounts.resize(m_shaders.size());
+            createTimestampQueryPools();
+            createTimelineSemaphore();
+        }
+
+        void release() override {
+            releaseTimelineSemaphore();
+            releaseTimestampQueryPools();
+            Pass::release();
         }
 
         void setGlobalInvocationSize(uint32_t stageIndex, uint32_t width, uint32_t height, uint32_t depth) {
@@ -27,37 +42,118 @@ namespace engine {
         }
 
         VkSemaphore execute(VkSemaphore awaitBeforeExecution) override {
-            vkWaitForFences(m_gpuContext->m_device, 1, &m_fences[m_gpuContext->getActiveIndex()], VK_TRUE, UINT64_MAX); // waiting for the previous frame to finish, blocks the CPU
-            vkResetFences(m_gpuContext->m_device, 1, &m_fences[m_gpuContext->getActiveIndex()]);
-
-            vkResetCommandBuffer(m_commandBuffers[m_gpuContext->getActiveIndex()], 0);
-            fillCommandBuffer(m_commandBuffers[m_gpuContext->getActiveIndex()]);
-
-            VkSubmitInfo submitInfo{};
-            submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+            std::vector<SemaphoreWait> waits;
             if (awaitBeforeExecution != VK_NULL_HANDLE) {
-                VkPipelineStageFlags waitStages[] = {VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT};
-                submitInfo.waitSemaphoreCount = 1;
-                submitInfo.pWaitSemaphores = &awaitBeforeExecution; // wait on dependent operation
-                submitInfo.pWaitDstStageMask = waitStages;
+                waits.push_back({awaitBeforeExecution, 0}); // wait on dependent operation
             }
-            submitInfo.commandBufferCount = 1;
-            submitInfo.pCommandBuffers = &m_commandBuffers[m_gpuContext->getActiveIndex()];
-            submitInfo.signalSemaphoreCount = 1;
-            submitInfo.pSignalSemaphores = &m_signalSemaphores[m_gpuContext->getActiveIndex()]; // is signaled when the command buffer has finished execution
+            submitCommandBuffer(waits, m_signalSemaphores[m_gpuContext->getActiveIndex()], 0); // is signaled when the command buffer has finished execution
+            return m_signalSemaphores[m_gpuContext->getActiveIndex()];
+        }
 
-            if (vkQueueSubmit(m_gpuContext->m_queues->getQueue(Queues::COMPUTE), 1, &submitInfo, m_fences[m_gpuContext->getActiveIndex()]) != VK_SUCCESS) { // signal fence after the command buffer finished execution
-                throw std::runtime_error("Failed to submit compute command buffer!");
+        // same as execute, but signals the timeline semaphore (getTimelineSemaphore) with the returned value when the command buffer has finished execution
+        // the host only blocks if the command buffer of the active index is still in flight, i.e. the GPU works on the submission while the CPU prepares the next one
+        uint64_t submit(const std::vector<SemaphoreWait> &waits = {}) {
+            submitCommandBuffer(waits, m_timelineSemaphore, m_timelineValue + 1);
+            return ++m_timelineValue;
+        }
+
+        // blocks until the submission that returned value has finished
+        void wait(uint64_t value) const {
+            VkSemaphoreWaitInfo waitInfo{};
+            waitInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+            waitInfo.semaphoreCount = 1;
+            waitInfo.pSemaphores = &m_timelineSemaphore;
+            waitInfo.pValues = &value;
+            if (vkWaitSemaphores(m_gpuContext->m_device, &waitInfo, UINT64_MAX) != VK_SUCCESS) {
+                throw std::runtime_error("Failed to wait for timeline semaphore!");
             }
+        }
 
-            return m_signalSemaphores[m_gpuContext->getActiveIndex()];
+        [[nodiscard]] bool isFinished(uint64_t value) const {
+            uint64_t completedValue = 0;
+            vkGetSemaphoreCounterValue(m_gpuContext->m_device, m_timelineSemaphore, &completedValue);
+            return completedValue >= value;
+        }
+
+        // other queues/passes can wait for a value returned by submit (e.g. as SemaphoreWait)
+        [[nodiscard]] VkSemaphore getTimelineSemaphore() const {
+            return m_timelineSemaphore;
         }
 
         [[nodiscard]] VkExtent3D getWorkGroupCount(uint32_t stageIndex) {
             return m_workGroupCounts[stageIndex];
         }
 
+        // largest work group size <= maxSize supported by the device that is a multiple of the subgroup size, e.g. to specialize layout (local_size_x_id = Shader::LOCAL_SIZE_X_CONSTANT_ID)
+        [[nodiscard]] uint32_t getPreferredWorkGroupSize(uint32_t maxSize) const {
+            const VkPhysicalDeviceLimits &limits = m_gpuContext->m_deviceProperties.limits;
+            const uint32_t subgroupSize = std::max(1u, m_gpuContext->m_subgroupProperties.subgroupSize);
+            const uint32_t size = std::min(maxSize, std::min(limits.maxComputeWorkGroupSize[0], limits.maxComputeWorkGroupInvocations));
+            return size >= subgroupSize ? size - size % subgroupSize : size;
+        }
+
+        // false if the pass did not request timestamps (m_timestampCount) or the compute queue does not support them
+        [[nodiscard]] bool hasTimestamps() const {
+            return !m_timestampQueryPools.empty();
+        }
+
+        // GPU durations in milliseconds between the timestamps 2 * i and 2 * i + 1 written by the last submission (which has to be finished), 0 if a timestamp of the pair was not written
+        void getTimestampDurations(std::vector<double> &durations) {
+            durations.assign(m_timestampCount / 2, 0.0);
+            if (!hasTimestamps()) {
+                return;
+            }
+
+            // (value, availability) per query, unavailable queries were not written during the last submission
+            std::vector<uint64_t> results(2 * m_timestampCount);
+            VkResult result = vkGetQueryPoolResults(m_gpuContext->m_device, m_timestampQueryPools[m_gpuContext->getActiveIndex()], 0, m_timestampCount, results.size() * sizeof(uint64_t), results.data(), 2 * sizeof(uint64_t), VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WITH_AVAILABILITY_BIT);
+            if (result != VK_SUCCESS && result != VK_NOT_READY) {
+                throw std::runtime_error("Failed to get timestamp query results!");
+            }
+
+            const double period = m_gpuContext->m_deviceProperties.limits.timestampPeriod; // nanoseconds per tick
+            for (uint32_t i = 0; i < durations.size(); i++) {
+                const uint64_t *begin = &results[4 * i];
+                const uint64_t *end = &results[4 * i + 2];
+                if (begin[1] == 0 || end[1] == 0) {
+                    continue;
+                }
+                const uint64_t ticks = (end[0] - begin[0]) & m_timestampMask; // the counter may wrap around
+                durations[i] = static_cast<double>(ticks) * period * 1e-6;
+            }
+        }
+
     protected:
+        uint32_t m_timestampCount = 0; // number of timestamp queries per submission (begin/end pairs), set by the subclass before create
+
+        // the timestamp is written once all previously recorded commands finished
+        void recordTimestamp(VkCommandBuffer commandBuffer, uint32_t query) {
+            if (!hasTimestamps()) {
+                return;
+            }
+            vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, m_timestampQueryPools[m_gpuContext->getActiveIndex()], query);
+        }
+
+        // pipeline layout of a stage with all descriptor set layouts of the pass and one push constant range (0 if the stage has no push constants), e.g. for createPipelineLayouts
+        void createPipelineLayout(uint32_t stageIndex, uint32_t pushConstantsSize) {
+            VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+            pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+            pipelineLayoutInfo.setLayoutCount = m_descriptorSetLayouts.size();
+            pipelineLayoutInfo.pSetLayouts = m_descriptorSetLayouts.data();
+
+            VkPushConstantRange pushConstantRange{};
+            pushConstantRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+            pushConstantRange.offset = 0;
+            pushConstantRange.size = pushConstantsSize;
+
+            pipelineLayoutInfo.pushConstantRangeCount = pushConstantsSize > 0 ? 1 : 0;
+            pipelineLayoutInfo.pPushConstantRanges = pushConstantsSize > 0 ? &pushConstantRange : nullptr;
+
+            if (vkCreatePipelineLayout(m_gpuContext->m_device, &pipelineLayoutInfo, nullptr, &m_pipelineLayouts[stageIndex]) != VK_SUCCESS) {
+                throw std::runtime_error("Failed to create pipeline layout!");
+            }
+        }
+
         uint32_t findQueueFamilyIndex() override {
             Queues::QueueFamilyIndices queueFamilyIndices = m_gpuContext->m_queues->findQueueFamilies(m_gpuContext->m_physicalDevice);
             return queueFamilyIndices.computeFamily.value();
@@ -74,7 +170,7 @@ namespace engine {
                 pipelineInfo.stage = shaderStage;
 
                 m_pipelines.emplace_back();
-                if (vkCreateComputePipelines(m_gpuContext->m_device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &m_pipelines[m_pipelines.size() - 1]) != VK_SUCCESS) {
+                if (vkCreateComputePipelines(m_gpuContext->m_device, m_gpuContext->m_pipelineCache, 1, &pipelineInfo, nullptr, &m_pipelines[m_pipelines.size() - 1]) != VK_SUCCESS) {
                     throw std::runtime_error("Failed to create compute pipeline!");
                 }
             }
@@ -85,18 +181,129 @@ namespace engine {
         }
 
         void recordCommandComputeShaderExecution(VkCommandBuffer commandBuffer, uint32_t stageIndex) {
-            vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_pipelines[stageIndex]);
-
-            std::vector<VkDescriptorSet> descriptorSets;
-            getDescriptorSets(descriptorSets);
-            vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_pipelineLayouts[stageIndex], 0, descriptorSets.size(), descriptorSets.data(), 0, nullptr);
+            bindPipelineAndDescriptorSets(commandBuffer, stageIndex);
 
             vkCmdDispatch(commandBuffer, m_workGroupCounts[stageIndex].width, m_workGroupCounts[stageIndex].height, m_workGroupCounts[stageIndex].depth);
         }
 
+        // the work group counts are read from the buffer (VkDispatchIndirectCommand at the given offset) when the dispatch is executed, the buffer requires VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT
+        void recordCommandComputeShaderExecutionIndirect(VkCommandBuffer commandBuffer, uint32_t stageIndex, VkBuffer indirectBuffer, VkDeviceSize offset) {
+            bindPipelineAndDescriptorSets(commandBuffer, stageIndex);
+
+            vkCmdDispatchIndirect(commandBuffer, indirectBuffer, offset);
+        }
+
     private:
         std::vector<VkExtent3D> m_workGroupCounts;
 
+        std::vector<VkQueryPool> m_timestampQueryPools; // m_timestampQueryPools[multibufferedId]
+        uint64_t m_timestampMask = ~0ull;               // timestampValidBits of the compute queue
+
+        VkSemaphore m_timelineSemaphore = VK_NULL_HANDLE;
+        uint64_t m_timelineValue = 0; // value of the last submit
+
+        void createTimelineSemaphore() {
+            VkSemaphoreTypeCreateInfo typeInfo{};
+            typeInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO;
+            typeInfo.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+            typeInfo.initialValue = m_timelineValue;
+
+            VkSemaphoreCreateInfo semaphoreInfo{};
+            semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+            semaphoreInfo.pNext = &typeInfo;
+            if (vkCreateSemaphore(m_gpuContext->m_device, &semaphoreInfo, nullptr, &m_timelineSemaphore) != VK_SUCCESS) {
+                throw std::runtime_error("Failed to create timeline semaphore!");
+            }
+        }
+
+        void releaseTimelineSemaphore() {
+            vkDestroySemaphore(m_gpuContext->m_device, m_timelineSemaphore, nullptr);
+            m_timelineSemaphore = VK_NULL_HANDLE;
+        }
+
+        // signalValue is ignored for binary semaphores
+        void submitCommandBuffer(const std::vector<SemaphoreWait> &waits, VkSemaphore signalSemaphore, uint64_t signalValue) {
+            vkWaitForFences(m_gpuContext->m_device, 1, &m_fences[m_gpuContext->getActiveIndex()], VK_TRUE, UINT64_MAX); // waiting for the previous submission of the active index to finish, blocks the CPU
+            vkResetFences(m_gpuContext->m_device, 1, &m_fences[m_gpuContext->getActiveIndex()]);
+
+            vkResetCommandBuffer(m_commandBuffers[m_gpuContext->getActiveIndex()], 0);
+            fillCommandBuffer(m_commandBuffers[m_gpuContext->getActiveIndex()]);
+
+            std::vector<VkSemaphore> waitSemaphores;
+            std::vector<uint64_t> waitValues;
+            std::vector<VkPipelineStageFlags> waitStages;
+            for (const auto &wait: waits) {
+                waitSemaphores.push_back(wait.m_semaphore);
+                waitValues.push_back(wait.m_value);
+                waitStages.push_back(wait.m_stageMask);
+            }
+
+            VkTimelineSemaphoreSubmitInfo timelineInfo{};
+            timelineInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+            timelineInfo.waitSemaphoreValueCount = waitValues.size();
+            timelineInfo.pWaitSemaphoreValues = waitValues.data();
+            timelineInfo.signalSemaphoreValueCount = 1;
+            timelineInfo.pSignalSemaphoreValues = &signalValue;
+
+            VkSubmitInfo submitInfo{};
+            submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+            submitInfo.pNext = &timelineInfo;
+            submitInfo.waitSemaphoreCount = waitSemaphores.size();
+            submitInfo.pWaitSemaphores = waitSemaphores.data();
+            submitInfo.pWaitDstStageMask = waitStages.data();
+            submitInfo.commandBufferCount = 1;
+            submitInfo.pCommandBuffers = &m_commandBuffers[m_gpuContext->getActiveIndex()];
+            submitInfo.signalSemaphoreCount = 1;
+            submitInfo.pSignalSemaphores = &signalSemaphore;
+
+            if (vkQueueSubmit(m_gpuContext->m_queues->getQueue(Queues::COMPUTE), 1, &submitInfo, m_fences[m_gpuContext->getActiveIndex()]) != VK_SUCCESS) { // signal fence after the command buffer finished execution
+                throw std::runtime_error("Failed to submit compute command buffer!");
+            }
+        }
+
+        void createTimestampQueryPools() {
+            if (m_timestampCount == 0) {
+                return;
+            }
+
+            uint32_t queueFamilyCount = 0;
+            vkGetPhysicalDeviceQueueFamilyProperties(m_gpuContext->m_physicalDevice, &queueFamilyCount, nullptr);
+            std::vector<VkQueueFamilyProperties> queueFamilies(queueFamilyCount);
+            vkGetPhysicalDeviceQueueFamilyProperties(m_gpuContext->m_physicalDevice, &queueFamilyCount, queueFamilies.data());
+            const uint32_t validBits = queueFamilies[m_queueFamilyIndex].timestampValidBits;
+            if (validBits == 0) {
+                return; // not supported, the durations are reported as 0
+            }
+            m_timestampMask = validBits >= 64 ? ~0ull : (1ull << validBits) - 1;
+
+            VkQueryPoolCreateInfo queryPoolInfo{};
+            queryPoolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+            queryPoolInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+            queryPoolInfo.queryCount = m_timestampCount;
+
+            m_timestampQueryPools.resize(m_gpuContext->getMultiBufferedCount());
+            for (auto &queryPool: m_timestampQueryPools) {
+                if (vkCreateQueryPool(m_gpuContext->m_device, &queryPoolInfo, nullptr, &queryPool) != VK_SUCCESS) {
+                    throw std::runtime_error("Failed to create timestamp query pool!");
+                }
+            }
+        }
+
+        void releaseTimestampQueryPools() {
+            for (auto &queryPool: m_timestampQueryPools) {
+                vkDestroyQueryPool(m_gpuContext->m_device, queryPool, nullptr);
+            }
+            m_timestampQueryPools.clear();
+        }
+
+        void bindPipelineAndDescriptorSets(VkCommandBuffer commandBuffer, uint32_t stageIndex) {
+            vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_pipelines[stageIndex]);
+
+            std::vector<VkDescriptorSet> descriptorSets;
+            getDescriptorSets(descriptorSets);
+            vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_pipelineLayouts[stageIndex], 0, descriptorSets.size(), descriptorSets.data(), 0, nullptr);
+        }
+
         void fillCommandBuffer(VkCommandBuffer commandBuffer) {
             // fill command buffer
             VkCommandBufferBeginInfo beginInfo{};
@@ -106,6 +313,10 @@ namespace engine {
                 throw std::runtime_error("failed to begin recording command buffer!");
             }
 
+            if (hasTimestamps()) {
+                vkCmdResetQueryPool(commandBuffer, m_timestampQueryPools[m_gpuContext->getActiveIndex()], 0, m_timestampCount);
+            }
+
             recordCommands(commandBuffer);
 
             if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS) {
@@ -4,6 +4,7 @@
 #include "engine/core/GPUContext.h"
 #include "engine/core/Shader.h"
 
+#include <algorithm>
 #include <vector>
 #include <vulkan/vulkan_core.h>
 
@@ -198,10 +199,13 @@ namespace engine {
                         uint32_t index = m_descriptorSetToIndex[setId];
                         auto &mergedLayoutData = m_descriptorSetLayoutData[index];
                         assert(setId == mergedLayoutData.set_number);
-                        mergedLayoutData.bindings.insert(mergedLayoutData.bindings.end(), layout.bindings.begin(), layout.bindings.end());
-                        //                        for (auto &binding : layout.bindings) {
-                        //
-                        //                        }
+                        for (const auto &binding: layout.bindings) {
+                            // several shaders may access the same binding, only add it once
+                            bool contained = std::any_of(mergedLayoutData.bindings.begin(), mergedLayoutData.bindings.end(), [&](const VkDescriptorSetLayoutBinding &mergedBinding) { return mergedBinding.binding == binding.binding; });
+                            if (!contained) {
+                                mergedLayoutData.bindings.push_back(binding);
+                            }
+                        }
                     } else {
                         // insert new set
                         uint32_t index = m_descriptorSetLayoutData.size();
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace engine {
+    // fixed number of persistent worker threads, the calling thread participates as thread 0
+    class ThreadPool {
+    public:
+        explicit ThreadPool(uint32_t numThreads);
+
+        ~ThreadPool();
+
+        ThreadPool(const ThreadPool &) = delete;
+
+        ThreadPool &operator=(const ThreadPool &) = delete;
+
+        // splits [0, count) into getNumThreads() contiguous chunks and calls function(threadIdx, begin, end) for each non-empty chunk, blocks until all chunks are processed
+        // the chunks only depend on count and the number of threads, i.e. two calls with the same count process the same chunks on the same threads
+        void parallelFor(uint32_t count, const std::function<void(uint32_t threadIdx, uint32_t begin, uint32_t end)> &function);
+
+        [[nodiscard]] uint32_t getNumThreads() const {
+            return m_numThreads;
+        }
+
+    private:
+        uint32_t m_numThreads;
+        std::vector<std::thread> m_workers;
+
+        std::mutex m_mutex;
+        std::condition_variable m_start;
+        std::condition_variable m_done;
+        const std::function<void(uint32_t, uint32_t, uint32_t)> *m_function = nullptr;
+        uint32_t m_count = 0;
+        uint64_t m_generation = 0; // incremented for each parallelFor, the workers wait for a new generation
+        uint32_t m_numPending = 0; // number of workers that did not finish their chunk of the current generation
+        bool m_stop = false;
+
+        void work(uint32_t threadIdx);
+
+        void processChunk(uint32_t threadIdx);
+    };
+}
@@ -0,0 +1,24 @@
+#include "engine/core/EmbeddedShaders.h"
+
+namespace engine {
+    bool EmbeddedShaders::add(const std::string &name, const unsigned char *code, size_t sizeBytes) {
+        registry()[name] = {code, sizeBytes};
+        return true;
+    }
+
+    bool EmbeddedShaders::find(const std::string &name, std::vector<char> &code) {
+        auto it = registry().find(name);
+        if (it == registry().end()) {
+            return false;
+        }
+        // copy, the vector guarantees the alignment required for VkShaderModuleCreateInfo::pCode
+        code.assign(reinterpret_cast<const char *>(it->second.first), reinterpret_cast<const char *>(it->second.first) + it->second.second);
+        return true;
+    }
+
+    std::map<std::string, std::pair<const unsigned char *, size_t>> &EmbeddedShaders::registry() {
+        // function local static, the generated source files register their shaders during static initialization
+        static std::map<std::string, std::pair<const unsigned char *, size_t>> shaders;
+        return shaders;
+    }
+} // namespace engine
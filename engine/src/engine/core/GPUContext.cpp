@@ -1,4 +1,5 @@
 #include "engine/core/GPUContext.h"
+#include "engine/core/MemoryAllocator.h"
 
 namespace engine {
     GPUContext::GPUContext(uint32_t requiredQueueFamilies) : m_queues(std::make_shared<Queues>(requiredQueueFamilies)) {
@@ -13,17 +14,26 @@ namespace engine {
     }
 
     void GPUContext::initVulkan() {
+        enableValidationLayers = enableValidationLayers && m_validationLayers;
         createInstance();
         setupDebugMessenger();
         pickPhysicalDevice();
         createLogicalDevice();
+        m_memoryAllocator = std::make_shared<MemoryAllocator>(m_device, m_physicalDevice);
+        createPipelineCache();
         m_queues->createQueues(m_device, m_physicalDevice);
         createCommandPool();
         createCommandBuffers();
+        m_stagingRing = std::make_shared<StagingRing>(this, m_stagingRingSize);
     }
 
     void GPUContext::releaseVulkan() {
+        m_stagingRing->release();
+        m_stagingRing = nullptr;
         vkDestroyCommandPool(m_device, m_commandPool, nullptr);
+        releasePipelineCache();
+        m_memoryAllocator->release();
+        m_memoryAllocator = nullptr;
         vkDestroyDevice(m_device, nullptr);
         if (enableValidationLayers) {
             DestroyDebugUtilsMessengerEXT(m_instance, m_debugMessenger, nullptr);
@@ -166,13 +176,27 @@ namespace engine {
         }
         std::cout << "Enter the number of the device... ";
         std::string s;
-        if (deviceCount == 1) {
+        if (m_deviceIndex.has_value()) {
+            s = std::to_string(m_deviceIndex.value());
+            std::cout << s << std::endl;
+        } else if (m_deviceType.has_value()) {
+            s = "-1";
+            for (uint32_t j = 0; j < deviceCount; j++) {
+                VkPhysicalDeviceProperties deviceProperties;
+                vkGetPhysicalDeviceProperties(devices[j], &deviceProperties);
+                if (deviceProperties.deviceType == m_deviceType.value()) {
+                    s = std::to_string(j);
+                    break;
+                }
+            }
+            std::cout << s << std::endl;
+        } else if (deviceCount == 1) {
             s = "0";
             std::cout << s << std::endl;
         } else {
             std::cin >> s;
         }
-        int i;
+        int i = -1;
         try {
             i = std::stoi(s);
         } catch (std::invalid_argument const &ex) {
@@ -189,9 +213,19 @@ namespace engine {
             throw std::runtime_error("Failed to find a suitable GPU!");
         }
 
-        VkPhysicalDeviceVulkan12Features v12Features{.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES};
+        VkPhysicalDeviceVulkan13Features v13Features{.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_3_FEATURES};
+        VkPhysicalDeviceVulkan12Features v12Features{.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES, .pNext = &v13Features};
         VkPhysicalDeviceFeatures2 deviceFeatures{.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2, .pNext = &v12Features};
         vkGetPhysicalDeviceFeatures2(m_physicalDevice, &deviceFeatures);
+        m_subgroupSizeControl = v13Features.subgroupSizeControl && v13Features.computeFullSubgroups; // all supported features are enabled in createLogicalDevice
+
+        m_subgroupSizeControlProperties = {.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SUBGROUP_SIZE_CONTROL_PROPERTIES};
+        m_subgroupProperties = {.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SUBGROUP_PROPERTIES, .pNext = &m_subgroupSizeControlProperties};
+        VkPhysicalDeviceProperties2 deviceProperties{.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2, .pNext = &m_subgroupProperties};
+        vkGetPhysicalDeviceProperties2(m_physicalDevice, &deviceProperties);
+        m_deviceProperties = deviceProperties.properties;
+        m_subgroupProperties.pNext = nullptr;
+        m_subgroupSizeControl = m_subgroupSizeControl && (m_subgroupSizeControlProperties.requiredSubgroupSizeStages & VK_SHADER_STAGE_COMPUTE_BIT);
     }
 
     void GPUContext::createLogicalDevice() {
@@ -270,4 +304,73 @@ namespace engine {
             throw std::runtime_error("Failed to allocate command buffers!");
         }
     }
+
+    void GPUContext::createPipelineCache() {
+        if (m_pipelineCachePath.empty()) {
+            m_pipelineCachePath = (std::filesystem::canonical("/proc/self/exe").remove_filename() / "pipeline_cache.bin").string();
+        }
+
+        std::vector<char> data;
+        std::ifstream file(m_pipelineCachePath, std::ios::ate | std::ios::binary);
+        if (file.is_open()) {
+            data.resize(static_cast<size_t>(file.tellg()));
+            file.seekg(0);
+            file.read(data.data(), static_cast<std::streamsize>(data.size()));
+            file.close();
+            if (!isPipelineCacheCompatible(data)) {
+                std::cout << "[GPUContext] Discarding pipeline cache " << m_pipelineCachePath << " (created for another device or driver)." << std::endl;
+                data.clear();
+            }
+        }
+        m_pipelineCacheWarm = !data.empty();
+
+        VkPipelineCacheCreateInfo createInfo{};
+        createInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+        createInfo.initialDataSize = data.size();
+        createInfo.pInitialData = data.empty() ? nullptr : data.data();
+        if (vkCreatePipelineCache(m_device, &createInfo, nullptr, &m_pipelineCache) != VK_SUCCESS) {
+            throw std::runtime_error("Failed to create pipeline cache!");
+        }
+    }
+
+    void GPUContext::releasePipelineCache() {
+        savePipelineCache();
+        vkDestroyPipelineCache(m_device, m_pipelineCache, nullptr);
+        m_pipelineCache = VK_NULL_HANDLE;
+    }
+
+    void GPUContext::savePipelineCache() {
+        size_t size = 0;
+        if (vkGetPipelineCacheData(m_device, m_pipelineCache, &size, nullptr) != VK_SUCCESS || size == 0) {
+            return;
+        }
+        std::vector<char> data(size);
+        if (vkGetPipelineCacheData(m_device, m_pipelineCache, &size, data.data()) != VK_SUCCESS) {
+            return;
+        }
+
+        // write into a temporary file and rename it, i.e. the cache is never read partially written
+        const std::string temporaryPath = m_pipelineCachePath + ".tmp";
+        std::ofstream file(temporaryPath, std::ios::binary | std::ios::trunc);
+        if (!file.is_open()) {
+            std::cout << "[GPUContext] Failed to save pipeline cache " << m_pipelineCachePath << "." << std::endl;
+            return;
+        }
+        file.write(data.data(), static_cast<std::streamsize>(size));
+        file.close();
+        std::filesystem::rename(temporaryPath, m_pipelineCachePath);
+    }
+
+    // the driver should reject incompatible data itself, but not all drivers do, therefore the header is validated before
+    bool GPUContext::isPipelineCacheCompatible(const std::vector<char> &data) const {
+        VkPipelineCacheHeaderVersionOne header{};
+        if (data.size() < sizeof(header)) {
+            return false;
+        }
+        std::memcpy(&header, data.data(), sizeof(header));
+
+        VkPhysicalDeviceProperties deviceProperties;
+        vkGetPhysicalDeviceProperties(m_physicalDevice, &deviceProperties);
+        return header.headerSize >= sizeof(header) && header.headerVersion == VK_PIPELINE_CACHE_HEADER_VERSION_ONE && header.vendorID == deviceProperties.vendorID && header.deviceID == deviceProperties.deviceID && std::memcmp(header.pipelineCacheUUID, deviceProperties.pipelineCacheUUID, VK_UUID_SIZE) == 0;
+    }
 } // namespace engine
\ No newline at end of file
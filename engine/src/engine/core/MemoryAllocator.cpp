@@ -0,0 +1,280 @@
+#include "engine/core/MemoryAllocator.h"
+
+#include <algorithm>
+#include <iostream>
+#include <stdexcept>
+
+namespace engine {
+    MemoryAllocator::MemoryAllocator(VkDevice device, VkPhysicalDevice physicalDevice, VkDeviceSize blockSize) : m_device(device), m_blockSize(blockSize) {
+        vkGetPhysicalDeviceMemoryProperties(physicalDevice, &m_memoryProperties);
+
+        VkPhysicalDeviceProperties properties;
+        vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+        m_nonCoherentAtomSize = std::max<VkDeviceSize>(1, properties.limits.nonCoherentAtomSize);
+    }
+
+    MemoryAllocator::~MemoryAllocator() {
+        release();
+    }
+
+    void MemoryAllocator::release() {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        uint32_t numLeakedAllocations = 0;
+        for (auto &pool: m_pools) {
+            for (auto &block: pool.m_blocks) {
+                numLeakedAllocations += block.m_numAllocations;
+                releaseBlock(block);
+            }
+        }
+        m_pools.clear();
+        if (numLeakedAllocations > 0) {
+            std::cout << PRINT_PREFIX << numLeakedAllocations << " allocation(s) not freed before release." << std::endl;
+        }
+    }
+
+    MemoryAllocator::Allocation MemoryAllocator::allocate(const VkMemoryRequirements &memoryRequirements, VkMemoryPropertyFlags memoryProperties, VkMemoryAllocateFlags memoryAllocateFlags) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        const uint32_t poolIndex = getPool(findMemoryType(memoryRequirements.memoryTypeBits, memoryProperties), memoryAllocateFlags);
+        Pool &pool = m_pools[poolIndex];
+
+        // flushed/invalidated ranges are aligned to nonCoherentAtomSize, i.e. they must not overlap other allocations
+        VkDeviceSize alignment = std::max<VkDeviceSize>(1, memoryRequirements.alignment);
+        VkDeviceSize size = std::max<VkDeviceSize>(1, memoryRequirements.size);
+        if (pool.m_hostVisible && !pool.m_coherent) {
+            alignment = std::max(alignment, m_nonCoherentAtomSize);
+            size = (size + m_nonCoherentAtomSize - 1) / m_nonCoherentAtomSize * m_nonCoherentAtomSize;
+        }
+
+        uint32_t blockIndex = 0;
+        VkDeviceSize offset = 0;
+        if (size > pool.m_blockSize / 2) {
+            blockIndex = createBlock(pool, size, true);
+        } else {
+            bool found = false;
+            for (; blockIndex < pool.m_blocks.size(); blockIndex++) {
+                Block &block = pool.m_blocks[blockIndex];
+                if (block.m_memory != VK_NULL_HANDLE && !block.m_dedicated && allocateFromBlock(block, size, alignment, offset)) {
+                    found = true;
+                    break;
+                }
+            }
+            if (!found) {
+                blockIndex = createBlock(pool, pool.m_blockSize, false);
+                allocateFromBlock(pool.m_blocks[blockIndex], size, alignment, offset);
+            }
+        }
+
+        Block &block = pool.m_blocks[blockIndex];
+        block.m_numAllocations++;
+        m_totalAllocations++;
+
+        Allocation allocation;
+        allocation.m_memory = block.m_memory;
+        allocation.m_offset = offset;
+        allocation.m_size = size;
+        allocation.m_mappedData = block.m_mappedData ? static_cast<char *>(block.m_mappedData) + offset : nullptr;
+        allocation.m_coherent = pool.m_coherent;
+        allocation.m_poolIndex = poolIndex;
+        allocation.m_blockIndex = blockIndex;
+        return allocation;
+    }
+
+    void MemoryAllocator::free(Allocation &allocation) {
+        if (allocation.m_memory == VK_NULL_HANDLE) {
+            return;
+        }
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+        Pool &pool = m_pools[allocation.m_poolIndex];
+        Block &block = pool.m_blocks[allocation.m_blockIndex];
+        block.m_numAllocations--;
+        if (block.m_dedicated) {
+            releaseBlock(block);
+        } else {
+            freeToBlock(block, allocation.m_offset, allocation.m_size);
+            // keep a single empty block per pool, e.g. for the staging buffers that are created and destroyed for every upload
+            if (block.m_numAllocations == 0) {
+                for (uint32_t i = 0; i < pool.m_blocks.size(); i++) {
+                    const Block &other = pool.m_blocks[i];
+                    if (i != allocation.m_blockIndex && other.m_memory != VK_NULL_HANDLE && !other.m_dedicated && other.m_numAllocations == 0) {
+                        releaseBlock(block);
+                        break;
+                    }
+                }
+            }
+        }
+        allocation = {};
+    }
+
+    void MemoryAllocator::flush(const Allocation &allocation, VkDeviceSize offset, VkDeviceSize size) const {
+        if (allocation.m_coherent || !allocation.m_mappedData) {
+            return;
+        }
+        const VkDeviceSize begin = (allocation.m_offset + offset) / m_nonCoherentAtomSize * m_nonCoherentAtomSize;
+        const VkDeviceSize end = (allocation.m_offset + offset + size + m_nonCoherentAtomSize - 1) / m_nonCoherentAtomSize * m_nonCoherentAtomSize;
+        VkMappedMemoryRange range{.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE, .memory = allocation.m_memory, .offset = begin, .size = end - begin};
+        vkFlushMappedMemoryRanges(m_device, 1, &range);
+    }
+
+    void MemoryAllocator::invalidate(const Allocation &allocation, VkDeviceSize offset, VkDeviceSize size) const {
+        if (allocation.m_coherent || !allocation.m_mappedData) {
+            return;
+        }
+        const VkDeviceSize begin = (allocation.m_offset + offset) / m_nonCoherentAtomSize * m_nonCoherentAtomSize;
+        const VkDeviceSize end = (allocation.m_offset + offset + size + m_nonCoherentAtomSize - 1) / m_nonCoherentAtomSize * m_nonCoherentAtomSize;
+        VkMappedMemoryRange range{.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE, .memory = allocation.m_memory, .offset = begin, .size = end - begin};
+        vkInvalidateMappedMemoryRanges(m_device, 1, &range);
+    }
+
+    MemoryAllocator::Statistics MemoryAllocator::getStatistics() {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        Statistics statistics;
+        statistics.totalBlockAllocations = m_totalBlockAllocations;
+        statistics.totalAllocations = m_totalAllocations;
+        VkDeviceSize freeBytes = 0;
+        for (const auto &pool: m_pools) {
+            for (const auto &block: pool.m_blocks) {
+                if (block.m_memory == VK_NULL_HANDLE) {
+                    continue;
+                }
+                statistics.numBlocks++;
+                statistics.numDedicatedBlocks += block.m_dedicated;
+                statistics.numAllocations += block.m_numAllocations;
+                statistics.blockBytes += block.m_size;
+                for (const auto &[offset, size]: block.m_freeRanges) {
+                    statistics.numFreeRanges++;
+                    statistics.largestFreeRange = std::max(statistics.largestFreeRange, size);
+                    freeBytes += size;
+                }
+            }
+        }
+        statistics.usedBytes = statistics.blockBytes - freeBytes;
+        statistics.fragmentation = freeBytes > 0 ? 1.0 - static_cast<double>(statistics.largestFreeRange) / static_cast<double>(freeBytes) : 0;
+        return statistics;
+    }
+
+    void MemoryAllocator::printStatistics() {
+        const Statistics statistics = getStatistics();
+        std::cout << PRINT_PREFIX << statistics.numAllocations << " allocation(s) in " << statistics.numBlocks << " block(s) (" << statistics.numDedicatedBlocks << " dedicated), "
+                  << statistics.usedBytes / (1024 * 1024) << " of " << statistics.blockBytes / (1024 * 1024) << " MiB used, "
+                  << statistics.numFreeRanges << " free range(s), fragmentation: " << statistics.fragmentation << ", "
+                  << statistics.totalBlockAllocations << " vkAllocateMemory call(s) for " << statistics.totalAllocations << " allocation(s) in total." << std::endl;
+    }
+
+    uint32_t MemoryAllocator::findMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties) const {
+        for (uint32_t i = 0; i < m_memoryProperties.memoryTypeCount; i++) {
+            if ((typeFilter & (1 << i)) && (m_memoryProperties.memoryTypes[i].propertyFlags & properties) == properties) {
+                return i;
+            }
+        }
+
+        throw std::runtime_error("Failed to find suitable memory type!");
+    }
+
+    uint32_t MemoryAllocator::getPool(uint32_t memoryTypeIndex, VkMemoryAllocateFlags memoryAllocateFlags) {
+        for (uint32_t i = 0; i < m_pools.size(); i++) {
+            if (m_pools[i].m_memoryTypeIndex == memoryTypeIndex && m_pools[i].m_memoryAllocateFlags == memoryAllocateFlags) {
+                return i;
+            }
+        }
+
+        const VkMemoryType &memoryType = m_memoryProperties.memoryTypes[memoryTypeIndex];
+        const VkDeviceSize heapSize = m_memoryProperties.memoryHeaps[memoryType.heapIndex].size;
+        Pool pool;
+        pool.m_memoryTypeIndex = memoryTypeIndex;
+        pool.m_memoryAllocateFlags = memoryAllocateFlags;
+        pool.m_blockSize = std::max<VkDeviceSize>(m_nonCoherentAtomSize, std::min(m_blockSize, heapSize / 8) / m_nonCoherentAtomSize * m_nonCoherentAtomSize);
+        pool.m_hostVisible = memoryType.propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT;
+        pool.m_coherent = memoryType.propertyFlags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+        m_pools.push_back(std::move(pool));
+        return m_pools.size() - 1;
+    }
+
+    uint32_t MemoryAllocator::createBlock(Pool &pool, VkDeviceSize size, bool dedicated) {
+        VkMemoryAllocateInfo allocInfo{};
+        allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+        allocInfo.allocationSize = size;
+        allocInfo.memoryTypeIndex = pool.m_memoryTypeIndex;
+        VkMemoryAllocateFlagsInfo memoryAllocateFlagsInfo{};
+        if (pool.m_memoryAllocateFlags != 0) {
+            memoryAllocateFlagsInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_FLAGS_INFO;
+            memoryAllocateFlagsInfo.flags = pool.m_memoryAllocateFlags;
+            allocInfo.pNext = &memoryAllocateFlagsInfo;
+        }
+
+        Block block;
+        block.m_size = size;
+        block.m_dedicated = dedicated;
+        if (vkAllocateMemory(m_device, &allocInfo, nullptr, &block.m_memory) != VK_SUCCESS) {
+            throw std::runtime_error("Failed to allocate buffer memory!");
+        }
+        m_totalBlockAllocations++;
+        if (pool.m_hostVisible && vkMapMemory(m_device, block.m_memory, 0, VK_WHOLE_SIZE, 0, &block.m_mappedData) != VK_SUCCESS) {
+            vkFreeMemory(m_device, block.m_memory, nullptr);
+            throw std::runtime_error("Failed to map buffer memory!");
+        }
+        if (!dedicated) {
+            block.m_freeRanges.emplace(0, size);
+        }
+
+        // reuse the index of a released block
+        for (uint32_t i = 0; i < pool.m_blocks.size(); i++) {
+            if (pool.m_blocks[i].m_memory == VK_NULL_HANDLE) {
+                pool.m_blocks[i] = std::move(block);
+                return i;
+            }
+        }
+        pool.m_blocks.push_back(std::move(block));
+        return pool.m_blocks.size() - 1;
+    }
+
+    void MemoryAllocator::releaseBlock(Block &block) {
+        if (block.m_memory == VK_NULL_HANDLE) {
+            return;
+        }
+        if (block.m_mappedData) {
+            vkUnmapMemory(m_device, block.m_memory);
+        }
+        vkFreeMemory(m_device, block.m_memory, nullptr);
+        block = {};
+    }
+
+    bool MemoryAllocator::allocateFromBlock(Block &block, VkDeviceSize size, VkDeviceSize alignment, VkDeviceSize &offset) {
+        for (auto it = block.m_freeRanges.begin(); it != block.m_freeRanges.end(); ++it) {
+            const auto [rangeOffset, rangeSize] = *it;
+            const VkDeviceSize alignedOffset = (rangeOffset + alignment - 1) / alignment * alignment;
+            const VkDeviceSize padding = alignedOffset - rangeOffset;
+            if (rangeSize < padding + size) {
+                continue;
+            }
+            // the padding in front and the rest behind the allocation stay free
+            block.m_freeRanges.erase(it);
+            if (padding > 0) {
+                block.m_freeRanges.emplace(rangeOffset, padding);
+            }
+            if (rangeSize > padding + size) {
+                block.m_freeRanges.emplace(alignedOffset + size, rangeSize - padding - size);
+            }
+            offset = alignedOffset;
+            return true;
+        }
+        return false;
+    }
+
+    void MemoryAllocator::freeToBlock(Block &block, VkDeviceSize offset, VkDeviceSize size) {
+        // merge with the adjacent free ranges
+        auto next = block.m_freeRanges.lower_bound(offset);
+        if (next != block.m_freeRanges.end() && offset + size == next->first) {
+            size += next->second;
+            next = block.m_freeRanges.erase(next);
+        }
+        if (next != block.m_freeRanges.begin()) {
+            auto previous = std::prev(next);
+            if (previous->first + previous->second == offset) {
+                previous->second += size;
+                return;
+            }
+        }
+        block.m_freeRanges.emplace(offset, size);
+    }
+} // namespace engine
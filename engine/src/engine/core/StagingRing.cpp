@@ -0,0 +1,270 @@
+#include "engine/core/StagingRing.h"
+#include "engine/core/Buffer.h"
+
+#include <tuple>
+
+namespace engine {
+    StagingRing::StagingRing(GPUContext *gpuContext, VkDeviceSize sizeBytes) : m_gpuContext(gpuContext), m_sizeBytes((sizeBytes + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT) {
+        if (m_sizeBytes < 4 * ALIGNMENT || m_sizeBytes > UINT32_MAX) {
+            throw std::runtime_error("Invalid staging ring size!");
+        }
+        m_buffer = std::make_shared<Buffer>(m_gpuContext, Buffer::BufferSettings{.m_sizeBytes = static_cast<uint32_t>(m_sizeBytes), .m_bufferUsages = VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, .m_memoryProperties = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, .m_name = "stagingRing"});
+        m_mappedData = static_cast<char *>(m_buffer->mapHostMemory());
+
+        VkCommandPoolCreateInfo poolInfo{};
+        poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+        poolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT; // command buffers of retired batches are reused
+        poolInfo.queueFamilyIndex = m_gpuContext->m_queues->findQueueFamilies(m_gpuContext->m_physicalDevice).transferFamily.value();
+        if (vkCreateCommandPool(m_gpuContext->m_device, &poolInfo, nullptr, &m_commandPool) != VK_SUCCESS) {
+            throw std::runtime_error("Failed to create command pool!");
+        }
+
+        VkSemaphoreTypeCreateInfo typeInfo{};
+        typeInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO;
+        typeInfo.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+        typeInfo.initialValue = 0;
+        VkSemaphoreCreateInfo semaphoreInfo{};
+        semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+        semaphoreInfo.pNext = &typeInfo;
+        if (vkCreateSemaphore(m_gpuContext->m_device, &semaphoreInfo, nullptr, &m_timelineSemaphore) != VK_SUCCESS) {
+            throw std::runtime_error("Failed to create timeline semaphore!");
+        }
+    }
+
+    StagingRing::~StagingRing() {
+        release();
+    }
+
+    void StagingRing::release() {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_commandPool == VK_NULL_HANDLE) {
+            return;
+        }
+        submitOpenBatch();
+        while (!m_submittedBatches.empty()) {
+            retireOldestBatch();
+        }
+        for (const auto &[commandBuffer, fence]: m_freeCommandBuffers) {
+            vkDestroyFence(m_gpuContext->m_device, fence, nullptr);
+        }
+        m_freeCommandBuffers.clear();
+        vkDestroyCommandPool(m_gpuContext->m_device, m_commandPool, nullptr); // frees the command buffers
+        m_commandPool = VK_NULL_HANDLE;
+        vkDestroySemaphore(m_gpuContext->m_device, m_timelineSemaphore, nullptr);
+        m_timelineSemaphore = VK_NULL_HANDLE;
+        m_buffer->release();
+        m_buffer = nullptr;
+        m_mappedData = nullptr;
+    }
+
+    StagingRing::TransferHandle StagingRing::upload(VkBuffer dstBuffer, VkDeviceSize dstOffset, const void *data, VkDeviceSize sizeBytes) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        TransferHandle handle;
+        // chunks of a quarter of the ring, i.e. the host copies the next chunk while the previous chunks are transferred
+        const VkDeviceSize chunkSize = m_sizeBytes / 4 / ALIGNMENT * ALIGNMENT;
+        for (VkDeviceSize done = 0; done < sizeBytes; done += chunkSize) {
+            const VkDeviceSize size = std::min(chunkSize, sizeBytes - done);
+            const VkDeviceSize ringOffset = allocate(size);
+            if (m_openBatch.m_commandBuffer == VK_NULL_HANDLE) {
+                beginBatch();
+            }
+            memcpy(m_mappedData + ringOffset, static_cast<const char *>(data) + done, size);
+
+            VkBufferCopy copyRegion{.srcOffset = ringOffset, .dstOffset = dstOffset + done, .size = size};
+            vkCmdCopyBuffer(m_openBatch.m_commandBuffer, m_buffer->getBuffer(), dstBuffer, 1, &copyRegion);
+
+            handle.m_batchId = m_openBatch.m_id;
+            if (m_openBatch.m_sizeBytes >= chunkSize) {
+                submitOpenBatch();
+            }
+        }
+        m_statistics.numTransfers++;
+        m_statistics.uploadedBytes += sizeBytes;
+        return handle;
+    }
+
+    StagingRing::TransferHandle StagingRing::download(VkBuffer srcBuffer, VkDeviceSize srcOffset, void *data, VkDeviceSize sizeBytes) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        TransferHandle handle;
+        const VkDeviceSize chunkSize = m_sizeBytes / 4 / ALIGNMENT * ALIGNMENT;
+        for (VkDeviceSize done = 0; done < sizeBytes; done += chunkSize) {
+            const VkDeviceSize size = std::min(chunkSize, sizeBytes - done);
+            const VkDeviceSize ringOffset = allocate(size); // retires older batches, i.e. copies their downloads to the host
+            if (m_openBatch.m_commandBuffer == VK_NULL_HANDLE) {
+                beginBatch();
+            }
+
+            VkBufferCopy copyRegion{.srcOffset = srcOffset + done, .dstOffset = ringOffset, .size = size};
+            vkCmdCopyBuffer(m_openBatch.m_commandBuffer, srcBuffer, m_buffer->getBuffer(), 1, &copyRegion);
+            m_openBatch.m_downloads.push_back({ringOffset, static_cast<char *>(data) + done, size});
+
+            handle.m_batchId = m_openBatch.m_id;
+            if (m_openBatch.m_sizeBytes >= chunkSize) {
+                submitOpenBatch();
+            }
+        }
+        m_statistics.numTransfers++;
+        m_statistics.downloadedBytes += sizeBytes;
+        return handle;
+    }
+
+    StagingRing::TransferHandle StagingRing::submit() {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        TransferHandle handle{.m_batchId = m_openBatch.m_id};
+        submitOpenBatch();
+        return handle;
+    }
+
+    void StagingRing::wait(TransferHandle handle) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (handle.m_batchId == 0) {
+            return;
+        }
+        if (handle.m_batchId == m_openBatch.m_id) {
+            submitOpenBatch();
+        }
+        while (m_finishedBatchId < handle.m_batchId && !m_submittedBatches.empty()) {
+            retireOldestBatch();
+        }
+    }
+
+    bool StagingRing::isFinished(TransferHandle handle) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        while (!m_submittedBatches.empty() && vkGetFenceStatus(m_gpuContext->m_device, m_submittedBatches.front().m_fence) == VK_SUCCESS) {
+            retireOldestBatch();
+        }
+        return m_finishedBatchId >= handle.m_batchId;
+    }
+
+    StagingRing::Statistics StagingRing::getStatistics() {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_statistics;
+    }
+
+    VkDeviceSize StagingRing::allocate(VkDeviceSize sizeBytes) {
+        const VkDeviceSize size = (sizeBytes + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT;
+        while (true) {
+            if (m_usedBytes == 0) {
+                m_head = 0;
+                m_tail = 0;
+            }
+
+            // free: [head, end of ring) and [0, tail) if the used bytes do not wrap around, [head, tail) otherwise
+            VkDeviceSize skipped = 0;
+            bool fits = false;
+            if (m_usedBytes == 0 || m_head > m_tail) {
+                if (m_head + size <= m_sizeBytes) {
+                    fits = true;
+                } else if (size <= m_tail) {
+                    skipped = m_sizeBytes - m_head; // a region is never split at the end of the ring
+                    fits = true;
+                }
+            } else if (m_head < m_tail) {
+                fits = m_head + size <= m_tail;
+            }
+
+            if (fits) {
+                const VkDeviceSize offset = (m_head + skipped) % m_sizeBytes;
+                m_head = (offset + size) % m_sizeBytes;
+                m_usedBytes += skipped + size;
+                m_openBatch.m_sizeBytes += skipped + size;
+                m_openBatch.m_end = m_head;
+                return offset;
+            }
+
+            // wait for the oldest batch, the open batch is submitted first if it is the only one that holds ring memory
+            if (m_submittedBatches.empty()) {
+                if (m_openBatch.m_commandBuffer == VK_NULL_HANDLE) {
+                    throw std::runtime_error("Staging ring region exceeds the ring size!");
+                }
+                submitOpenBatch();
+            }
+            m_statistics.numStalls++;
+            retireOldestBatch();
+        }
+    }
+
+    void StagingRing::beginBatch() {
+        if (m_freeCommandBuffers.empty()) {
+            VkCommandBufferAllocateInfo allocInfo{};
+            allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+            allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+            allocInfo.commandPool = m_commandPool;
+            allocInfo.commandBufferCount = 1;
+            VkCommandBuffer commandBuffer;
+            if (vkAllocateCommandBuffers(m_gpuContext->m_device, &allocInfo, &commandBuffer) != VK_SUCCESS) {
+                throw std::runtime_error("Failed to allocate command buffers!");
+            }
+
+            VkFenceCreateInfo fenceInfo{};
+            fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+            VkFence fence;
+            if (vkCreateFence(m_gpuContext->m_device, &fenceInfo, nullptr, &fence) != VK_SUCCESS) {
+                throw std::runtime_error("Failed to create fence!");
+            }
+            m_freeCommandBuffers.emplace_back(commandBuffer, fence);
+        }
+
+        std::tie(m_openBatch.m_commandBuffer, m_openBatch.m_fence) = m_freeCommandBuffers.back();
+        m_freeCommandBuffers.pop_back();
+        m_openBatch.m_id = m_nextBatchId++;
+
+        VkCommandBufferBeginInfo beginInfo{};
+        beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+        beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+        vkBeginCommandBuffer(m_openBatch.m_commandBuffer, &beginInfo);
+    }
+
+    void StagingRing::submitOpenBatch() {
+        if (m_openBatch.m_commandBuffer == VK_NULL_HANDLE) {
+            return;
+        }
+
+        if (!m_openBatch.m_downloads.empty()) {
+            // make the transfer writes visible to the host reads in retireOldestBatch
+            VkMemoryBarrier memoryBarrier{};
+            memoryBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+            memoryBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+            memoryBarrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+            vkCmdPipelineBarrier(m_openBatch.m_commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+        }
+        vkEndCommandBuffer(m_openBatch.m_commandBuffer);
+
+        // the batches are submitted in the order of their ids, i.e. the signaled values increase
+        VkTimelineSemaphoreSubmitInfo timelineInfo{};
+        timelineInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+        timelineInfo.signalSemaphoreValueCount = 1;
+        timelineInfo.pSignalSemaphoreValues = &m_openBatch.m_id;
+
+        VkSubmitInfo submitInfo{};
+        submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+        submitInfo.pNext = &timelineInfo;
+        submitInfo.commandBufferCount = 1;
+        submitInfo.pCommandBuffers = &m_openBatch.m_commandBuffer;
+        submitInfo.signalSemaphoreCount = 1;
+        submitInfo.pSignalSemaphores = &m_timelineSemaphore;
+        if (vkQueueSubmit(m_gpuContext->m_queues->getQueue(Queues::TRANSFER), 1, &submitInfo, m_openBatch.m_fence) != VK_SUCCESS) {
+            throw std::runtime_error("Failed to submit staging ring batch!");
+        }
+        m_statistics.numSubmits++;
+
+        m_submittedBatches.push_back(std::move(m_openBatch));
+        m_openBatch = {};
+    }
+
+    void StagingRing::retireOldestBatch() {
+        Batch &batch = m_submittedBatches.front();
+        vkWaitForFences(m_gpuContext->m_device, 1, &batch.m_fence, VK_TRUE, UINT64_MAX);
+        for (const auto &download: batch.m_downloads) {
+            memcpy(download.m_data, m_mappedData + download.m_ringOffset, download.m_sizeBytes);
+        }
+
+        m_tail = batch.m_end;
+        m_usedBytes -= batch.m_sizeBytes;
+        m_finishedBatchId = batch.m_id;
+
+        vkResetFences(m_gpuContext->m_device, 1, &batch.m_fence);
+        m_freeCommandBuffers.emplace_back(batch.m_commandBuffer, batch.m_fence);
+        m_submittedBatches.pop_front();
+    }
+} // namespace engine
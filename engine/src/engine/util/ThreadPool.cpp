@@ -0,0 +1,68 @@
+#include "engine/util/ThreadPool.h"
+
+#include <algorithm>
+
+namespace engine {
+
+    ThreadPool::ThreadPool(uint32_t numThreads) : m_numThreads(std::max(1u, numThreads)) {
+        for (uint32_t i = 1; i < m_numThreads; i++) {
+            m_workers.emplace_back(&ThreadPool::work, this, i);
+        }
+    }
+
+    ThreadPool::~ThreadPool() {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_stop = true;
+        }
+        m_start.notify_all();
+        for (auto &worker: m_workers) {
+            worker.join();
+        }
+    }
+
+    void ThreadPool::parallelFor(uint32_t count, const std::function<void(uint32_t, uint32_t, uint32_t)> &function) {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_function = &function;
+            m_count = count;
+            m_numPending = m_numThreads - 1;
+            m_generation++;
+        }
+        m_start.notify_all();
+
+        processChunk(0);
+
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_done.wait(lock, [this] { return m_numPending == 0; });
+        m_function = nullptr;
+    }
+
+    void ThreadPool::work(uint32_t threadIdx) {
+        uint64_t generation = 0;
+        std::unique_lock<std::mutex> lock(m_mutex);
+        while (true) {
+            m_start.wait(lock, [this, generation] { return m_stop || m_generation != generation; });
+            if (m_stop) {
+                return;
+            }
+            generation = m_generation;
+
+            lock.unlock();
+            processChunk(threadIdx);
+            lock.lock();
+
+            if (--m_numPending == 0) {
+                m_done.notify_one();
+            }
+        }
+    }
+
+    void ThreadPool::processChunk(uint32_t threadIdx) {
+        const auto begin = static_cast<uint32_t>(static_cast<uint64_t>(m_count) * threadIdx / m_numThreads);
+        const auto end = static_cast<uint32_t>(static_cast<uint64_t>(m_count) * (threadIdx + 1) / m_numThreads);
+        if (begin < end) {
+            (*m_function)(threadIdx, begin, end);
+        }
+    }
+} // namespace engine
@@ -1,81 +1,365 @@
 #pragma once
 
 #include "AABB.h"
+#include "LBVHTypes.h"
 #include "LBVHPass.h"
+#include "LBVHQueryPass.h"
 #include "tinyobjloader/tiny_obj_loader.h"
 
 #include <glm/glm.hpp>
+#include <algorithm>
+#include <cstring>
 #include <random>
 #include <utility>
 
 namespace engine {
-    class LBVH {
-    private:
-        // input for the builder (normally a triangle or some other kind of primitive); it is necessary to allocate and fill the buffer
-        struct Element {
-            uint32_t primitiveIdx; // the id of the primitive; this primitive id is copied to the leaf nodes of the  LBVHNode
-            float aabbMinX;        // aabb of the primitive
-            float aabbMinY;
-            float aabbMinZ;
-            float aabbMaxX;
-            float aabbMaxY;
-            float aabbMaxZ;
-        };
-
-        // output of the builder; it is necessary to allocate the (empty) buffer
-        struct LBVHNode {
-            int32_t left;          // pointer to the left child or INVALID_POINTER in case of leaf
-            int32_t right;         // pointer to the right child or INVALID_POINTER in case of leaf
-            uint32_t primitiveIdx; // custom value that is copied from the input Element or 0 in case of inner node
-            float aabbMinX;        // aabb of the node
-            float aabbMinY;
-            float aabbMinZ;
-            float aabbMaxX;
-            float aabbMaxY;
-            float aabbMaxZ;
-        };
+    class LBVHCPUBuilder;
+    class LBVHBuilder;
+    class LBVHQualityAnalyzer;
+    class LBVHTwoLevelBuilder;
 
+    class LBVH {
+    public:
         // only used on the GPU side during construction; it is necessary to allocate the (empty) buffer
         struct MortonCodeElement {
             uint32_t mortonCode; // key for sorting
             uint32_t elementIdx; // pointer into element buffer
         };
 
+        // only used on the GPU side during construction in case of 63-bit morton codes (MORTON_CODES_64); it is necessary to allocate the (empty) buffer
+        struct MortonCodeElement64 {
+            uint64_t mortonCode; // key for sorting
+            uint32_t elementIdx; // pointer into element buffer
+            uint32_t padding;
+        };
+
         // only used on the GPU side during construction; it is necessary to allocate the (empty) buffer
         struct LBVHConstructionInfo {
             uint32_t parent;         // pointer to the parent
             int32_t visitationCount; // number of threads that arrived
         };
 
-#define INVALID_POINTER 0x0 // do not change
+        // only used on the GPU side during PLOC construction; it is necessary to allocate the (empty) buffer
+        struct PLOCState {
+            uint32_t numClusters;      // number of clusters of the current iteration
+            uint32_t nodeCounter;      // number of created internal nodes
+            uint32_t dispatchX;        // indirect dispatch (VkDispatchIndirectCommand) for nearest neighbour and merge
+            uint32_t dispatchY;
+            uint32_t dispatchZ;
+            uint32_t compactDispatchX; // indirect dispatch (VkDispatchIndirectCommand) for compact
+            uint32_t compactDispatchY;
+            uint32_t compactDispatchZ;
+        };
+
+        // only used on the GPU side during construction; it is necessary to allocate the (empty) buffer
+        struct LBVHExtent {
+            uint32_t minX; // extent of the centroids of all elements, the floats are stored as order-preserving uints (see floatToOrderedUint in lbvh_common.glsl)
+            uint32_t minY;
+            uint32_t minZ;
+            uint32_t maxX;
+            uint32_t maxY;
+            uint32_t maxZ;
+        };
+
+        // input for the ray queries (LBVHQueryPass); it is necessary to allocate and fill the buffer
+        struct Ray {
+            float originX;
+            float originY;
+            float originZ;
+            float tMin;       // the ray is the segment origin + t * direction, t in [tMin, tMax]
+            float directionX;
+            float directionY;
+            float directionZ;
+            float tMax;
+        };
+
+        // output of the ray queries (LBVHQueryPass); it is necessary to allocate the (empty) buffer
+        struct RayHit {
+            uint32_t primitiveIdx;  // primitiveIdx of the hit primitive or INVALID_PRIMITIVE in case of miss
+            float t;                // ray parameter of the hit
+            uint32_t stackOverflow; // 1 if the traversal stack (LBVHQueryPass stackSize) was too small for the LBVH, i.e. subtrees were skipped and the hit may be wrong
+        };
+
+        // input for the two-level ray queries (LBVHQueryPass), one per instance (written by LBVHTwoLevelBuilder); it is necessary to allocate and fill the buffer
+        struct LBVHInstance {
+            float worldToObject[12]; // inverse of the object to world transform (3x4, row-major), the rays are transformed into the object space of the instance
+            uint32_t nodeOffset;     // root of the LBVH of the mesh in the bottom-level buffer (LBVHSegment::nodeOffset)
+            uint32_t meshIdx;
+        };
+
+        // output of the two-level ray queries (LBVHQueryPass); it is necessary to allocate the (empty) buffer
+        struct InstanceRayHit {
+            uint32_t instanceIdx;   // index of the hit instance or INVALID_PRIMITIVE in case of miss
+            uint32_t primitiveIdx;  // primitiveIdx of the hit primitive of the mesh or INVALID_PRIMITIVE in case of miss
+            float t;                // ray parameter of the hit (the same in world and object space, the direction is transformed without normalization)
+            uint32_t stackOverflow; // 1 if the traversal stack (LBVHQueryPass stackSize) was too small for the top-level or a bottom-level LBVH, i.e. subtrees were skipped and the hit may be wrong
+        };
+
+        // output of the overlap queries (LBVHQueryPass); it is necessary to allocate the (empty) buffer
+        struct OverlapPair {
+            uint32_t queryIdx;     // index of the query aabb
+            uint32_t primitiveIdx; // primitiveIdx of the overlapping leaf
+        };
+
+        // state of the overlap queries (LBVHQueryPass); it is necessary to allocate the buffer, it is reset by the pass before each execution
+        struct LBVHOverlapState {
+            uint32_t pairCount;          // number of found pairs, may exceed the capacity of the pair buffer
+            uint32_t overflowCount;      // number of pairs that did not fit into the pair buffer
+            uint32_t resumeQueryIdx;     // smallest query index with a dropped pair or INVALID_QUERY, the pairs of all queries < resumeQueryIdx are complete
+            uint32_t stackOverflowCount; // number of queries whose traversal stack (LBVHQueryPass stackSize) was too small for the LBVH, i.e. pairs may be missing
+        };
+
+        // input for the nearest neighbour queries (LBVHQueryPass); it is necessary to allocate and fill the buffer
+        struct PointQuery {
+            float x; // query point
+            float y;
+            float z;
+            float maxDistance; // only neighbours within this distance are reported, infinity for the k nearest neighbours, the radius for a radius search
+        };
+
+        // output of the nearest neighbour queries (LBVHQueryPass), KNN_K per query sorted by distance; it is necessary to allocate the (empty) buffer
+        struct Neighbour {
+            uint32_t primitiveIdx; // primitiveIdx of the neighbour or INVALID_PRIMITIVE if less than KNN_K primitives are within maxDistance
+            float distanceSquared; // squared distance to the aabb of the primitive (to the point for point elements with min == max)
+        };
+
+        // state of the nearest neighbour queries (LBVHQueryPass); it is necessary to allocate the buffer, it is reset by the pass before each execution
+        struct LBVHKNNState {
+            uint32_t stackOverflowCount; // number of queries whose traversal stack (LBVHQueryPass stackSize) was too small for the LBVH, i.e. neighbours may be wrong
+        };
+
 #define ABSOLUTE_POINTERS 1 // 1 to use absolute pointers (left/right child pointer is the absolute index of the child in the buffer/array)
 //or 0 for relative pointers (left/right child pointer is the relative pointer from the parent index to the child index in the buffer, i.e. absolute child pointer = absolute parent pointer + relative child pointer)
 #define POINTER(index, pointer) (ABSOLUTE_POINTERS ? (pointer) : (index) + (pointer)) // helper macro to handle relative pointers on CPU side, i.e. convert them to absolute pointers for array indexing
+#define MORTON_CODES_64 0 // 1 to use 63-bit morton codes (21 bits per axis, fewer duplicate codes for large/dense models, requires shaderInt64) or 0 for 30-bit morton codes (10 bits per axis)
+#define WIDE_BVH_WIDTH 4  // 4 (BVH4) or 8 (BVH8), number of children per node of the optional wide BVH in the example (passed to LBVHBuilder, which compiles lbvh_wide_collapse.comp with it)
+#define COMPRESSED_NODE_BITS 8 // 8 or 16 bits per quantized bound of the optional compressed nodes in the example (passed to LBVHBuilder, which compiles lbvh_compress.comp with it)
+
+        // output of the optional collapse (LBVHPass::m_wideBVH); it is necessary to allocate the (empty) buffer
+        // the bounds of all children are stored contiguously (structure of arrays), e.g. for SIMD traversal
+        // WIDTH has to match the width of the pass (LBVHPass::getWideBVHWidth), i.e. WIDE_BVH_WIDTH in lbvh_common.glsl
+        template<uint32_t WIDTH>
+        struct LBVHWideNode {
+            static_assert(WIDTH == 4 || WIDTH == 8, "The wide BVH has 4 or 8 children per node!");
+
+            float childMinX[WIDTH]; // aabbs of the children, an empty child slot has an empty aabb (min=+inf, max=-inf)
+            float childMinY[WIDTH];
+            float childMinZ[WIDTH];
+            float childMaxX[WIDTH];
+            float childMaxY[WIDTH];
+            float childMaxZ[WIDTH];
+            uint32_t children[WIDTH]; // index of the child wide node, WIDE_BVH_LEAF | primitiveIdx in case of leaf or WIDE_BVH_INVALID_CHILD in case of empty slot
+        };
+
+        // size of a wide node for the runtime width of the pass (4 or 8)
+        static constexpr uint32_t getWideNodeSizeBytes(uint32_t wideBVHWidth) {
+            return wideBVHWidth == 8 ? sizeof(LBVHWideNode<8>) : sizeof(LBVHWideNode<4>);
+        }
+
+        // only used on the GPU side during the collapse; it is necessary to allocate the (empty) buffer
+        struct LBVHWideState {
+            uint32_t levelBegin;  // wide nodes [levelBegin, levelEnd) are collapsed in the current iteration
+            uint32_t levelEnd;
+            uint32_t nodeCounter; // number of allocated wide nodes, the wide root is node 0
+            uint32_t dispatchX;   // indirect dispatch (VkDispatchIndirectCommand) for collapse
+            uint32_t dispatchY;
+            uint32_t dispatchZ;
+        };
+
+        static constexpr uint32_t WIDE_BVH_LEAF = 0x80000000u;          // leaf flag of LBVHWideNode::children, the lower 31 bits are the primitiveIdx
+        static constexpr uint32_t WIDE_BVH_INVALID_CHILD = 0xFFFFFFFFu; // empty child slot of LBVHWideNode::children
+
+        static constexpr uint32_t COMPRESSED_NODE_LEAF = 0x80000000u; // leaf flag of LBVHCompressedNode::children, the lower 31 bits are the primitiveIdx
+
+        // output of the optional compression (LBVHPass::m_compressedNodes), one node per internal node of the LBVH; it is necessary to allocate the (empty) buffer
+        // the child aabbs are quantized conservatively on a grid with power of two spacing relative to the aabb of the node (see decodeCompressedChild)
+        // BITS has to match the bits of the pass (LBVHPass::getCompressedNodeBits), i.e. COMPRESSED_NODE_BITS in lbvh_common.glsl
+        template<uint32_t BITS>
+        struct LBVHCompressedNode {
+            static_assert(BITS == 8 || BITS == 16, "The compressed nodes have 8 or 16 bits per bound!");
+            static constexpr uint32_t MAX_VALUE = (1u << BITS) - 1u;
+            static constexpr uint32_t VALUES_PER_WORD = 32 / BITS;
+            static constexpr uint32_t BOUNDS_WORDS = 12 / VALUES_PER_WORD; // 2 children * 6 bounds
+
+            float originX;      // minimum of the node aabb, origin of the grid
+            float originY;
+            float originZ;
+            uint32_t exponents; // biased exponents (as in float) of the grid spacing per axis: x | y << 8 | z << 16
+            uint32_t childBounds[BOUNDS_WORDS]; // quantized child aabbs, value i = 6 * child + (minX, minY, minZ, maxX, maxY, maxZ) is stored in word i / VALUES_PER_WORD
+            uint32_t children[2]; // index of the internal child node (same index as in the LBVH) or COMPRESSED_NODE_LEAF | primitiveIdx in case of leaf
+        };
+
+        // size of a compressed node for the runtime bits of the pass (8 or 16)
+        static constexpr uint32_t getCompressedNodeSizeBytes(uint32_t compressedNodeBits) {
+            return compressedNodeBits == 16 ? sizeof(LBVHCompressedNode<16>) : sizeof(LBVHCompressedNode<8>);
+        }
+
+        // output of the optional leaf collapse (LBVHPass::m_collapseLeaves); it is necessary to allocate the (empty) buffer
+        struct LBVHCollapsedNode {
+            int32_t left;             // pointer to the left child or INVALID_POINTER in case of leaf
+            int32_t right;            // pointer to the right child or INVALID_POINTER in case of leaf
+            uint32_t primitiveOffset; // first index into the primitive index list (all primitives of the subtree are stored contiguously)
+            uint32_t primitiveCount;  // number of primitives of the leaf or 0 in case of inner node
+            float aabbMinX;           // aabb of the node
+            float aabbMinY;
+            float aabbMinZ;
+            float aabbMaxX;
+            float aabbMaxY;
+            float aabbMaxZ;
+        };
+
+        // only used on the GPU side during the leaf collapse; it is necessary to allocate the (empty) buffer
+        struct LBVHCollapseInfo {
+            uint32_t primitiveCount; // number of primitives in the subtree
+            uint32_t collapse;       // 1 if the subtree becomes a single leaf
+            float cost;              // SAH cost of the subtree (not normalized)
+        };
+
+        // only used on the GPU side during the leaf collapse; it is necessary to allocate the (empty) buffer
+        struct LBVHCollapseState {
+            uint32_t levelBegin;  // collapsed nodes [levelBegin, levelEnd) are emitted in the current iteration
+            uint32_t levelEnd;
+            uint32_t nodeCounter; // number of allocated collapsed nodes, the root is node 0
+            uint32_t dispatchX;   // indirect dispatch (VkDispatchIndirectCommand) for emit
+            uint32_t dispatchY;
+            uint32_t dispatchZ;
+        };
+
+        static constexpr uint32_t COLLAPSE_MAX_LEAF_SIZE = 8;      // COLLAPSE_MAX_LEAF_SIZE defined in lbvh_common.glsl
+        static constexpr float COLLAPSE_TRAVERSAL_COST = 1.2f;    // SAH cost of traversing an inner node relative to intersecting a primitive (as in Karras and Aila 2013)
+        static constexpr float COLLAPSE_INTERSECTION_COST = 1.0f; // SAH cost of intersecting a primitive
+
+        static constexpr uint32_t SINGLE_RADIX_SORT_THRESHOLD = 16384;  // up to this number of elements, the single work group radix sort is used (less dispatches)
+        static constexpr uint32_t RADIX_SORT_BINS = 256;                // RADIX_SORT_BINS defined in lbvh_multi_radixsort.comp
+        static constexpr uint32_t RADIX_SORT_WORKGROUP_SIZE = 256;      // WORKGROUP_SIZE defined in lbvh_multi_radixsort.comp
+        static constexpr uint32_t RADIX_SORT_BLOCKS_PER_WORKGROUP = 32; // each work group of the multi radix sort sorts this number of blocks (of RADIX_SORT_WORKGROUP_SIZE elements)
+        static constexpr uint32_t RADIX_SORT_ELEMENTS_PER_WORKGROUP = RADIX_SORT_WORKGROUP_SIZE * RADIX_SORT_BLOCKS_PER_WORKGROUP;
+        static constexpr uint32_t EXTENT_ELEMENTS_PER_THREAD = 16;      // ELEMENTS_PER_THREAD defined in lbvh_extent.comp
+        static constexpr uint32_t SAH_COST_WORKGROUP_SIZE = 256;        // WORKGROUP_SIZE defined in lbvh_sah_cost.comp
+        static constexpr uint32_t SAH_COST_NODES_PER_THREAD = 16;       // NODES_PER_THREAD defined in lbvh_sah_cost.comp
+        static constexpr uint32_t SAH_COST_NODES_PER_WORKGROUP = SAH_COST_WORKGROUP_SIZE * SAH_COST_NODES_PER_THREAD;
+        static constexpr uint32_t SEGMENTED_WORKGROUP_SIZE = 256;       // WORKGROUP_SIZE defined in lbvh_segmented_morton_codes.comp (one work group per segment)
+        static constexpr uint32_t INVALID_PRIMITIVE = 0xFFFFFFFFu;      // INVALID_PRIMITIVE defined in lbvh_common.glsl
+        static constexpr uint32_t INVALID_QUERY = 0xFFFFFFFFu;          // INVALID_QUERY defined in lbvh_common.glsl
 
-    public:
         void execute(GPUContext *gpuContext);
 
     private:
+        static constexpr uint32_t NUM_REFIT_FRAMES = 4;                 // number of refits (with moving elements) after the full build in the example
+        static constexpr double REFIT_MAX_SAH_COST_RATIO = 1.5;         // a full rebuild is recommended if the SAH cost after refitting exceeds this ratio of the SAH cost of the last full build
+        static constexpr uint32_t NUM_RAYS = 1u << 20;                  // number of rays per ray query benchmark in the example
+        static constexpr uint32_t NUM_VERIFIED_RAYS = 128;              // number of rays that are verified against a brute force CPU reference
+        static constexpr uint32_t MAX_OVERLAP_PAIRS = 1u << 22;         // capacity of the pair buffer of the overlap queries, the queries are resumed if it overflows
+        static constexpr uint32_t NUM_VERIFIED_QUERIES = 128;           // number of overlap queries that are verified against a brute force CPU reference
+        static constexpr uint32_t KNN_K = 8;                            // number of neighbours per nearest neighbour query (the query shader is compiled with KNN_K)
+        static constexpr uint32_t NUM_KNN_QUERIES = 1u << 20;           // number of nearest neighbour queries per benchmark in the example
+        static constexpr uint32_t NUM_VERIFIED_KNN_QUERIES = 128;       // number of nearest neighbour queries that are verified against a brute force CPU reference
+        static constexpr uint32_t NUM_CPU_BUILD_RUNS = 3;               // number of CPU builds per thread count in the example, the fastest is reported
+        static constexpr uint32_t NUM_PERSISTENT_BUILD_RUNS = 3;        // number of builds of all elements with the persistent builder in the example, the fastest is reported
+        static constexpr uint32_t BATCH_SEGMENT_ELEMENTS = 1000;        // average number of elements per segment of the batched build in the example (sizes from 1 to 2 * BATCH_SEGMENT_ELEMENTS - 1)
+        static constexpr uint32_t NUM_INSTANCE_MESHES = 16;             // number of meshes of the instanced scene in the example (chunks of the elements)
+        static constexpr uint32_t INSTANCE_MESH_ELEMENTS = 4096;        // maximum number of elements per mesh of the instanced scene in the example
+        static constexpr uint32_t NUM_INSTANCES = 4096;                 // number of instances of the instanced scene in the example
+        static constexpr uint32_t NUM_INSTANCE_FRAMES = 4;              // number of top-level rebuilds (with moving instances) in the example
+        static constexpr float DENSE_CLUSTER_SIZE = 5e-4f;              // edge length of the dense cluster (relative to the extent) of the morton code width comparison in the example, at most two cells per axis of the 30-bit codes
+
         GPUContext *m_gpuContext;
 
-        std::shared_ptr<LBVHPass> m_pass;
+        std::shared_ptr<LBVHBuilder> m_builder; // Karras, PLOC and the post build stages of the example, created by execute
+        std::shared_ptr<LBVHQueryPass> m_queryPass; // created by the first verify, stack size of the deepest verified LBVH
+        std::shared_ptr<LBVHQualityAnalyzer> m_qualityAnalyzer; // created by execute
+
+        std::shared_ptr<Buffer> m_raysBuffer;
+        std::shared_ptr<Buffer> m_rayHitsBuffer;
+        std::shared_ptr<Buffer> m_overlapPairsBuffer;
+        std::shared_ptr<Buffer> m_overlapStateBuffer;
+        std::shared_ptr<Buffer> m_pointQueriesBuffer;
+        std::shared_ptr<Buffer> m_neighboursBuffer;
+        std::shared_ptr<Buffer> m_knnStateBuffer;
+
+        std::vector<Ray> m_rays;
 
-        std::shared_ptr<Buffer> m_elementsBuffer;
-        std::shared_ptr<Buffer> m_mortonCodeBuffer;
-        std::shared_ptr<Buffer> m_mortonCodePingPongBuffer;
-        std::shared_ptr<Buffer> m_LBVHBuffer;
-        std::shared_ptr<Buffer> m_LBVHConstructionInfoBuffer;
+        double m_buildSAHCost = 0; // SAH cost of the last full build, reference for the quality degradation of refits
 
         static inline const char *PRINT_PREFIX = "[LBVH] ";
 
         void releaseBuffers();
 
-        void verify(uint numLBVHElements);
+        void printStageTimes(const std::string &name) const;
+
+        // also sizes the traversal stack of the query pass for the verified LBVH (reserveQueryStack)
+        void verify(bool writeFile = true);
+
+        // (re)creates the query pass if the stack of the current one is smaller than LBVHQueryPass::getRequiredStackSize(maxLeafDepth)
+        void reserveQueryStack(uint32_t maxLeafDepth);
+
+        void verifyWide(uint numElements);
+
+        void verifyCompressed(uint numElements);
+
+        void verifyCollapsed(uint numElements);
+
+        double executeQueryPass();
+
+        void benchmarkRayQueries(const std::string &name);
+
+        void verifyRayQueries(const std::vector<LBVHNode> &LBVH, const std::vector<RayHit> &hits, bool anyHit);
+
+        void benchmarkOverlapQueries(const std::string &name, const std::vector<Element> &elements, double buildTime);
+
+        static void verifyOverlapQueries(const std::vector<Element> &elements, std::vector<std::vector<uint32_t>> &pairs);
+
+        void benchmarkCPUBuilder(const std::vector<Element> &elements, double gpuTime);
+
+        void verifyCPUBuilder(const LBVHCPUBuilder &builder, const std::vector<LBVHNode> &cpuLBVH);
+
+        void benchmarkPersistentBuilder(const std::vector<Element> &elements, double gpuTime);
+
+        void benchmarkBatchedBuild(const std::vector<Element> &elements);
+
+        void benchmarkInstancedScene(const std::vector<Element> &elements);
+
+        // builds the same dense, duplicate-heavy input with 30-bit and 63-bit morton codes (if shaderInt64 is supported) and compares the quality of both LBVHs
+        void benchmarkMortonCodeWidths(uint32_t numElements);
+
+        static void verifyInstanceRayQueries(const LBVHTwoLevelBuilder &builder, const std::vector<std::vector<Element>> &meshes, const std::vector<Ray> &rays, const std::vector<InstanceRayHit> &hits, bool anyHit);
+
+        void benchmarkNearestNeighbourQueries(const std::vector<Element> &points, const AABB &extent, float radius);
+
+        static void verifyNearestNeighbourQueries(const std::vector<Element> &points, const std::vector<PointQuery> &queries, const std::vector<Neighbour> &neighbours);
+
+        static bool intersectAABB(const Ray &ray, const LBVHNode &node, float tMax, float &tEntry);
+
+        static void generatePointElements(const std::vector<Element> &elements, std::vector<Element> &points);
+
+        static void generatePointQueries(std::vector<PointQuery> &queries, const AABB &extent, float maxDistance, std::mt19937 &generator);
+
+        static void generateRays(std::vector<Ray> &rays, const AABB &extent, std::mt19937 &generator);
+
+        static void moveElements(std::vector<Element> &elements, float maxDistance, std::mt19937 &generator);
+
+        // numElements - 2 elements in a cube of DENSE_CLUSTER_SIZE at the center of the unit cube and two elements at its corners that span the extent
+        static void generateDenseElements(std::vector<Element> &elements, uint32_t numElements, std::mt19937 &generator);
 
         static bool aabbIsUnion(AABB parentAABB, AABB childAAABB, AABB childBAABB);
 
         void traverse(uint32_t index, LBVHNode *LBVH, std::vector<bool> &visited);
 
-        static void generateElements(std::vector<Element> &elements, AABB *extent);
+        void traverseCollapsed(uint32_t index, LBVHCollapsedNode *collapsedLBVH, uint32_t *primitiveIndices, const std::vector<AABB> &primitiveAABBs, std::vector<bool> &visitedNodes, std::vector<bool> &visitedPrimitives, uint32_t &numLeaves);
+
+        void traverseWide(uint32_t index, const AABB &aabb, LBVHWideNode<WIDE_BVH_WIDTH> *wideLBVH, std::vector<bool> &visitedNodes, std::vector<bool> &visitedPrimitives, uint32_t depth, uint32_t &maxLeafDepth);
+
+        static float surfaceArea(const LBVHNode &node);
+
+        static float orderedUintToFloat(uint32_t u);
+
+        // quantized value i = 6 * child + (minX, minY, minZ, maxX, maxY, maxZ) of a compressed node
+        static uint32_t getCompressedValue(const LBVHCompressedNode<COMPRESSED_NODE_BITS> &node, uint32_t valueIdx);
+
+        static float dequantize(const LBVHCompressedNode<COMPRESSED_NODE_BITS> &node, uint32_t axis, uint32_t value);
+
+        static AABB decodeCompressedChild(const LBVHCompressedNode<COMPRESSED_NODE_BITS> &node, uint32_t child);
+
+        static void generateElements(std::vector<Element> &elements);
     };
 } // namespace engine
\ No newline at end of file
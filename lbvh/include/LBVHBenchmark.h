@@ -0,0 +1,115 @@
+#pragma once
+
+#include "LBVHBuilder.h"
+
+#include <cctype>
+#include <iomanip>
+#include <numeric>
+#include <sstream>
+
+namespace engine {
+    // builds the LBVH with LBVHBuilder over a sweep of element counts, synthetic distributions and build algorithms
+    // every configuration is built Settings::m_warmupRuns times without measurement and Settings::m_runs times with measurement, the results are written as JSON and CSV
+    // afterward, a batch of small meshes is built with one batched build (LBVHBuilder::buildBatch) and with one build per mesh (written to the JSON only)
+    class LBVHBenchmark {
+    public:
+        enum Distribution {
+            UNIFORM = 0,   // small boxes, centroids uniform in the unit cube
+            CLUSTERED = 1, // small boxes, centroids normal distributed around a few cluster centers
+            DUPLICATE = 2, // all centroids at the same position, i.e. all morton codes are equal
+            THIN = 3,      // long thin triangles (boxes elongated along a random axis), the centroids do not represent the extents well
+            PLANAR = 4,    // flat boxes, centroids uniform in the z = 0 plane
+            NUM_DISTRIBUTIONS = 5,
+        };
+
+        struct Settings {
+            std::vector<uint32_t> m_sizes = {1000, 10000, 100000, 1000000, 10000000, 50000000};
+            std::vector<Distribution> m_distributions = {UNIFORM, CLUSTERED, DUPLICATE, THIN, PLANAR};
+            std::vector<LBVHPass::BuildAlgorithm> m_algorithms = {LBVHPass::KARRAS};
+            uint32_t m_warmupRuns = 2;
+            uint32_t m_runs = 5;
+            uint32_t m_seed = 42;
+            std::string m_jsonPath = "lbvh_benchmark.json";
+            std::string m_csvPath = "lbvh_benchmark.csv";
+            uint32_t m_batchMeshes = 10000;      // 0 disables the batched build
+            uint32_t m_batchMeshElements = 1000; // elements per mesh of the batched build
+        };
+
+        // measurements of one (distribution, algorithm, size) configuration
+        struct Result {
+            Distribution distribution;
+            LBVHPass::BuildAlgorithm algorithm;
+            uint32_t numElements;
+            std::string status = "ok";                                       // "ok" or the reason why the configuration was skipped
+            double buildTimeMean = 0;                                        // [ms] host time of LBVHBuilder::build (upload of the elements and execution)
+            double buildTimeMin = 0;                                         // [ms]
+            double buildTimeMedian = 0;                                      // [ms]
+            double gpuTimeMedian = 0;                                        // [ms] median of the sums of the GPU stage times, 0 without timestamp support
+            std::array<double, LBVHPass::NUM_TIMED_STAGES> stageTimesMean{}; // [ms] LBVHPass::TimedStage
+            double primitivesPerSecond = 0;                                  // based on gpuTimeMedian (buildTimeMedian without timestamp support)
+            uint64_t deviceMemoryBytes = 0;                                  // buffers of the builder (LBVHBuilder::getDeviceMemoryBytes)
+            double deviceAllocationsPerBuild = 0;                            // vkAllocateMemory calls per measured build (MemoryAllocator, e.g. for staging buffers that do not fit into a block)
+            uint64_t processPeakRSSBytes = 0;                                // peak resident set size of the whole process so far (ru_maxrss), i.e. never decreases and includes all earlier configurations
+        };
+
+        // measurements of the batched build (uniform distribution, 63-bit morton codes)
+        struct BatchResult {
+            uint32_t numMeshes = 0;
+            uint32_t numElementsPerMesh = 0;
+            std::string status = "ok";   // "ok" or the reason why the batched build was skipped
+            double batchTimeMedian = 0;  // [ms] host time of LBVHBuilder::buildBatch
+            double gpuTimeMedian = 0;    // [ms] median of the sums of the GPU stage times of the batched build, 0 without timestamp support
+            double sequentialTime = 0;   // [ms] host time of one LBVHBuilder::build per mesh (measured once, after the warmup runs of the batched build)
+            double speedup = 0;          // sequentialTime / batchTimeMedian
+            uint64_t deviceMemoryBytes = 0;
+        };
+
+        explicit LBVHBenchmark(Settings settings) : m_settings(std::move(settings)) {
+        }
+
+        // returns false for --help, throws if an argument is invalid, see the usage in bin/LBVHBenchmark.cpp
+        static bool parseArguments(int argc, char *argv[], Settings &settings, GPUContext &gpuContext);
+
+        void execute(GPUContext *gpuContext);
+
+        [[nodiscard]] const std::vector<Result> &getResults() const {
+            return m_results;
+        }
+
+        [[nodiscard]] const BatchResult &getBatchResult() const {
+            return m_batchResult;
+        }
+
+        [[nodiscard]] static const char *getDistributionName(Distribution distribution);
+
+        [[nodiscard]] static const char *getAlgorithmName(LBVHPass::BuildAlgorithm algorithm);
+
+    private:
+        GPUContext *m_gpuContext = nullptr;
+        Settings m_settings;
+        std::vector<Result> m_results;
+        BatchResult m_batchResult;
+        std::string m_deviceName;
+        bool m_timestamps = false; // the stage times are 0 without timestamp support
+
+        static inline const char *PRINT_PREFIX = "[LBVHBenchmark] ";
+
+        static constexpr uint32_t NUM_CLUSTERS = 64;
+        static constexpr float CLUSTER_SIGMA = 0.01f; // standard deviation of the centroids around the cluster center
+        static constexpr float THIN_LENGTH = 0.25f;   // length of the thin boxes along their long axis
+        static constexpr float THIN_WIDTH = 1e-4f;    // size of the thin boxes along the other axes
+
+        static void generateElements(Distribution distribution, uint32_t numElements, uint32_t seed, std::vector<Element> &elements);
+
+        Result benchmark(LBVHBuilder &builder, const std::vector<Element> &elements, Distribution distribution, LBVHPass::BuildAlgorithm algorithm) const;
+
+        BatchResult benchmarkBatch() const;
+
+        // high-water mark of the process, not the memory of a single configuration (0 if not supported)
+        static uint64_t getProcessPeakRSSBytes();
+
+        void writeJSON() const;
+
+        void writeCSV() const;
+    };
+} // namespace engine
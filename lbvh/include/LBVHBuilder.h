@@ -0,0 +1,215 @@
+#pragma once
+
+#include "LBVH.h"
+
+namespace engine {
+    // long-lived GPU builder: the pass (shaders, pipelines and descriptor sets) is created once and reused for all builds
+    // the buffers are allocated for a capacity of elements and only reallocated (geometric growth) if a build exceeds the capacity, i.e. a build is an upload and the dispatches
+    // supports the Karras and the PLOC build, the treelet restructuring, the refit, the SAH cost, the wide BVH, the compression and the leaf collapse (their buffers are allocated by the first build that enables them)
+    // Karras builds can be submitted without blocking the host (buildAsync), a builder has a single set of buffers, i.e. several builds are in flight with several builders
+    // many small LBVHs (e.g. one per mesh) are built with a single submission by the batched build (buildBatch), their nodes are stored one after another in the LBVH buffer
+    class LBVHBuilder {
+    public:
+        // identifies an asynchronous build of this builder
+        struct BuildHandle {
+            uint64_t m_value = 0; // value of the timeline semaphore (getTimelineSemaphore) after the build finished, 0 if there is nothing to wait for
+        };
+
+        explicit LBVHBuilder(GPUContext *gpuContext, bool mortonCodes64 = false, bool absolutePointers = true, uint32_t wideBVHWidth = 4, uint32_t compressedNodeBits = 8) : m_gpuContext(gpuContext), m_mortonCodes64(mortonCodes64), m_absolutePointers(absolutePointers), m_wideBVHWidth(wideBVHWidth), m_compressedNodeBits(compressedNodeBits) {
+        }
+
+        void create(uint32_t initialCapacity = MIN_CAPACITY);
+
+        void release();
+
+        // full build, returns the time in ms (upload of the elements and execution)
+        // the post build stages enabled on the pass (getPass()->m_wideBVH, m_compressedNodes, m_collapseLeaves) are executed as well
+        double build(const std::vector<Element> &elements, LBVHPass::BuildAlgorithm buildAlgorithm = LBVHPass::KARRAS);
+
+        // Karras build that returns after the submission: the dispatches wait on the GPU for the upload of the elements (staging ring) and for waits, e.g. upstream GPU work
+        // blocks until the previous build of this builder finished (its buffers are reused), PLOC, the wide BVH and the leaf collapse are not supported because the host reads back the state between their iterations
+        BuildHandle buildAsync(const std::vector<Element> &elements, const std::vector<ComputePass::SemaphoreWait> &waits = {});
+
+        // same as above for elements that were written to getElementsBuffer by GPU work that signals waits, numElements has to fit into the capacity (see reserve)
+        BuildHandle buildAsync(uint32_t numElements, const std::vector<ComputePass::SemaphoreWait> &waits);
+
+        // Karras build of one LBVH per segment, the segments cover the elements in order (elementOffset and numElements, at least one element per segment), returns the time in ms
+        // the LBVH of segment i is stored at nodeOffset = 2 * elementOffset - i (set by the build), its pointers and primitive ids are relative to its root and its own elements, e.g. the primitive ids of the mesh
+        // the segment index and the morton code share the sort key, i.e. the morton codes have (64 or 32 - ceil(log2(segments.size()))) / 3 bits per axis (at most 21 or 10), 63-bit morton codes are recommended for large batches
+        // the post build stages are not recorded, the refit and downloadSAHCost are not supported for a batch
+        double buildBatch(const std::vector<Element> &elements, std::vector<LBVHSegment> &segments);
+
+        // same as above without blocking the host (see buildAsync)
+        BuildHandle buildBatchAsync(const std::vector<Element> &elements, std::vector<LBVHSegment> &segments, const std::vector<ComputePass::SemaphoreWait> &waits = {});
+
+        // blocks until the build finished, the stage times (getStageTimes) of the build are available afterward
+        void wait(BuildHandle handle);
+
+        [[nodiscard]] bool isFinished(BuildHandle handle) const {
+            return m_pass->isFinished(handle.m_value);
+        }
+
+        // signaled with BuildHandle::m_value, i.e. downstream GPU work can wait for a build with a ComputePass::SemaphoreWait
+        [[nodiscard]] VkSemaphore getTimelineSemaphore() const {
+            return m_pass->getTimelineSemaphore();
+        }
+
+        // reallocates the buffers (after the pending build finished) if numElements exceeds the capacity
+        void reserve(uint32_t numElements);
+
+        // only update the bounding boxes of the last build, the elements have to have the same number and order as in the last build, returns the time in ms
+        double refit(const std::vector<Element> &elements);
+
+        // NUM_LBVH_ELEMENTS = 2 * getNumElements() - getNumLBVHs() nodes of the last build/refit
+        void downloadLBVH(std::vector<LBVHNode> &LBVH);
+
+        double downloadSAHCost();
+
+        // the buffer is valid until the next build that exceeds the capacity, it is larger than the LBVH of the last build
+        [[nodiscard]] Buffer *getLBVHBuffer() const {
+            return m_LBVHBuffer.get();
+        }
+
+        // input of the next build, valid until the capacity is exceeded (same as getLBVHBuffer)
+        [[nodiscard]] Buffer *getElementsBuffer() const {
+            return m_elementsBuffer.get();
+        }
+
+        // extent of the element centroids of the last build (LBVH::LBVHExtent)
+        [[nodiscard]] Buffer *getExtentBuffer() const {
+            return m_extentBuffer.get();
+        }
+
+        // sorted morton codes of the last build (LBVH::MortonCodeElement or LBVH::MortonCodeElement64), larger than the number of elements
+        [[nodiscard]] Buffer *getMortonCodeBuffer() const {
+            return m_mortonCodeBuffer.get();
+        }
+
+        // outputs of the post build stages, nullptr until a build enabled the wide BVH, the compression or the leaf collapse
+        [[nodiscard]] Buffer *getWideLBVHBuffer() const {
+            return m_wideLBVHBuffer.get();
+        }
+
+        [[nodiscard]] Buffer *getWideStateBuffer() const {
+            return m_wideStateBuffer.get();
+        }
+
+        [[nodiscard]] Buffer *getCompressedLBVHBuffer() const {
+            return m_compressedLBVHBuffer.get();
+        }
+
+        [[nodiscard]] Buffer *getCollapsedLBVHBuffer() const {
+            return m_collapsedLBVHBuffer.get();
+        }
+
+        [[nodiscard]] Buffer *getCollapsedPrimitiveIndicesBuffer() const {
+            return m_collapsedPrimitiveIndicesBuffer.get();
+        }
+
+        [[nodiscard]] Buffer *getCollapseStateBuffer() const {
+            return m_collapseStateBuffer.get();
+        }
+
+        // e.g. to enable the treelet restructuring (m_treeletOptimization), the post build stages (m_wideBVH, m_compressedNodes, m_collapseLeaves) or to disable the SAH cost (m_sahCost)
+        [[nodiscard]] LBVHPass *getPass() const {
+            return m_pass.get();
+        }
+
+        // GPU durations in ms of the stages of the last finished build/refit (LBVHPass::TimedStage)
+        [[nodiscard]] const std::array<double, LBVHPass::NUM_TIMED_STAGES> &getStageTimes() const {
+            return m_pass->getStageTimes();
+        }
+
+        [[nodiscard]] uint32_t getNumElements() const {
+            return m_numElements;
+        }
+
+        // number of segments of the last build, 1 if it was not a batched build
+        [[nodiscard]] uint32_t getNumLBVHs() const {
+            return m_numLBVHs;
+        }
+
+        [[nodiscard]] uint32_t getCapacity() const {
+            return m_capacity;
+        }
+
+        // sum of the buffer sizes for the current capacity (the staging buffers of the uploads/downloads are not included)
+        [[nodiscard]] uint64_t getDeviceMemoryBytes() const;
+
+        // largest number of elements of a build, the LBVH has to fit into a single storage buffer binding (maxStorageBufferRange)
+        [[nodiscard]] uint32_t getMaxCapacity() const;
+
+        // number of times the buffers were reallocated because a build exceeded the capacity
+        [[nodiscard]] uint32_t getNumReallocations() const {
+            return m_numReallocations;
+        }
+
+    private:
+        static constexpr uint32_t MIN_CAPACITY = 1024;
+        static constexpr uint32_t GROWTH_FACTOR = 2; // the capacity grows to max(numElements, GROWTH_FACTOR * capacity)
+
+        GPUContext *m_gpuContext;
+        bool m_mortonCodes64;
+        bool m_absolutePointers;
+        uint32_t m_wideBVHWidth;
+        uint32_t m_compressedNodeBits;
+
+        std::shared_ptr<LBVHPass> m_pass;
+
+        uint32_t m_numElements = 0;
+        uint32_t m_numLBVHs = 1;
+        uint32_t m_capacity = 0;
+        uint32_t m_segmentsCapacity = 0; // the segments buffer is only allocated by the first batched build
+        uint32_t m_postBuildCapacity = 0; // the buffers of the post build stages are only allocated by the first build that enables them
+        uint32_t m_numReallocations = 0;
+        BuildHandle m_pendingBuild; // asynchronous build that was not waited for yet
+
+        std::shared_ptr<Buffer> m_elementsBuffer;
+        std::shared_ptr<Buffer> m_extentBuffer;
+        std::shared_ptr<Buffer> m_mortonCodeBuffer;
+        std::shared_ptr<Buffer> m_mortonCodePingPongBuffer;
+        std::shared_ptr<Buffer> m_radixSortHistogramsBuffer;
+        std::shared_ptr<Buffer> m_LBVHBuffer;
+        std::shared_ptr<Buffer> m_LBVHConstructionInfoBuffer;
+        std::shared_ptr<Buffer> m_SAHCostBuffer;
+        std::shared_ptr<Buffer> m_PLOCClustersBuffer;
+        std::shared_ptr<Buffer> m_PLOCMergedClustersBuffer;
+        std::shared_ptr<Buffer> m_PLOCNearestNeighboursBuffer;
+        std::shared_ptr<Buffer> m_PLOCBlockCountsBuffer;
+        std::shared_ptr<Buffer> m_PLOCStateBuffer;
+        std::shared_ptr<Buffer> m_segmentsBuffer;
+        std::shared_ptr<Buffer> m_wideLBVHBuffer;
+        std::shared_ptr<Buffer> m_wideToBinaryBuffer;
+        std::shared_ptr<Buffer> m_wideStateBuffer;
+        std::shared_ptr<Buffer> m_compressedLBVHBuffer;
+        std::shared_ptr<Buffer> m_collapseInfosBuffer;
+        std::shared_ptr<Buffer> m_collapsedLBVHBuffer;
+        std::shared_ptr<Buffer> m_collapsedToBinaryBuffer;
+        std::shared_ptr<Buffer> m_collapsedPrimitiveIndicesBuffer;
+        std::shared_ptr<Buffer> m_collapseStateBuffer;
+
+        // (re)allocates the buffers for the capacity and assigns them to the pass
+        void createBuffers(uint32_t capacity);
+
+        void releaseBuffers();
+
+        // (re)allocates the segments buffer (after the pending build finished) if numSegments exceeds its capacity
+        void reserveSegments(uint32_t numSegments);
+
+        // (re)allocates the buffers of the wide BVH, the compression and the leaf collapse for the capacity if a post build stage is enabled on the pass
+        void reservePostBuild();
+
+        void releasePostBuildBuffers();
+
+        // bits of the morton code below the segment index in the sort key of a batched build, a multiple of 3
+        [[nodiscard]] uint32_t getBatchCodeBits(uint32_t numSegments) const;
+
+        // sets the global invocation sizes and push constants for the number of elements (no allocation)
+        void setNumElements(uint32_t numElements);
+
+        // waits for the pending asynchronous build and reads its stage times, has to be called before the buffers are accessed
+        void finishBuild();
+
+        double executePass();
+    };
+}
@@ -0,0 +1,86 @@
+#pragma once
+
+#include "LBVHTypes.h"
+#include "engine/util/ThreadPool.h"
+
+#include <glm/glm.hpp>
+#include <atomic>
+#include <memory>
+
+namespace engine {
+    // CPU backend of the builder that does not require a GPU: the same pipeline as the GPU Karras build (extent, morton codes, radix sort, hierarchy, bounding boxes)
+    // the result has the same LBVHNode layout and is identical to the GPU result (same floating point operations, see quantize)
+    class LBVHCPUBuilder {
+    public:
+        explicit LBVHCPUBuilder(uint32_t numThreads = std::thread::hardware_concurrency(), bool mortonCodes64 = false) : m_threadPool(numThreads), m_mortonCodes64(mortonCodes64) {
+        }
+
+        // the temporary arrays are kept and only grow, i.e. repeated builds do not allocate
+        void build(const std::vector<Element> &elements, std::vector<LBVHNode> &LBVH, bool absolutePointers);
+
+        // sorted morton codes of the last build (same order as the morton code buffer of the GPU build)
+        [[nodiscard]] const std::vector<uint64_t> &getSortedMortonCodes() const {
+            return m_mortonCodes;
+        }
+
+        [[nodiscard]] uint32_t getNumThreads() const {
+            return m_threadPool.getNumThreads();
+        }
+
+    private:
+        static constexpr uint32_t RADIX_SORT_BITS_PER_PASS = 8;
+        static constexpr uint32_t RADIX_SORT_BINS = 1u << RADIX_SORT_BITS_PER_PASS;
+        static constexpr uint32_t BLOCK_SIZE = 64; // elements per block of the extent and morton code loops
+
+        // aabbs of a block of elements as arrays, the elements (array of structs) are not vectorized by the compiler but the loops over the block are
+        struct ElementBlock {
+            float minX[BLOCK_SIZE];
+            float minY[BLOCK_SIZE];
+            float minZ[BLOCK_SIZE];
+            float maxX[BLOCK_SIZE];
+            float maxY[BLOCK_SIZE];
+            float maxZ[BLOCK_SIZE];
+        };
+
+        ThreadPool m_threadPool;
+        bool m_mortonCodes64; // 63-bit morton codes (21 bits per axis) or 30-bit morton codes (10 bits per axis), see MORTON_CODES_64 in LBVH.h
+
+        std::vector<uint64_t> m_mortonCodes;
+        std::vector<uint32_t> m_elementIndices;
+        std::vector<uint64_t> m_mortonCodesPingPong;
+        std::vector<uint32_t> m_elementIndicesPingPong;
+        std::vector<uint32_t> m_radixSortHistograms; // RADIX_SORT_BINS per thread
+        std::vector<uint32_t> m_parents;
+        std::unique_ptr<std::atomic<uint32_t>[]> m_visitationCounts;
+        uint32_t m_visitationCountsCapacity = 0;
+
+        void computeExtent(const std::vector<Element> &elements, glm::vec3 &extentMin, glm::vec3 &extentMax);
+
+        void computeMortonCodes(const std::vector<Element> &elements, const glm::vec3 &extentMin, const glm::vec3 &extentMax);
+
+        void radixSort(uint32_t numElements);
+
+        void buildHierarchy(const std::vector<Element> &elements, std::vector<LBVHNode> &LBVH, bool absolutePointers);
+
+        void buildBoundingBoxes(std::vector<LBVHNode> &LBVH, bool absolutePointers);
+
+        [[nodiscard]] int delta(int i, uint64_t codeI, int j) const;
+
+        void determineRange(int idx, int &lower, int &upper) const;
+
+        [[nodiscard]] int findSplit(int first, int last) const;
+
+        static void loadBlock(const std::vector<Element> &elements, uint32_t begin, uint32_t count, ElementBlock &block);
+
+        // floor(clamp(offset / size * scale, 0, maxValue)), the division is only an approximation that is corrected with correctly rounded products, i.e. the GPU computes the same integer
+        static uint32_t quantize(float offset, float size, float scale, float maxValue);
+
+        static uint32_t floatToOrderedUint(float value);
+
+        static float orderedUintToFloat(uint32_t value);
+
+        static uint32_t expandBits(uint32_t v);
+
+        static uint64_t expandBits64(uint64_t v);
+    };
+}
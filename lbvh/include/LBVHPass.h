@@ -3,27 +3,81 @@
 #include "engine/util/Paths.h"
 #include "engine/passes/ComputePass.h"
 
+#include <array>
+
 namespace engine {
     class LBVHPass : public ComputePass {
     public:
-        explicit LBVHPass(GPUContext *gpuContext) : ComputePass(gpuContext) {
+        explicit LBVHPass(GPUContext *gpuContext, bool mortonCodes64 = false, uint32_t wideBVHWidth = 4, uint32_t compressedNodeBits = 8) : ComputePass(gpuContext), m_mortonCodes64(mortonCodes64), m_wideBVHWidth(wideBVHWidth), m_compressedNodeBits(compressedNodeBits) {
+            m_timestampCount = 2 * NUM_TIMED_STAGES;
         }
 
+        void create() override;
+
         enum ComputeStage {
             MORTON_CODES = 0,
             RADIX_SORT = 1,
             HIERARCHY = 2,
             BOUNDING_BOXES = 3,
+            MULTI_RADIX_SORT_HISTOGRAMS = 4,
+            MULTI_RADIX_SORT = 5,
+            EXTENT = 6,
+            REFIT_LEAVES = 7,
+            SAH_COST = 8,
+            TREELET_INIT = 9,
+            TREELET_RESTRUCTURE = 10,
+            PLOC_INIT = 11,
+            PLOC_NEAREST_NEIGHBOUR = 12,
+            PLOC_MERGE = 13,
+            PLOC_SCAN = 14,
+            PLOC_COMPACT = 15,
+            WIDE_INIT = 16,
+            WIDE_COLLAPSE = 17,
+            WIDE_UPDATE = 18,
+            COMPRESS = 19,
+            COLLAPSE_COST = 20,
+            COLLAPSE_INIT = 21,
+            COLLAPSE_EMIT = 22,
+            COLLAPSE_UPDATE = 23,
+            SEGMENTED_MORTON_CODES = 24,
+            SEGMENTED_HIERARCHY = 25,
+            SEGMENTED_BOUNDING_BOXES = 26,
+            MULTI_RADIX_SORT_SCAN = 27,
+        };
+
+        enum BuildAlgorithm {
+            KARRAS = 0, // HIERARCHY and BOUNDING_BOXES
+            PLOC = 1,   // PLOC_INIT followed by iterations of PLOC_NEAREST_NEIGHBOUR, PLOC_MERGE, PLOC_SCAN and PLOC_COMPACT
+        };
+
+        enum RecordMode {
+            BUILD = 0,               // full build (including the post build stages in case of KARRAS, m_plocIterations iterations in case of PLOC)
+            PLOC_ITERATIONS = 1,     // further m_plocIterations iterations in case PLOC did not merge all clusters yet
+            POST_BUILD = 2,          // post build stages (treelet optimization, SAH cost, compression, wide BVH and leaf collapse) after PLOC merged all clusters
+            REFIT = 3,               // only update the bounding boxes of the last full build (REFIT_LEAVES and BOUNDING_BOXES) and calculate the SAH cost
+            WIDE_ITERATIONS = 4,     // further m_wideIterations collapse iterations in case the collapse did not reach the bottom of the LBVH yet
+            COLLAPSE_ITERATIONS = 5, // further m_collapseIterations emit iterations in case the leaf collapse did not reach the leaves yet
+            BATCH_BUILD = 6,         // Karras build of one LBVH per segment (SEGMENTED_MORTON_CODES, sort, SEGMENTED_HIERARCHY and SEGMENTED_BOUNDING_BOXES), no post build stages
+        };
+
+        // stages with GPU timestamps before and after, see getStageTimes
+        enum TimedStage {
+            TIMED_MORTON_CODES = 0,   // EXTENT and MORTON_CODES, or SEGMENTED_MORTON_CODES
+            TIMED_SORT = 1,           // RADIX_SORT or the MULTI_RADIX_SORT iterations
+            TIMED_HIERARCHY = 2,      // HIERARCHY, or PLOC_INIT and all PLOC iterations (PLOC computes the bounding boxes while merging)
+            TIMED_BOUNDING_BOXES = 3, // BOUNDING_BOXES, or REFIT_LEAVES and BOUNDING_BOXES of a refit
+            TIMED_POST_BUILD = 4,     // treelet optimization, SAH cost, compression, wide BVH and leaf collapse (including their iterations)
+            NUM_TIMED_STAGES = 5,
+        };
+
+
+        struct PushConstantsExtent {
+            uint32_t g_num_elements;
         };
+        PushConstantsExtent m_pushConstantsExtent{};
 
         struct PushConstantsMortonCodes {
             uint32_t g_num_elements;
-            float g_min_x;
-            float g_min_y;
-            float g_min_z;
-            float g_max_x;
-            float g_max_y;
-            float g_max_z;
         };
         PushConstantsMortonCodes m_pushConstantsMortonCodes{};
 
@@ -32,6 +86,15 @@ namespace engine {
         };
         PushConstantsRadixSort m_pushConstantsRadixSort{};
 
+        // shared by MULTI_RADIX_SORT_HISTOGRAMS, MULTI_RADIX_SORT_SCAN and MULTI_RADIX_SORT, g_shift is set for each iteration during recording
+        struct PushConstantsMultiRadixSort {
+            uint32_t g_num_elements;
+            uint32_t g_shift;
+            uint32_t g_num_workgroups;
+            uint32_t g_num_blocks_per_workgroup;
+        };
+        PushConstantsMultiRadixSort m_pushConstantsMultiRadixSort{};
+
         struct PushConstantsHierarchy {
             uint32_t g_num_elements;
             uint32_t g_absolute_pointers;
@@ -44,11 +107,193 @@ namespace engine {
         };
         PushConstantsBoundingBoxes m_pushConstantsBoundingBoxes{};
 
+        struct PushConstantsRefitLeaves {
+            uint32_t g_num_elements;
+        };
+        PushConstantsRefitLeaves m_pushConstantsRefitLeaves{};
+
+        struct PushConstantsSAHCost {
+            uint32_t g_num_elements;
+        };
+        PushConstantsSAHCost m_pushConstantsSAHCost{};
+
+        // shared by TREELET_INIT and TREELET_RESTRUCTURE
+        struct PushConstantsTreelet {
+            uint32_t g_num_elements;
+            uint32_t g_absolute_pointers;
+        };
+        PushConstantsTreelet m_pushConstantsTreelet{};
+
+        // shared by all PLOC stages
+        struct PushConstantsPLOC {
+            uint32_t g_num_elements;
+            uint32_t g_absolute_pointers;
+        };
+        PushConstantsPLOC m_pushConstantsPLOC{};
+
+        // shared by WIDE_INIT, WIDE_COLLAPSE and WIDE_UPDATE
+        struct PushConstantsWide {
+            uint32_t g_num_elements;
+            uint32_t g_absolute_pointers;
+        };
+        PushConstantsWide m_pushConstantsWide{};
+
+        struct PushConstantsCompress {
+            uint32_t g_num_elements;
+            uint32_t g_absolute_pointers;
+        };
+        PushConstantsCompress m_pushConstantsCompress{};
+
+        // shared by COLLAPSE_COST, COLLAPSE_INIT, COLLAPSE_EMIT and COLLAPSE_UPDATE
+        struct PushConstantsCollapse {
+            uint32_t g_num_elements;
+            uint32_t g_absolute_pointers;
+            float g_traversal_cost;
+            float g_intersection_cost;
+        };
+        PushConstantsCollapse m_pushConstantsCollapse{};
+
+        // shared by SEGMENTED_MORTON_CODES, SEGMENTED_HIERARCHY and SEGMENTED_BOUNDING_BOXES
+        struct PushConstantsSegmented {
+            uint32_t g_num_elements;
+            uint32_t g_num_segments;
+            uint32_t g_code_bits; // bits of the morton code below the segment index in the sort key, a multiple of 3
+            uint32_t g_absolute_pointers;
+        };
+        PushConstantsSegmented m_pushConstantsSegmented{};
+
+        // 4 iterations for 30-bit morton codes, 8 iterations for 63-bit morton codes (sorting 8 bits per iteration)
+        [[nodiscard]] uint32_t getRadixSortIterations() const {
+            return m_mortonCodes64 ? 8 : 4;
+        }
+
+        // the extent buffer (LBVHExtent) is reset with vkCmdFillBuffer before EXTENT, therefore the pass needs to know the buffer (which requires VK_BUFFER_USAGE_TRANSFER_DST_BIT)
+        void setExtentBuffer(Buffer *extentBuffer);
+
+        // the PLOC state buffer (PLOCState) contains the work group counts of the indirect dispatches, therefore the pass needs to know the buffer (which requires VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT)
+        void setPLOCStateBuffer(Buffer *plocStateBuffer);
+
+        // the wide state buffer (LBVHWideState) contains the work group count of the indirect dispatch, therefore the pass needs to know the buffer (which requires VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT)
+        void setWideStateBuffer(Buffer *wideStateBuffer);
+
+        // the collapse state buffer (LBVHCollapseState) contains the work group count of the indirect dispatch, therefore the pass needs to know the buffer (which requires VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT)
+        void setCollapseStateBuffer(Buffer *collapseStateBuffer);
+
+        // number of children per wide node (WIDE_BVH_WIDTH in lbvh_common.glsl)
+        [[nodiscard]] uint32_t getWideBVHWidth() const {
+            return m_wideBVHWidth;
+        }
+
+        // number of bits per quantized bound of the compressed nodes (COMPRESSED_NODE_BITS in lbvh_common.glsl)
+        [[nodiscard]] uint32_t getCompressedNodeBits() const {
+            return m_compressedNodeBits;
+        }
+
+        // subgroup size the radix sorts are specialized with (SUBGROUP_SIZE), valid after create
+        [[nodiscard]] uint32_t getSubgroupSize() const {
+            return m_subgroupSize;
+        }
+
+        // work group size the shaders with one thread per element are specialized with (local_size_x_id), valid after create
+        // specialized: MORTON_CODES, HIERARCHY, BOUNDING_BOXES, REFIT_LEAVES, TREELET_*, PLOC_* (incl. the indirect dispatches and the PLOC_SCAN work group), WIDE_COLLAPSE, COMPRESS, COLLAPSE_COST, COLLAPSE_EMIT, SEGMENTED_HIERARCHY and SEGMENTED_BOUNDING_BOXES
+        // fixed 256 threads: the radix sorts, EXTENT, SAH_COST and SEGMENTED_MORTON_CODES (the host computes their work group counts with the constants in LBVH.h), the single thread stages WIDE_INIT, WIDE_UPDATE, COLLAPSE_INIT and COLLAPSE_UPDATE
+        [[nodiscard]] uint32_t getWorkGroupSize() const {
+            return m_workGroupSize;
+        }
+
+        [[nodiscard]] static const char *getTimedStageName(TimedStage stage);
+
+        // GPU timestamps: call resetStageTimes before a build/refit and accumulateStageTimes after each of its finished submissions (see LBVHBuilder::executePass)
+        void resetStageTimes();
+
+        void accumulateStageTimes();
+
+        // GPU durations in milliseconds of the timed stages accumulated since resetStageTimes, 0 for stages that were not recorded or if the device does not support timestamps (hasTimestamps)
+        [[nodiscard]] const std::array<double, NUM_TIMED_STAGES> &getStageTimes() const {
+            return m_stageTimes;
+        }
+
+        static constexpr uint32_t SUBGROUP_SIZE_CONSTANT_ID = 1;          // constant_id of SUBGROUP_SIZE in lbvh_single_radixsort.comp and lbvh_multi_radixsort.comp
+        static constexpr uint32_t DISPATCH_WORKGROUP_SIZE_CONSTANT_ID = 2; // constant_id of WORKGROUP_SIZE in lbvh_wide_update.comp and lbvh_collapse_update.comp (work group size of the indirect dispatch they write)
+
+        bool m_multiRadixSort = true;             // true: sort with MULTI_RADIX_SORT_HISTOGRAMS, MULTI_RADIX_SORT_SCAN and MULTI_RADIX_SORT (scales with the number of elements), false: sort with the single work group RADIX_SORT (less overhead for tiny inputs)
+        BuildAlgorithm m_buildAlgorithm = KARRAS; // selectable per build, both algorithms emit the same LBVHNode layout (root at index 0, leaves in morton order at NUM_ELEMENTS - 1 and following)
+        RecordMode m_recordMode = BUILD;          // what is recorded on the next execute
+        uint32_t m_plocIterations = 32;           // number of PLOC iterations recorded per submission, the host has to check the number of clusters afterwards (see LBVHBuilder::executePass)
+        bool m_sahCost = true;                    // true: calculate the SAH cost of the resulting LBVH (SAH_COST) after the build/refit
+        bool m_treeletOptimization = false;       // true: restructure treelets to minimize the SAH cost (TREELET_INIT and TREELET_RESTRUCTURE) after a full build
+        uint32_t m_treeletIterations = 3;         // number of bottom-up treelet restructuring passes
+        bool m_wideBVH = false;                   // true: collapse the LBVH into a BVH4/BVH8 (WIDE_INIT followed by iterations of WIDE_COLLAPSE and WIDE_UPDATE) after a full build
+        uint32_t m_wideIterations = 16;           // number of collapse iterations (levels of the wide BVH) recorded per submission, the host has to check the wide state afterwards (see LBVHBuilder::executePass)
+        bool m_compressedNodes = false;           // true: quantize the child bounds of all internal nodes into LBVHCompressedNodes (COMPRESS) after a full build/refit
+        bool m_collapseLeaves = false;            // true: collapse subtrees into multi-primitive leaves where it reduces the SAH cost (COLLAPSE_COST, COLLAPSE_INIT followed by iterations of COLLAPSE_EMIT and COLLAPSE_UPDATE) after a full build
+        uint32_t m_collapseIterations = 32;       // number of emit iterations (levels of the collapsed LBVH) recorded per submission, the host has to check the collapse state afterwards (see LBVHBuilder::executePass)
+
     protected:
         std::vector<std::shared_ptr<Shader>> createShaders() override;
 
         void recordCommands(VkCommandBuffer commandBuffer) override;
 
         void createPipelineLayouts() override;
+
+    private:
+        bool m_mortonCodes64;          // true: 63-bit morton codes (21 bits per axis, shaders are compiled with MORTON_CODES_64), false: 30-bit morton codes (10 bits per axis)
+        uint32_t m_wideBVHWidth;       // 4 (BVH4) or 8 (BVH8, the collapse shader is compiled with WIDE_BVH_WIDTH=8)
+        uint32_t m_compressedNodeBits; // 8 or 16 (the compression shader is compiled with COMPRESSED_NODE_BITS=16)
+        uint32_t m_subgroupSize = 32;   // from the device, see createShaders
+        uint32_t m_workGroupSize = 256; // from the device limits, see createShaders
+
+        static constexpr uint32_t RADIX_SORT_WORKGROUP_SIZE = 256; // WORKGROUP_SIZE of the radix sorts, one thread per bin (not specialized, the host computes the number of work groups with it)
+        static constexpr uint32_t MAX_WORKGROUP_SIZE = 256;        // default local_size_x of the specialized shaders
+
+        std::array<double, NUM_TIMED_STAGES> m_stageTimes{};
+
+        Buffer *m_extentBuffer = nullptr;
+        Buffer *m_plocStateBuffer = nullptr;
+        Buffer *m_wideStateBuffer = nullptr;
+        Buffer *m_collapseStateBuffer = nullptr;
+
+        static constexpr VkDeviceSize PLOC_DISPATCH_OFFSET = 2 * sizeof(uint32_t);         // offset of dispatchX in PLOCState (lbvh_common.glsl)
+        static constexpr VkDeviceSize PLOC_COMPACT_DISPATCH_OFFSET = 5 * sizeof(uint32_t); // offset of compactDispatchX in PLOCState (lbvh_common.glsl)
+        static constexpr VkDeviceSize WIDE_DISPATCH_OFFSET = 3 * sizeof(uint32_t);         // offset of dispatchX in LBVHWideState (lbvh_common.glsl)
+        static constexpr VkDeviceSize COLLAPSE_DISPATCH_OFFSET = 3 * sizeof(uint32_t);     // offset of dispatchX in LBVHCollapseState (lbvh_common.glsl)
+
+        void recordExtent(VkCommandBuffer commandBuffer);
+
+        void recordRadixSort(VkCommandBuffer commandBuffer);
+
+        void recordBuild(VkCommandBuffer commandBuffer);
+
+        void recordBatchBuild(VkCommandBuffer commandBuffer);
+
+        void recordRefit(VkCommandBuffer commandBuffer);
+
+        void recordTreeletOptimization(VkCommandBuffer commandBuffer);
+
+        void recordPostBuild(VkCommandBuffer commandBuffer);
+
+        void recordSAHCost(VkCommandBuffer commandBuffer);
+
+        void recordPLOC(VkCommandBuffer commandBuffer);
+
+        void recordPLOCIterations(VkCommandBuffer commandBuffer);
+
+        void recordWideCollapse(VkCommandBuffer commandBuffer);
+
+        void recordWideIterations(VkCommandBuffer commandBuffer);
+
+        void recordCompress(VkCommandBuffer commandBuffer);
+
+        void recordLeafCollapse(VkCommandBuffer commandBuffer);
+
+        void recordLeafCollapseIterations(VkCommandBuffer commandBuffer);
+
+        void recordStageBegin(VkCommandBuffer commandBuffer, TimedStage stage);
+
+        void recordStageEnd(VkCommandBuffer commandBuffer, TimedStage stage);
+
+        static void recordComputeBarrier(VkCommandBuffer commandBuffer);
+
+        static void recordIndirectBarrier(VkCommandBuffer commandBuffer);
     };
-}
\ No newline at end of file
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include "LBVHTypes.h"
+#include "engine/util/ThreadPool.h"
+
+namespace engine {
+    // quality metrics of a built LBVH (downloaded LBVHNode array), computed in parallel on the CPU
+    // all costs use a traversal and intersection cost of 1 and are normalized by the root, i.e. they are comparable between build algorithms and scenes
+    class LBVHQualityAnalyzer {
+    public:
+        explicit LBVHQualityAnalyzer(uint32_t numThreads = std::thread::hardware_concurrency(), uint32_t epoSamples = 1024) : m_threadPool(numThreads), m_epoSamples(epoSamples) {
+        }
+
+        struct Report {
+            uint32_t numNodes = 0;
+            uint32_t numLeaves = 0;
+            double sahCost = 0;                   // sum of the surface areas of all nodes / surface area of the root (same as lbvh_sah_cost.comp)
+            double epo = 0;                       // effective parallel overlap (Aila et al. 2013), estimated with getEPOSamples() random nodes
+            double siblingOverlapVolume = 0;      // sum of the overlap volumes of the two children of all internal nodes / volume of the root
+            double siblingOverlapArea = 0;        // same with the surface area of the overlap (also meaningful for flat scenes)
+            uint32_t maxLeafDepth = 0;            // depth of the root is 0
+            double averageLeafDepth = 0;
+            std::vector<uint32_t> depthHistogram; // depthHistogram[depth] = number of leaves at this depth
+        };
+
+        // throws if the LBVH is not a valid binary tree with the root at index 0 (see LBVH::verify for the full verification)
+        Report analyze(const std::vector<LBVHNode> &LBVH, bool absolutePointers);
+
+        static void print(const Report &report);
+
+        [[nodiscard]] uint32_t getEPOSamples() const {
+            return m_epoSamples;
+        }
+
+    private:
+        ThreadPool m_threadPool;
+        uint32_t m_epoSamples; // number of random nodes for the EPO estimate, the cost of a sample grows with the number of overlapping nodes
+
+        std::vector<uint32_t> m_frontier;     // nodes of the current level of the top-down traversal
+        std::vector<uint32_t> m_nextFrontier; // children of the internal nodes of the current level
+
+        static inline const char *PRINT_PREFIX = "[LBVHQuality] ";
+
+        void computeNodeMetrics(const std::vector<LBVHNode> &LBVH, bool absolutePointers, Report &report);
+
+        void computeDepths(const std::vector<LBVHNode> &LBVH, bool absolutePointers, Report &report);
+
+        void estimateEPO(const std::vector<LBVHNode> &LBVH, bool absolutePointers, Report &report);
+
+        static uint32_t getChild(const std::vector<LBVHNode> &LBVH, uint32_t index, int32_t pointer, bool absolutePointers);
+
+        static double surfaceArea(const LBVHNode &node);
+
+        static double volume(const LBVHNode &node);
+
+        static bool intersect(const LBVHNode &a, const LBVHNode &b, LBVHNode &intersection);
+    };
+} // namespace engine
@@ -0,0 +1,94 @@
+#pragma once
+
+#include "engine/util/Paths.h"
+#include "engine/passes/ComputePass.h"
+
+#include <algorithm>
+
+namespace engine {
+    // queries against a built LBVH (the LBVH buffer is only read, i.e. any number of queries can be executed after a build/refit)
+    class LBVHQueryPass : public ComputePass {
+    public:
+        // stackSize: entries of the traversal stack of every query thread, has to be at least getRequiredStackSize of the deepest queried LBVH (otherwise the queries report a stack overflow)
+        explicit LBVHQueryPass(GPUContext *gpuContext, uint32_t knnK = 8, uint32_t stackSize = DEFAULT_STACK_SIZE) : ComputePass(gpuContext), m_knnK(knnK), m_stackSize(stackSize) {
+        }
+
+        static constexpr uint32_t STACK_SIZE_CONSTANT_ID = 1; // layout (constant_id = 1) const uint STACK_SIZE of the query shaders
+        static constexpr uint32_t DEFAULT_STACK_SIZE = 64;
+
+        // the traversals test the children before they push them (only internal nodes are pushed, at most one deferred sibling per level), i.e. the stack of an LBVH with the given max leaf depth (root = 0, see LBVHQualityAnalyzer::Report::maxLeafDepth) never exceeds max(maxLeafDepth, 1) entries
+        static uint32_t getRequiredStackSize(uint32_t maxLeafDepth) {
+            return std::max(maxLeafDepth, 1u);
+        }
+
+        void create() override;
+
+        enum ComputeStage {
+            RAY_CLOSEST_HIT = 0,
+            RAY_ANY_HIT = 1,
+            OVERLAP = 2,
+            KNN = 3,
+            INSTANCE_RAY_CLOSEST_HIT = 4, // two-level ray queries against a top-level LBVH over instances of bottom-level LBVHs (see LBVHTwoLevelBuilder)
+            INSTANCE_RAY_ANY_HIT = 5,
+        };
+
+        struct PushConstantsRayQuery {
+            uint32_t g_num_rays;
+            uint32_t g_absolute_pointers;
+        };
+        PushConstantsRayQuery m_pushConstantsRayQuery{};
+
+        struct PushConstantsOverlap {
+            uint32_t g_num_queries;
+            uint32_t g_query_offset;
+            uint32_t g_max_pairs;
+            uint32_t g_absolute_pointers;
+            uint32_t g_self_collision;
+        };
+        PushConstantsOverlap m_pushConstantsOverlap{};
+
+        struct PushConstantsKNN {
+            uint32_t g_num_queries;
+            uint32_t g_absolute_pointers;
+        };
+        PushConstantsKNN m_pushConstantsKNN{};
+
+        struct PushConstantsInstanceRayQuery {
+            uint32_t g_num_rays;
+            uint32_t g_absolute_pointers;
+        };
+        PushConstantsInstanceRayQuery m_pushConstantsInstanceRayQuery{};
+
+        ComputeStage m_stage = RAY_CLOSEST_HIT; // what is recorded on the next execute
+
+        // the overlap state buffer (LBVHOverlapState) is reset with vkCmdFillBuffer before OVERLAP, therefore the pass needs to know the buffer (which requires VK_BUFFER_USAGE_TRANSFER_DST_BIT)
+        void setOverlapStateBuffer(Buffer *overlapStateBuffer);
+
+        // same for the nearest neighbour state buffer (LBVHKNNState) before KNN
+        void setKNNStateBuffer(Buffer *knnStateBuffer);
+
+        [[nodiscard]] uint32_t getKNNK() const {
+            return m_knnK;
+        }
+
+        [[nodiscard]] uint32_t getStackSize() const {
+            return m_stackSize;
+        }
+
+    protected:
+        std::vector<std::shared_ptr<Shader>> createShaders() override;
+
+        void recordCommands(VkCommandBuffer commandBuffer) override;
+
+        void createPipelineLayouts() override;
+
+    private:
+        uint32_t m_knnK; // number of neighbours per nearest neighbour query (the shader is compiled with KNN_K)
+        uint32_t m_stackSize;
+
+        static constexpr uint32_t MAX_WORKGROUP_SIZE = 256; // default local_size_x of the query shaders
+
+        Buffer *m_overlapStateBuffer = nullptr;
+        Buffer *m_knnStateBuffer = nullptr;
+    };
+}
@@ -0,0 +1,114 @@
+#pragma once
+
+#include "LBVHBuilder.h"
+
+namespace engine {
+    // two-level acceleration structure for instanced scenes: one bottom-level LBVH (BLAS) per mesh and a top-level LBVH (TLAS) over the world aabbs of the instances
+    // the meshes are built once (batched build) and compacted into a buffer of the exact size, the TLAS is rebuilt whenever the instances move, i.e. the rebuild only depends on the number of instances
+    // an instance references a mesh and stores its object to world transform (3x4), the ray queries (LBVHQueryPass::INSTANCE_RAY_*) transform the rays into the object space of the hit instances
+    // the TLAS and the instances buffer are overwritten by the next build of the instances, the queries against the last build have to be finished before
+    class LBVHTwoLevelBuilder {
+    public:
+        struct Instance {
+            float transform[12]; // object to world (3x4, row-major), has to be invertible
+            uint32_t meshIdx;    // index of the mesh of buildMeshes
+        };
+
+        explicit LBVHTwoLevelBuilder(GPUContext *gpuContext, bool mortonCodes64 = false, bool absolutePointers = true) : m_gpuContext(gpuContext), m_mortonCodes64(mortonCodes64), m_absolutePointers(absolutePointers), m_tlasBuilder(gpuContext, mortonCodes64, absolutePointers) {
+        }
+
+        void create(uint32_t initialInstanceCapacity = MIN_INSTANCE_CAPACITY);
+
+        void release();
+
+        // builds the LBVH of every mesh (at least one element per mesh) with a single batched build and replaces the meshes of the last call, returns the time in ms
+        // the instances have to be rebuilt afterward, the primitive ids of a mesh are returned by the queries together with the instance index
+        double buildMeshes(const std::vector<std::vector<Element>> &meshes);
+
+        // builds the TLAS over the instances (at least one instance), returns the time in ms (transforms, upload and execution)
+        double buildInstances(const std::vector<Instance> &instances);
+
+        // same as above without blocking the host (see LBVHBuilder::buildAsync), the instances buffer is complete when the returned build finished
+        LBVHBuilder::BuildHandle buildInstancesAsync(const std::vector<Instance> &instances, const std::vector<ComputePass::SemaphoreWait> &waits = {});
+
+        void wait(LBVHBuilder::BuildHandle handle) {
+            m_tlasBuilder.wait(handle);
+        }
+
+        [[nodiscard]] bool isFinished(LBVHBuilder::BuildHandle handle) const {
+            return m_tlasBuilder.isFinished(handle);
+        }
+
+        // 2 * getNumInstances() - 1 nodes, the primitiveIdx of a leaf is the instance index
+        void downloadTLAS(std::vector<LBVHNode> &LBVH);
+
+        // the LBVHs of all meshes, the LBVH of mesh i starts at getMeshes()[i].nodeOffset
+        void downloadBLAS(std::vector<LBVHNode> &LBVH);
+
+        // bindings of the instance ray queries (lbvh_instance_ray_query.comp), valid until the next build that exceeds the capacity (TLAS and instances) or the next buildMeshes (BLAS)
+        [[nodiscard]] Buffer *getTLASBuffer() const {
+            return m_tlasBuilder.getLBVHBuffer();
+        }
+
+        [[nodiscard]] Buffer *getBLASBuffer() const {
+            return m_blasBuffer.get();
+        }
+
+        [[nodiscard]] Buffer *getInstancesBuffer() const {
+            return m_instancesBuffer.get();
+        }
+
+        // the segments of the last buildMeshes, i.e. the element range and the root of the LBVH of every mesh
+        [[nodiscard]] const std::vector<LBVHSegment> &getMeshes() const {
+            return m_meshes;
+        }
+
+        // the instances of the last build as they are stored in the instances buffer (inverse transforms)
+        [[nodiscard]] const std::vector<LBVH::LBVHInstance> &getInstances() const {
+            return m_instances;
+        }
+
+        [[nodiscard]] uint32_t getNumInstances() const {
+            return static_cast<uint32_t>(m_instances.size());
+        }
+
+        // e.g. for the stage times of the last TLAS build
+        [[nodiscard]] const LBVHBuilder &getTLASBuilder() const {
+            return m_tlasBuilder;
+        }
+
+        // the compacted LBVHs of the meshes, independent of the number of instances
+        [[nodiscard]] uint64_t getBLASMemoryBytes() const {
+            return m_blasBuffer ? m_blasBuffer->getSizeBytes() : 0;
+        }
+
+        // the buffers of the TLAS builder and the instances buffer, grows with the number of instances
+        [[nodiscard]] uint64_t getTLASMemoryBytes() const;
+
+        // the ray in the object space of the instance (the direction is not normalized, i.e. t is the same in both spaces), as in lbvh_instance_ray_query.comp
+        static LBVH::Ray transformRay(const LBVH::LBVHInstance &instance, const LBVH::Ray &ray);
+
+    private:
+        static constexpr uint32_t MIN_INSTANCE_CAPACITY = 1024;
+        static constexpr uint32_t GROWTH_FACTOR = 2; // the capacity grows to max(numInstances, GROWTH_FACTOR * capacity)
+
+        GPUContext *m_gpuContext;
+        bool m_mortonCodes64;
+        bool m_absolutePointers;
+
+        LBVHBuilder m_tlasBuilder;
+
+        std::vector<LBVHSegment> m_meshes;
+        std::vector<LBVHNode> m_meshAABBs;   // root node of the LBVH of every mesh (object space)
+        std::vector<Element> m_tlasElements; // world aabb of every instance, the input of the TLAS build
+        std::vector<LBVH::LBVHInstance> m_instances;
+        uint32_t m_instanceCapacity = 0;
+        StagingRing::TransferHandle m_instancesUpload; // last upload into the instances buffer, finished before the buffer is reallocated
+
+        std::shared_ptr<Buffer> m_blasBuffer;
+        std::shared_ptr<Buffer> m_instancesBuffer;
+
+        // (re)allocates the instances buffer (after the pending TLAS build finished) if numInstances exceeds its capacity
+        void reserveInstances(uint32_t numInstances);
+    };
+}
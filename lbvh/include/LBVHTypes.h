@@ -0,0 +1,41 @@
+#pragma once
+
+#include <cstdint>
+
+// types shared by the GPU builders (LBVHBuilder, LBVHTwoLevelBuilder) and the CPU side (LBVHCPUBuilder, LBVHQualityAnalyzer), i.e. no Vulkan dependency
+// the layouts match the structs of the same name in lbvh_common.glsl
+
+#define INVALID_POINTER 0x0 // do not change
+
+namespace engine {
+    // input for the builder (normally a triangle or some other kind of primitive); it is necessary to allocate and fill the buffer
+    struct Element {
+        uint32_t primitiveIdx; // the id of the primitive; this primitive id is copied to the leaf nodes of the  LBVHNode
+        float aabbMinX;        // aabb of the primitive
+        float aabbMinY;
+        float aabbMinZ;
+        float aabbMaxX;
+        float aabbMaxY;
+        float aabbMaxZ;
+    };
+
+    // output of the builder; it is necessary to allocate the (empty) buffer
+    struct LBVHNode {
+        int32_t left;          // pointer to the left child or INVALID_POINTER in case of leaf
+        int32_t right;         // pointer to the right child or INVALID_POINTER in case of leaf
+        uint32_t primitiveIdx; // custom value that is copied from the input Element or 0 in case of inner node
+        float aabbMinX;        // aabb of the node
+        float aabbMinY;
+        float aabbMinZ;
+        float aabbMaxX;
+        float aabbMaxY;
+        float aabbMaxZ;
+    };
+
+    // input for the batched build (LBVHBuilder::buildBatch), one segment per LBVH; it is necessary to allocate and fill the buffer
+    struct LBVHSegment {
+        uint32_t elementOffset; // first element of the segment, the segments cover the elements in order
+        uint32_t numElements;
+        uint32_t nodeOffset;    // root of the LBVH of the segment (2 * numElements - 1 nodes), set by the builder
+    };
+} // namespace engine
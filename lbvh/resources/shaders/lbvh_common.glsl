@@ -9,6 +9,10 @@
 #ifndef LBVH_COMMONG_GLSL
 #define LBVH_COMMONG_GLSL
 
+#ifdef MORTON_CODES_64
+#extension GL_EXT_shader_explicit_arithmetic_types_int64: require
+#endif
+
 #define INVALID_POINTER 0x0
 
 // input for the builder (normally a triangle or some other kind of primitive); it is necessary to allocate and fill the buffer
@@ -35,16 +39,243 @@ struct LBVHNode {
     float aabbMaxZ;
 };
 
+#ifdef MORTON_CODES_64
+// 63-bit morton codes (21 bits per axis), compile the shaders with -DMORTON_CODES_64
+#define MORTON_CODE_T uint64_t
+#define MORTON_CODE_BITS 64
+
+// only used on the GPU side during construction; it is necessary to allocate the (empty) buffer
+struct MortonCodeElement {
+    uint64_t mortonCode;// key for sorting
+    uint elementIdx;// pointer into element buffer
+    uint padding;
+};
+
+// number of leading zero bits, 64 for v == 0
+int countLeadingZeros(uint64_t v) {
+    uint high = uint(v >> 32);
+    uint low = uint(v);
+    return high != 0 ? 31 - findMSB(high) : 63 - findMSB(low);
+}
+#else
+// 30-bit morton codes (10 bits per axis)
+#define MORTON_CODE_T uint
+#define MORTON_CODE_BITS 32
+
 // only used on the GPU side during construction; it is necessary to allocate the (empty) buffer
 struct MortonCodeElement {
     uint mortonCode;// key for sorting
     uint elementIdx;// pointer into element buffer
 };
 
+// number of leading zero bits, 32 for v == 0
+int countLeadingZeros(uint v) {
+    return 31 - findMSB(v);
+}
+#endif
+
 // only used on the GPU side during construction; it is necessary to allocate the (empty) buffer
 struct LBVHConstructionInfo {
     uint parent;// pointer to the parent
     int visitationCount;// number of threads that arrived
 };
 
+// only used on the GPU side during construction; it is necessary to allocate the (empty) buffer
+// extent of the centroids of all elements, the floats are stored as order-preserving uints (see floatToOrderedUint) to allow atomicMin and atomicMax
+struct LBVHExtent {
+    uint minX;
+    uint minY;
+    uint minZ;
+    uint maxX;
+    uint maxY;
+    uint maxZ;
+};
+
+// input for the batched build (lbvh_segmented_*.comp), one segment per LBVH; it is necessary to allocate and fill the buffer
+// the segments cover the elements in order, the LBVH of a segment is written to nodeOffset = 2 * elementOffset - segment index (2 * numElements - 1 nodes, pointers relative to nodeOffset)
+struct LBVHSegment {
+    uint elementOffset;// first element of the segment
+    uint numElements;
+    uint nodeOffset;// root of the LBVH of the segment
+};
+
+// only used on the GPU side during PLOC construction; it is necessary to allocate the (empty) buffer
+struct PLOCState {
+    uint numClusters;// number of clusters of the current iteration
+    uint nodeCounter;// number of created internal nodes, the internal nodes are allocated downwards from g_num_elements - 2 so that the root is node 0
+    uint dispatchX;// indirect dispatch (VkDispatchIndirectCommand) for nearest neighbour, merge: ceil(numClusters / WORKGROUP_SIZE) work groups
+    uint dispatchY;
+    uint dispatchZ;
+    uint compactDispatchX;// indirect dispatch (VkDispatchIndirectCommand) for compact: work groups of the number of clusters before the merge
+    uint compactDispatchY;
+    uint compactDispatchZ;
+};
+
+#define INVALID_CLUSTER 0xFFFFFFFFu
+
+#ifndef WIDE_BVH_WIDTH
+#define WIDE_BVH_WIDTH 4// 4 (BVH4) or 8 (BVH8), set with -DWIDE_BVH_WIDTH=8
+#endif
+#define WIDE_BVH_LEAF 0x80000000u// leaf flag of the child pointer of a LBVHWideNode, the lower 31 bits are the primitiveIdx
+#define WIDE_BVH_INVALID_CHILD 0xFFFFFFFFu// empty child slot, the aabb of the slot is empty (min=+inf, max=-inf)
+
+// output of the optional collapse (lbvh_wide_*.comp); it is necessary to allocate the (empty) buffer
+// the bounds of all children are stored contiguously (structure of arrays) for SIMD traversal on the CPU or GPU
+struct LBVHWideNode {
+    float childMinX[WIDE_BVH_WIDTH];// aabbs of the children
+    float childMinY[WIDE_BVH_WIDTH];
+    float childMinZ[WIDE_BVH_WIDTH];
+    float childMaxX[WIDE_BVH_WIDTH];
+    float childMaxY[WIDE_BVH_WIDTH];
+    float childMaxZ[WIDE_BVH_WIDTH];
+    uint children[WIDE_BVH_WIDTH];// index of the child wide node, WIDE_BVH_LEAF | primitiveIdx in case of leaf or WIDE_BVH_INVALID_CHILD
+};
+
+// only used on the GPU side during the collapse; it is necessary to allocate the (empty) buffer
+struct LBVHWideState {
+    uint levelBegin;// wide nodes [levelBegin, levelEnd) are processed in the current iteration
+    uint levelEnd;
+    uint nodeCounter;// number of allocated wide nodes, the wide root is node 0
+    uint dispatchX;// indirect dispatch (VkDispatchIndirectCommand) for collapse: ceil((levelEnd - levelBegin) / WORKGROUP_SIZE)
+    uint dispatchY;
+    uint dispatchZ;
+};
+
+#ifndef COMPRESSED_NODE_BITS
+#define COMPRESSED_NODE_BITS 8// 8 or 16 bits per quantized bound, set with -DCOMPRESSED_NODE_BITS=16
+#endif
+#define COMPRESSED_NODE_MAX_VALUE ((1u << COMPRESSED_NODE_BITS) - 1u)
+#define COMPRESSED_NODE_VALUES_PER_WORD (32 / COMPRESSED_NODE_BITS)
+#define COMPRESSED_NODE_BOUNDS_WORDS (12 / COMPRESSED_NODE_VALUES_PER_WORD)// 2 children * 6 bounds
+#define COMPRESSED_NODE_LEAF 0x80000000u// leaf flag of the child pointer of a LBVHCompressedNode, the lower 31 bits are the primitiveIdx
+
+// output of the optional compression (lbvh_compress.comp), one node per internal node of the LBVH; it is necessary to allocate the (empty) buffer
+// the child aabbs are quantized conservatively on a grid with power of two spacing relative to the aabb of the node: bound = origin + value * 2^(exponent - 127)
+struct LBVHCompressedNode {
+    float originX;// minimum of the node aabb, origin of the grid
+    float originY;
+    float originZ;
+    uint exponents;// biased exponents (as in float) of the grid spacing per axis: x | y << 8 | z << 16
+    uint childBounds[COMPRESSED_NODE_BOUNDS_WORDS];// quantized child aabbs, value i = 6 * child + (minX, minY, minZ, maxX, maxY, maxZ) is stored in word i / COMPRESSED_NODE_VALUES_PER_WORD
+    uint children[2];// index of the internal child node (same index as in the LBVH) or COMPRESSED_NODE_LEAF | primitiveIdx in case of leaf
+};
+
+#define COLLAPSE_MAX_LEAF_SIZE 8// maximum number of primitives of a leaf of the collapsed LBVH (lbvh_collapse_*.comp)
+
+// output of the optional leaf collapse (lbvh_collapse_*.comp); it is necessary to allocate the (empty) buffer
+struct LBVHCollapsedNode {
+    int left;// pointer to the left child or INVALID_POINTER in case of leaf
+    int right;// pointer to the right child or INVALID_POINTER in case of leaf
+    uint primitiveOffset;// first index into the primitive index list (all primitives of the subtree are stored contiguously)
+    uint primitiveCount;// number of primitives of the leaf or 0 in case of inner node
+    float aabbMinX;// aabb of the node
+    float aabbMinY;
+    float aabbMinZ;
+    float aabbMaxX;
+    float aabbMaxY;
+    float aabbMaxZ;
+};
+
+// only used on the GPU side during the leaf collapse; it is necessary to allocate the (empty) buffer
+struct LBVHCollapseInfo {
+    uint primitiveCount;// number of primitives in the subtree
+    uint collapse;// 1 if the subtree becomes a single leaf
+    float cost;// SAH cost of the subtree (not normalized)
+};
+
+// only used on the GPU side during the leaf collapse; it is necessary to allocate the (empty) buffer
+struct LBVHCollapseState {
+    uint levelBegin;// collapsed nodes [levelBegin, levelEnd) are emitted in the current iteration
+    uint levelEnd;
+    uint nodeCounter;// number of allocated collapsed nodes, the root is node 0
+    uint dispatchX;// indirect dispatch (VkDispatchIndirectCommand) for emit: ceil((levelEnd - levelBegin) / WORKGROUP_SIZE)
+    uint dispatchY;
+    uint dispatchZ;
+};
+
+#define INVALID_PRIMITIVE 0xFFFFFFFFu// primitiveIdx of a query result without hit
+
+// input for the ray queries (lbvh_ray_query.comp); it is necessary to allocate and fill the buffer
+struct Ray {
+    float originX;
+    float originY;
+    float originZ;
+    float tMin;// the ray is the segment origin + t * direction, t in [tMin, tMax]
+    float directionX;
+    float directionY;
+    float directionZ;
+    float tMax;
+};
+
+// output of the ray queries (lbvh_ray_query.comp); it is necessary to allocate the (empty) buffer
+struct RayHit {
+    uint primitiveIdx;// primitiveIdx of the hit primitive or INVALID_PRIMITIVE in case of miss
+    float t;// ray parameter of the hit
+    uint stackOverflow;// 1 if the traversal stack (LBVHQueryPass stackSize) was too small for the LBVH, i.e. subtrees were skipped and the hit may be wrong
+};
+
+// input for the two-level ray queries (lbvh_instance_ray_query.comp), one per instance (written by LBVHTwoLevelBuilder); it is necessary to allocate and fill the buffer
+struct LBVHInstance {
+    float worldToObject[12];// inverse of the object to world transform (3x4, row-major), the rays are transformed into the object space of the instance
+    uint nodeOffset;// root of the LBVH of the mesh in the bottom-level buffer (LBVHSegment::nodeOffset)
+    uint meshIdx;
+};
+
+// output of the two-level ray queries (lbvh_instance_ray_query.comp); it is necessary to allocate the (empty) buffer
+struct InstanceRayHit {
+    uint instanceIdx;// index of the hit instance or INVALID_PRIMITIVE in case of miss
+    uint primitiveIdx;// primitiveIdx of the hit primitive of the mesh or INVALID_PRIMITIVE in case of miss
+    float t;// ray parameter of the hit (the same in world and object space, the direction is transformed without normalization)
+    uint stackOverflow;// 1 if the traversal stack (LBVHQueryPass stackSize) was too small for the top-level or a bottom-level LBVH, i.e. subtrees were skipped and the hit may be wrong
+};
+
+// output of the overlap queries (lbvh_overlap_query.comp); it is necessary to allocate the (empty) buffer
+struct OverlapPair {
+    uint queryIdx;// index of the query aabb
+    uint primitiveIdx;// primitiveIdx of the overlapping leaf
+};
+
+// state of the overlap queries (lbvh_overlap_query.comp); it is necessary to allocate the buffer and reset it before each execution (0, 0, INVALID_QUERY, 0)
+struct LBVHOverlapState {
+    uint pairCount;// number of found pairs, may exceed the capacity of the pair buffer
+    uint overflowCount;// number of pairs that did not fit into the pair buffer
+    uint resumeQueryIdx;// smallest query index with a dropped pair or INVALID_QUERY, the pairs of all queries < resumeQueryIdx are complete
+    uint stackOverflowCount;// number of queries whose traversal stack (LBVHQueryPass stackSize) was too small for the LBVH, i.e. pairs may be missing
+};
+
+#define INVALID_QUERY 0xFFFFFFFFu
+
+#ifndef KNN_K
+#define KNN_K 8// number of neighbours per nearest neighbour query (lbvh_knn_query.comp), set with -DKNN_K=16
+#endif
+
+// input for the nearest neighbour queries (lbvh_knn_query.comp); it is necessary to allocate and fill the buffer
+struct PointQuery {
+    float x;// query point
+    float y;
+    float z;
+    float maxDistance;// only neighbours within this distance are reported, infinity for the k nearest neighbours, the radius for a radius search
+};
+
+// output of the nearest neighbour queries (lbvh_knn_query.comp), KNN_K per query sorted by distance; it is necessary to allocate the (empty) buffer
+struct Neighbour {
+    uint primitiveIdx;// primitiveIdx of the neighbour or INVALID_PRIMITIVE if less than KNN_K primitives are within maxDistance
+    float distanceSquared;// squared distance to the aabb of the primitive (to the point for point elements with min == max)
+};
+
+// state of the nearest neighbour queries (lbvh_knn_query.comp); it is necessary to allocate the buffer and reset it before each execution (0)
+struct LBVHKNNState {
+    uint stackOverflowCount;// number of queries whose traversal stack (LBVHQueryPass stackSize) was too small for the LBVH, i.e. neighbours may be wrong
+};
+
+// maps a float to a uint such that the order is preserved, i.e. a < b <=> floatToOrderedUint(a) < floatToOrderedUint(b)
+uint floatToOrderedUint(float f) {
+    uint u = floatBitsToUint(f);
+    return (u & 0x80000000u) != 0 ? ~u : u | 0x80000000u;
+}
+
+float orderedUintToFloat(uint u) {
+    return uintBitsToFloat((u & 0x80000000u) != 0 ? u & 0x7FFFFFFFu : ~u);
+}
+
 #endif
\ No newline at end of file
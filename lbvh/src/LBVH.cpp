@@ -1,121 +1,987 @@
 #include "LBVH.h"
+#include "LBVHBuilder.h"
+#include "LBVHCPUBuilder.h"
+#include "LBVHQualityAnalyzer.h"
+#include "LBVHTwoLevelBuilder.h"
 
 namespace engine {
 
     void LBVH::execute(GPUContext *gpuContext) {
-        AABB extent{};
         std::vector<Element> elements;
-        generateElements(elements, &extent);
+        generateElements(elements);
         const uint NUM_ELEMENTS = elements.size();
-        const uint NUM_LBVH_ELEMENTS = NUM_ELEMENTS + NUM_ELEMENTS - 1;
 
         // gpu context
         m_gpuContext = gpuContext;
 
-        // compute pass
-        m_pass = std::make_shared<LBVHPass>(gpuContext);
-        m_pass->create();
-        m_pass->setGlobalInvocationSize(LBVHPass::MORTON_CODES, NUM_ELEMENTS, 1, 1);
-        m_pass->setGlobalInvocationSize(LBVHPass::RADIX_SORT, 256, 1, 1); // WORKGROUP_SIZE defined in lbvh_single_radix_sort.comp, i.e. we just want to launch a single work group
-        m_pass->setGlobalInvocationSize(LBVHPass::HIERARCHY, NUM_ELEMENTS, 1, 1);
-        m_pass->setGlobalInvocationSize(LBVHPass::BOUNDING_BOXES, NUM_ELEMENTS, 1, 1);
-
-        // push constants
-        m_pass->m_pushConstantsMortonCodes.g_num_elements = NUM_ELEMENTS;
-        m_pass->m_pushConstantsMortonCodes.g_min_x = extent.min.x;
-        m_pass->m_pushConstantsMortonCodes.g_min_y = extent.min.y;
-        m_pass->m_pushConstantsMortonCodes.g_min_z = extent.min.z;
-        m_pass->m_pushConstantsMortonCodes.g_max_x = extent.max.x;
-        m_pass->m_pushConstantsMortonCodes.g_max_y = extent.max.y;
-        m_pass->m_pushConstantsMortonCodes.g_max_z = extent.max.z;
-        m_pass->m_pushConstantsRadixSort.g_num_elements = NUM_ELEMENTS;
-        m_pass->m_pushConstantsHierarchy.g_num_elements = NUM_ELEMENTS;
-        m_pass->m_pushConstantsHierarchy.g_absolute_pointers = ABSOLUTE_POINTERS;
-        m_pass->m_pushConstantsBoundingBoxes.g_num_elements = NUM_ELEMENTS;
-        m_pass->m_pushConstantsBoundingBoxes.g_absolute_pointers = ABSOLUTE_POINTERS;
-
-        // buffers
-        auto settingsElement = Buffer::BufferSettings{.m_sizeBytes = static_cast<uint32_t>(NUM_ELEMENTS * sizeof(Element)), .m_bufferUsages = VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, .m_memoryProperties = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, .m_name = "lbvh.elementsBuffer"};
-        m_elementsBuffer = Buffer::fillDeviceWithStagingBuffer(m_gpuContext, settingsElement, elements.data());
-
-        auto settingsMortonCode = Buffer::BufferSettings{.m_sizeBytes = static_cast<uint32_t>(NUM_ELEMENTS * sizeof(MortonCodeElement)), .m_bufferUsages = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, .m_memoryProperties = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, .m_name = "lbvh.mortonCodeBuffer"};
-        m_mortonCodeBuffer = std::make_shared<Buffer>(gpuContext, settingsMortonCode);
-
-        auto settingsMortonCodePingPong = Buffer::BufferSettings{.m_sizeBytes = static_cast<uint32_t>(NUM_ELEMENTS * sizeof(MortonCodeElement)), .m_bufferUsages = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, .m_memoryProperties = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, .m_name = "lbvh.mortonCodePingPongBuffer"};
-        m_mortonCodePingPongBuffer = std::make_shared<Buffer>(gpuContext, settingsMortonCodePingPong);
-
-        auto settingsLBVH = Buffer::BufferSettings{.m_sizeBytes = static_cast<uint32_t>(NUM_LBVH_ELEMENTS * sizeof(LBVHNode)), .m_bufferUsages = VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, .m_memoryProperties = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, .m_name = "lbvh.LBVHBuffer"};
-        m_LBVHBuffer = std::make_shared<Buffer>(gpuContext, settingsLBVH);
-
-        auto settingsLBVHConstructionInfo = Buffer::BufferSettings{.m_sizeBytes = static_cast<uint32_t>(NUM_LBVH_ELEMENTS * sizeof(LBVHConstructionInfo)), .m_bufferUsages = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, .m_memoryProperties = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, .m_name = "lbvh.LBVHConstructionInfoBuffer"};
-        m_LBVHConstructionInfoBuffer = std::make_shared<Buffer>(gpuContext, settingsLBVHConstructionInfo);
+        // used by verify and verifyCPUBuilder, the thread pool is kept for all analyses
+        m_qualityAnalyzer = std::make_shared<LBVHQualityAnalyzer>();
+
+        // persistent builder for all builds of the example, the pipelines are created with the pipeline cache of the gpu context (warm if it was saved by a previous run)
+        std::chrono::steady_clock::time_point createBegin = std::chrono::steady_clock::now();
+        m_builder = std::make_shared<LBVHBuilder>(gpuContext, MORTON_CODES_64, ABSOLUTE_POINTERS, WIDE_BVH_WIDTH, COMPRESSED_NODE_BITS);
+        m_builder->create(NUM_ELEMENTS);
+        std::chrono::steady_clock::time_point createEnd = std::chrono::steady_clock::now();
+        std::cout << PRINT_PREFIX << "Compute pass created in " << static_cast<double>(std::chrono::duration_cast<std::chrono::microseconds>(createEnd - createBegin).count()) * std::pow(10, -3) << "[ms] (" << (gpuContext->isPipelineCacheWarm() ? "warm" : "cold") << " pipeline cache)." << std::endl;
+        std::cout << PRINT_PREFIX << "Shaders specialized with subgroup size " << m_builder->getPass()->getSubgroupSize() << " (radix sorts) and work group size " << m_builder->getPass()->getWorkGroupSize() << "." << std::endl;
 
         std::cout << PRINT_PREFIX << "Building LBVH for " << NUM_ELEMENTS << " elements." << std::endl;
-        std::cout << PRINT_PREFIX << "Union of all element AABBs: " << extent << std::endl;
-
-        // set storage buffers
-        m_pass->setStorageBuffer(0, 0, m_mortonCodeBuffer.get());
-        m_pass->setStorageBuffer(0, 1, m_elementsBuffer.get());
-        m_pass->setStorageBuffer(1, 0, m_mortonCodeBuffer.get());
-        m_pass->setStorageBuffer(1, 1, m_mortonCodePingPongBuffer.get());
-        m_pass->setStorageBuffer(2, 0, m_mortonCodeBuffer.get());
-        m_pass->setStorageBuffer(2, 1, m_elementsBuffer.get());
-        m_pass->setStorageBuffer(2, 2, m_LBVHBuffer.get());
-        m_pass->setStorageBuffer(2, 3, m_LBVHConstructionInfoBuffer.get());
-        m_pass->setStorageBuffer(3, 0, m_LBVHBuffer.get());
-        m_pass->setStorageBuffer(3, 1, m_LBVHConstructionInfoBuffer.get());
-
-        // execute pass
-        std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
-        m_pass->execute(VK_NULL_HANDLE);
-        vkQueueWaitIdle(m_gpuContext->m_queues->getQueue(Queues::COMPUTE));
-        std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
-        double gpuTime = (static_cast<double>(std::chrono::duration_cast<std::chrono::microseconds>(end - begin).count()) * std::pow(10, -3));
+        std::cout << PRINT_PREFIX << "Using " << (MORTON_CODES_64 ? "63" : "30") << "-bit morton codes." << std::endl;
+        std::cout << PRINT_PREFIX << "Sorting morton codes with the " << (NUM_ELEMENTS > SINGLE_RADIX_SORT_THRESHOLD ? "multi" : "single") << " work group radix sort." << std::endl;
+
+        // query buffers, the query pass is created by the first verify (reserveQueryStack)
+        auto settingsRays = Buffer::BufferSettings{.m_sizeBytes = static_cast<uint32_t>(NUM_RAYS * sizeof(Ray)), .m_bufferUsages = VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, .m_memoryProperties = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, .m_name = "lbvh.raysBuffer"};
+        m_raysBuffer = std::make_shared<Buffer>(gpuContext, settingsRays);
+
+        auto settingsRayHits = Buffer::BufferSettings{.m_sizeBytes = static_cast<uint32_t>(NUM_RAYS * sizeof(RayHit)), .m_bufferUsages = VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, .m_memoryProperties = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, .m_name = "lbvh.rayHitsBuffer"};
+        m_rayHitsBuffer = std::make_shared<Buffer>(gpuContext, settingsRayHits);
+
+        auto settingsOverlapPairs = Buffer::BufferSettings{.m_sizeBytes = static_cast<uint32_t>(MAX_OVERLAP_PAIRS * sizeof(OverlapPair)), .m_bufferUsages = VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, .m_memoryProperties = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, .m_name = "lbvh.overlapPairsBuffer"};
+        m_overlapPairsBuffer = std::make_shared<Buffer>(gpuContext, settingsOverlapPairs);
+
+        auto settingsOverlapState = Buffer::BufferSettings{.m_sizeBytes = sizeof(LBVHOverlapState), .m_bufferUsages = VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, .m_memoryProperties = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, .m_name = "lbvh.overlapStateBuffer"};
+        m_overlapStateBuffer = std::make_shared<Buffer>(gpuContext, settingsOverlapState);
+
+        auto settingsPointQueries = Buffer::BufferSettings{.m_sizeBytes = static_cast<uint32_t>(NUM_KNN_QUERIES * sizeof(PointQuery)), .m_bufferUsages = VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, .m_memoryProperties = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, .m_name = "lbvh.pointQueriesBuffer"};
+        m_pointQueriesBuffer = std::make_shared<Buffer>(gpuContext, settingsPointQueries);
+
+        auto settingsNeighbours = Buffer::BufferSettings{.m_sizeBytes = static_cast<uint32_t>(NUM_KNN_QUERIES * KNN_K * sizeof(Neighbour)), .m_bufferUsages = VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, .m_memoryProperties = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, .m_name = "lbvh.neighboursBuffer"};
+        m_neighboursBuffer = std::make_shared<Buffer>(gpuContext, settingsNeighbours);
+
+        auto settingsKNNState = Buffer::BufferSettings{.m_sizeBytes = sizeof(LBVHKNNState), .m_bufferUsages = VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, .m_memoryProperties = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, .m_name = "lbvh.knnStateBuffer"};
+        m_knnStateBuffer = std::make_shared<Buffer>(gpuContext, settingsKNNState);
+
+        // build (upload of the elements and execution)
+        double gpuTime = m_builder->build(elements);
         std::cout << PRINT_PREFIX << "GPU build finished in " << gpuTime << "[ms]." << std::endl;
+        printStageTimes("Karras");
+
+        LBVHExtent extent{};
+        m_builder->getExtentBuffer()->downloadWithStagingBuffer(&extent);
+        std::cout << PRINT_PREFIX << "Extent of all element centroids: " << AABB({orderedUintToFloat(extent.minX), orderedUintToFloat(extent.minY), orderedUintToFloat(extent.minZ), 0}, {orderedUintToFloat(extent.maxX), orderedUintToFloat(extent.maxY), orderedUintToFloat(extent.maxZ), 0}) << std::endl;
 
         // verify result
-        verify(NUM_LBVH_ELEMENTS);
+        verify();
+        m_buildSAHCost = m_builder->downloadSAHCost();
+        std::cout << PRINT_PREFIX << "SAH cost (GPU): " << m_buildSAHCost << std::endl;
+
+        // ray queries: rays from outside towards random points within the extent of the centroids
+        std::mt19937 rayGenerator(7);
+        generateRays(m_rays, AABB({orderedUintToFloat(extent.minX), orderedUintToFloat(extent.minY), orderedUintToFloat(extent.minZ), 0}, {orderedUintToFloat(extent.maxX), orderedUintToFloat(extent.maxY), orderedUintToFloat(extent.maxZ), 0}), rayGenerator);
+        m_raysBuffer->uploadWithStagingBuffer(m_rays.data());
+        benchmarkRayQueries("Karras");
+        benchmarkOverlapQueries("Karras", elements, gpuTime);
+
+        // CPU builder: same pipeline and result as the GPU Karras build
+        benchmarkCPUBuilder(elements, gpuTime);
+
+        // persistent builder: create once, build many times
+        benchmarkPersistentBuilder(elements, gpuTime);
+
+        // batched build: one LBVH per segment of the elements with a single submission
+        benchmarkBatchedBuild(elements);
+
+        // two-level acceleration structure: LBVHs of meshes built once, the LBVH over the moving instances is rebuilt every frame
+        benchmarkInstancedScene(elements);
+
+        // morton code widths: 30-bit and 63-bit codes on the same dense input with many duplicate codes
+        benchmarkMortonCodeWidths(NUM_ELEMENTS);
+
+        // treelet restructuring: build again with the optimization and compare
+        LBVHPass *pass = m_builder->getPass();
+        pass->m_treeletOptimization = true;
+        double treeletGpuTime = m_builder->build(elements);
+        pass->m_treeletOptimization = false;
+        verify(false);
+        double treeletSAHCost = m_builder->downloadSAHCost();
+        std::cout << PRINT_PREFIX << "GPU build with treelet restructuring finished in " << treeletGpuTime << "[ms] (without: " << gpuTime << "[ms]), SAH cost: " << treeletSAHCost << " (without: " << m_buildSAHCost << ")." << std::endl;
+        benchmarkRayQueries("Karras with treelet restructuring");
+
+        // PLOC: build with the alternative algorithm and compare
+        double plocGpuTime = m_builder->build(elements, LBVHPass::PLOC);
+        verify(false);
+        double plocSAHCost = m_builder->downloadSAHCost();
+        std::cout << PRINT_PREFIX << "GPU build with PLOC finished in " << plocGpuTime << "[ms], SAH cost: " << plocSAHCost << "." << std::endl;
+        printStageTimes("PLOC");
+        benchmarkRayQueries("PLOC");
+        benchmarkOverlapQueries("PLOC", elements, plocGpuTime);
+
+        // wide BVH: build with PLOC again and collapse the binary LBVH into a BVH4/BVH8
+        pass->m_wideBVH = true;
+        double wideGpuTime = m_builder->build(elements, LBVHPass::PLOC);
+        pass->m_wideBVH = false;
+        verifyWide(NUM_ELEMENTS);
+        std::cout << PRINT_PREFIX << "GPU build with PLOC and the collapse into a BVH" << WIDE_BVH_WIDTH << " finished in " << wideGpuTime << "[ms] (without: " << plocGpuTime << "[ms])." << std::endl;
+
+        // compressed nodes: build with PLOC again and quantize the child bounds
+        pass->m_compressedNodes = true;
+        double compressedGpuTime = m_builder->build(elements, LBVHPass::PLOC);
+        pass->m_compressedNodes = false;
+        verifyCompressed(NUM_ELEMENTS);
+        std::cout << PRINT_PREFIX << "GPU build with PLOC and the compression (" << COMPRESSED_NODE_BITS << "-bit bounds) finished in " << compressedGpuTime << "[ms] (without: " << plocGpuTime << "[ms])." << std::endl;
+
+        // multi-primitive leaves: build with PLOC again and collapse subtrees into leaves where it reduces the SAH cost
+        pass->m_collapseLeaves = true;
+        double collapsedGpuTime = m_builder->build(elements, LBVHPass::PLOC);
+        pass->m_collapseLeaves = false;
+        verifyCollapsed(NUM_ELEMENTS);
+        std::cout << PRINT_PREFIX << "GPU build with PLOC and the leaf collapse finished in " << collapsedGpuTime << "[ms] (without: " << plocGpuTime << "[ms])." << std::endl;
+
+        // the refits below update the last full build (PLOC)
+        gpuTime = plocGpuTime;
+        m_buildSAHCost = plocSAHCost;
+
+        // refit: move the elements and only update the bounding boxes, the hierarchy of the full build is kept
+        const float maxExtent = std::max(orderedUintToFloat(extent.maxX) - orderedUintToFloat(extent.minX), std::max(orderedUintToFloat(extent.maxY) - orderedUintToFloat(extent.minY), orderedUintToFloat(extent.maxZ) - orderedUintToFloat(extent.minZ)));
+        std::mt19937 generator(42);
+        for (uint32_t frame = 1; frame <= NUM_REFIT_FRAMES; frame++) {
+            moveElements(elements, 0.001f * maxExtent, generator);
+            double refitTime = m_builder->refit(elements);
+            verify(false);
+            double refitSAHCost = m_builder->downloadSAHCost();
+            double degradation = refitSAHCost / m_buildSAHCost;
+            std::cout << PRINT_PREFIX << "Refit " << frame << " finished in " << refitTime << "[ms] (" << gpuTime / refitTime << "x faster than the full build), SAH cost: " << refitSAHCost << " (" << degradation << "x of the full build)." << std::endl;
+            if (degradation > REFIT_MAX_SAH_COST_RATIO) {
+                std::cout << PRINT_PREFIX << "The SAH cost degraded by more than " << REFIT_MAX_SAH_COST_RATIO << "x, a full rebuild is recommended." << std::endl;
+            }
+        }
+
+        // point cloud: build the LBVH over the centroids of the elements (point elements with min == max) and run nearest neighbour queries
+        std::vector<Element> points;
+        generatePointElements(elements, points);
+        double pointsGpuTime = m_builder->build(points);
+        verify(false);
+        std::cout << PRINT_PREFIX << "GPU build of the point cloud (" << NUM_ELEMENTS << " points) finished in " << pointsGpuTime << "[ms]." << std::endl;
+        benchmarkNearestNeighbourQueries(points, AABB({orderedUintToFloat(extent.minX), orderedUintToFloat(extent.minY), orderedUintToFloat(extent.minZ), 0}, {orderedUintToFloat(extent.maxX), orderedUintToFloat(extent.maxY), orderedUintToFloat(extent.maxZ), 0}), 0.01f * maxExtent);
+
+        // sub-allocated buffer memory of all builds and queries (including the staging buffers)
+        m_gpuContext->m_memoryAllocator->printStatistics();
 
         // clean up
         releaseBuffers();
-        m_pass->release();
+        m_builder->release();
+        m_queryPass->release();
     }
 
     void LBVH::releaseBuffers() {
-        m_mortonCodeBuffer->release();
-        m_mortonCodePingPongBuffer->release();
-        m_elementsBuffer->release();
-        m_LBVHBuffer->release();
-        m_LBVHConstructionInfoBuffer->release();
+        m_raysBuffer->release();
+        m_rayHitsBuffer->release();
+        m_overlapPairsBuffer->release();
+        m_overlapStateBuffer->release();
+        m_pointQueriesBuffer->release();
+        m_neighboursBuffer->release();
+        m_knnStateBuffer->release();
+    }
+
+    void LBVH::printStageTimes(const std::string &name) const {
+        if (!m_builder->getPass()->hasTimestamps()) {
+            return;
+        }
+        const auto &stageTimes = m_builder->getStageTimes();
+        std::cout << PRINT_PREFIX << "GPU stage times (" << name << "):";
+        for (uint32_t stage = 0; stage < LBVHPass::NUM_TIMED_STAGES; stage++) {
+            std::cout << (stage > 0 ? "," : "") << " " << LBVHPass::getTimedStageName(static_cast<LBVHPass::TimedStage>(stage)) << " " << stageTimes[stage] << "[ms]";
+        }
+        std::cout << std::endl;
+    }
+
+    double LBVH::executeQueryPass() {
+        std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+        m_queryPass->execute(VK_NULL_HANDLE);
+        vkQueueWaitIdle(m_gpuContext->m_queues->getQueue(Queues::COMPUTE));
+        std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+        return static_cast<double>(std::chrono::duration_cast<std::chrono::microseconds>(end - begin).count()) * std::pow(10, -3);
+    }
+
+    void LBVH::benchmarkRayQueries(const std::string &name) {
+        std::vector<LBVHNode> LBVH;
+        m_builder->downloadLBVH(LBVH);
+        std::vector<RayHit> hits(m_rays.size());
+
+        for (const bool anyHit: {false, true}) {
+            m_queryPass->m_stage = anyHit ? LBVHQueryPass::RAY_ANY_HIT : LBVHQueryPass::RAY_CLOSEST_HIT;
+            double queryTime = executeQueryPass();
+            m_rayHitsBuffer->downloadWithStagingBuffer(hits.data());
+            verifyRayQueries(LBVH, hits, anyHit);
+
+            uint32_t numHits = 0;
+            for (const auto &hit: hits) {
+                numHits += hit.primitiveIdx != INVALID_PRIMITIVE;
+            }
+            std::cout << PRINT_PREFIX << "Ray queries (" << name << ", " << (anyHit ? "any hit" : "closest hit") << "): " << hits.size() << " rays in " << queryTime << "[ms] (" << static_cast<double>(hits.size()) / (queryTime * 1000) << " Mrays/s), " << numHits << " hits." << std::endl;
+        }
+    }
+
+    void LBVH::verifyRayQueries(const std::vector<LBVHNode> &LBVH, const std::vector<RayHit> &hits, bool anyHit) {
+        // a skipped subtree may hide the correct hit of any ray, not only of the verified ones
+        for (uint32_t r = 0; r < hits.size(); r++) {
+            if (hits[r].stackOverflow != 0) {
+                std::cout << PRINT_PREFIX << "Error: Ray " << r << " overflowed the traversal stack (" << m_queryPass->getStackSize() << " entries), the LBVH is too deep for the stack size of the query pass." << std::endl;
+                throw std::runtime_error("TEST FAILED.");
+            }
+        }
+
+        // brute force over all leaves for the first rays
+        const uint32_t numLeaves = (LBVH.size() + 1) / 2;
+        std::vector<uint32_t> leafOfPrimitive(numLeaves);
+        for (uint32_t i = numLeaves - 1; i < LBVH.size(); i++) {
+            leafOfPrimitive[LBVH[i].primitiveIdx] = i;
+        }
+
+        const float EPS = 0.0001;
+        for (uint32_t r = 0; r < std::min(NUM_VERIFIED_RAYS, static_cast<uint32_t>(m_rays.size())); r++) {
+            const Ray &ray = m_rays[r];
+            float tClosest = ray.tMax;
+            bool hit = false;
+            for (uint32_t i = numLeaves - 1; i < LBVH.size(); i++) {
+                float tEntry;
+                if (intersectAABB(ray, LBVH[i], tClosest, tEntry)) {
+                    tClosest = tEntry;
+                    hit = true;
+                }
+            }
+
+            const RayHit &gpuHit = hits[r];
+            if (hit != (gpuHit.primitiveIdx != INVALID_PRIMITIVE)) {
+                std::cout << PRINT_PREFIX << "Error: Ray " << r << " hit (CPU): " << hit << ", hit (GPU): " << (gpuHit.primitiveIdx != INVALID_PRIMITIVE) << "." << std::endl;
+                throw std::runtime_error("TEST FAILED.");
+            }
+            if (!hit) {
+                continue;
+            }
+            // the reported primitive has to be hit at the reported t, in case of closest hit no other primitive may be hit before
+            float tEntry;
+            if (gpuHit.primitiveIdx >= numLeaves || !intersectAABB(ray, LBVH[leafOfPrimitive[gpuHit.primitiveIdx]], ray.tMax, tEntry) || glm::abs(tEntry - gpuHit.t) > EPS * glm::max(1.f, tEntry) || (!anyHit && glm::abs(tClosest - gpuHit.t) > EPS * glm::max(1.f, tClosest))) {
+                std::cout << PRINT_PREFIX << "Error: Ray " << r << " hit primitive " << gpuHit.primitiveIdx << " at t=" << gpuHit.t << " (GPU), closest t=" << tClosest << " (CPU)." << std::endl;
+                throw std::runtime_error("TEST FAILED.");
+            }
+        }
+    }
+
+    void LBVH::benchmarkOverlapQueries(const std::string &name, const std::vector<Element> &elements, double buildTime) {
+        std::vector<OverlapPair> pairs(MAX_OVERLAP_PAIRS);
+        std::vector<std::vector<uint32_t>> verifiedPairs(std::min(NUM_VERIFIED_QUERIES, static_cast<uint32_t>(elements.size())));
+        uint64_t numPairs = 0;
+        uint64_t numOverflowedPairs = 0;
+        uint32_t numExecutions = 0;
+        double queryTime = 0;
+
+        m_queryPass->m_stage = LBVHQueryPass::OVERLAP;
+        uint32_t queryOffset = 0;
+        while (true) {
+            m_queryPass->m_pushConstantsOverlap.g_query_offset = queryOffset;
+            queryTime += executeQueryPass();
+            numExecutions++;
+
+            LBVHOverlapState state{};
+            m_overlapStateBuffer->downloadAsync(&state);
+            m_gpuContext->m_stagingRing->wait(m_overlapPairsBuffer->downloadAsync(pairs.data())); // both downloads in one submit
+            numOverflowedPairs += state.overflowCount;
+            if (state.stackOverflowCount != 0) {
+                std::cout << PRINT_PREFIX << "Error: " << state.stackOverflowCount << " overlap queries overflowed the traversal stack (" << m_queryPass->getStackSize() << " entries), the LBVH is too deep for the stack size of the query pass." << std::endl;
+                throw std::runtime_error("TEST FAILED.");
+            }
+
+            // only the pairs of the queries before resumeQueryIdx are complete, the remaining queries are executed again
+            for (uint32_t i = 0; i < std::min(state.pairCount, MAX_OVERLAP_PAIRS); i++) {
+                const OverlapPair &pair = pairs[i];
+                if (pair.queryIdx >= state.resumeQueryIdx) {
+                    continue;
+                }
+                numPairs++;
+                if (pair.queryIdx < verifiedPairs.size()) {
+                    verifiedPairs[pair.queryIdx].push_back(pair.primitiveIdx);
+                }
+            }
+
+            if (state.resumeQueryIdx == INVALID_QUERY) {
+                break;
+            }
+            if (state.resumeQueryIdx == queryOffset) {
+                throw std::runtime_error("The overlap queries did not make progress, increase the capacity of the pair buffer!");
+            }
+            queryOffset = state.resumeQueryIdx;
+        }
+        m_queryPass->m_pushConstantsOverlap.g_query_offset = 0;
+
+        verifyOverlapQueries(elements, verifiedPairs);
+        std::cout << PRINT_PREFIX << "Overlap queries (" << name << ", self collision): " << numPairs << " pairs in " << queryTime << "[ms] (" << static_cast<double>(numPairs) / (queryTime * 1000) << " Mpairs/s, " << numExecutions << " executions, " << numOverflowedPairs << " overflowed pairs), build: " << buildTime << "[ms]." << std::endl;
+    }
+
+    void LBVH::verifyOverlapQueries(const std::vector<Element> &elements, std::vector<std::vector<uint32_t>> &pairs) {
+        // brute force over all elements for the first queries
+        for (uint32_t q = 0; q < pairs.size(); q++) {
+            const Element &query = elements[q];
+            std::vector<uint32_t> expected;
+            for (const auto &element: elements) {
+                if (query.primitiveIdx < element.primitiveIdx && query.aabbMinX <= element.aabbMaxX && element.aabbMinX <= query.aabbMaxX && query.aabbMinY <= element.aabbMaxY && element.aabbMinY <= query.aabbMaxY && query.aabbMinZ <= element.aabbMaxZ && element.aabbMinZ <= query.aabbMaxZ) {
+                    expected.push_back(element.primitiveIdx);
+                }
+            }
+            std::sort(expected.begin(), expected.end());
+            std::sort(pairs[q].begin(), pairs[q].end());
+            if (expected != pairs[q]) {
+                std::cout << PRINT_PREFIX << "Error: Query " << q << " overlaps " << expected.size() << " primitives (CPU), " << pairs[q].size() << " pairs (GPU)." << std::endl;
+                throw std::runtime_error("TEST FAILED.");
+            }
+        }
+    }
+
+    void LBVH::benchmarkCPUBuilder(const std::vector<Element> &elements, double gpuTime) {
+        const uint32_t maxThreads = std::max(1u, std::thread::hardware_concurrency());
+        std::vector<LBVHNode> cpuLBVH;
+        double singleThreadTime = 0;
+        for (uint32_t numThreads = 1;; numThreads = std::min(2 * numThreads, maxThreads)) {
+            LBVHCPUBuilder builder(numThreads, MORTON_CODES_64);
+            double cpuTime = std::numeric_limits<double>::max();
+            for (uint32_t run = 0; run < NUM_CPU_BUILD_RUNS; run++) {
+                std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+                builder.build(elements, cpuLBVH, ABSOLUTE_POINTERS);
+                std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+                cpuTime = std::min(cpuTime, static_cast<double>(std::chrono::duration_cast<std::chrono::microseconds>(end - begin).count()) * std::pow(10, -3));
+            }
+            if (numThreads == 1) {
+                singleThreadTime = cpuTime;
+            }
+            std::cout << PRINT_PREFIX << "CPU build with " << numThreads << " thread(s) finished in " << cpuTime << "[ms] (" << static_cast<double>(elements.size()) / (cpuTime * 1000) << " Melements/s, " << singleThreadTime / cpuTime << "x speedup, GPU: " << gpuTime << "[ms])." << std::endl;
+
+            if (numThreads == maxThreads) {
+                verifyCPUBuilder(builder, cpuLBVH);
+                break;
+            }
+        }
+    }
+
+    void LBVH::verifyCPUBuilder(const LBVHCPUBuilder &builder, const std::vector<LBVHNode> &cpuLBVH) {
+        std::vector<LBVHNode> cpuLBVHCopy = cpuLBVH;
+        std::vector<bool> visited(cpuLBVHCopy.size(), false);
+        traverse(0, cpuLBVHCopy.data(), visited);
+        if (std::find(visited.begin(), visited.end(), false) != visited.end()) {
+            std::cout << PRINT_PREFIX << "Error: Node of the CPU build not visited." << std::endl;
+            throw std::runtime_error("TEST FAILED.");
+        }
+
+        // compare with the GPU build, the morton codes are computed with the same floating point operations (see LBVHCPUBuilder::quantize), i.e. the results have to be identical
+        const std::vector<uint64_t> &cpuMortonCodes = builder.getSortedMortonCodes();
+        std::vector<uint64_t> gpuMortonCodes(cpuMortonCodes.size());
+        if (MORTON_CODES_64) {
+            std::vector<MortonCodeElement64> mortonCodeElements(cpuMortonCodes.size());
+            m_builder->getMortonCodeBuffer()->downloadWithStagingBuffer(mortonCodeElements.data(), static_cast<uint32_t>(mortonCodeElements.size() * sizeof(MortonCodeElement64)));
+            std::transform(mortonCodeElements.begin(), mortonCodeElements.end(), gpuMortonCodes.begin(), [](const MortonCodeElement64 &e) { return e.mortonCode; });
+        } else {
+            std::vector<MortonCodeElement> mortonCodeElements(cpuMortonCodes.size());
+            m_builder->getMortonCodeBuffer()->downloadWithStagingBuffer(mortonCodeElements.data(), static_cast<uint32_t>(mortonCodeElements.size() * sizeof(MortonCodeElement)));
+            std::transform(mortonCodeElements.begin(), mortonCodeElements.end(), gpuMortonCodes.begin(), [](const MortonCodeElement &e) { return static_cast<uint64_t>(e.mortonCode); });
+        }
+        uint32_t numDifferentMortonCodes = 0;
+        for (uint32_t i = 0; i < cpuMortonCodes.size(); i++) {
+            numDifferentMortonCodes += cpuMortonCodes[i] != gpuMortonCodes[i];
+        }
+        if (numDifferentMortonCodes > 0) {
+            std::cout << PRINT_PREFIX << "Error: " << numDifferentMortonCodes << " morton codes of the CPU build differ from the GPU build." << std::endl;
+        }
+
+        // the nodes are compared in any case, i.e. the topology is verified even if the morton codes already differ
+        std::vector<LBVHNode> gpuLBVH;
+        m_builder->downloadLBVH(gpuLBVH);
+        uint32_t numDifferentNodes = 0;
+        for (uint32_t i = 0; i < cpuLBVH.size(); i++) {
+            const LBVHNode &a = cpuLBVH[i];
+            const LBVHNode &b = gpuLBVH[i];
+            if (a.left != b.left || a.right != b.right || a.primitiveIdx != b.primitiveIdx || a.aabbMinX != b.aabbMinX || a.aabbMinY != b.aabbMinY || a.aabbMinZ != b.aabbMinZ || a.aabbMaxX != b.aabbMaxX || a.aabbMaxY != b.aabbMaxY || a.aabbMaxZ != b.aabbMaxZ) {
+                if (numDifferentNodes == 0) {
+                    std::cout << PRINT_PREFIX << "Error: Node " << i << " of the CPU build differs from the GPU build." << std::endl;
+                }
+                numDifferentNodes++;
+            }
+        }
+        if (numDifferentMortonCodes > 0 || numDifferentNodes > 0) {
+            std::cout << PRINT_PREFIX << "Error: " << numDifferentNodes << " of " << cpuLBVH.size() << " nodes of the CPU build differ from the GPU build." << std::endl;
+            throw std::runtime_error("TEST FAILED.");
+        }
+        std::cout << PRINT_PREFIX << "CPU build verified, identical to the GPU build." << std::endl;
+    }
+
+    void LBVH::benchmarkPersistentBuilder(const std::vector<Element> &elements, double gpuTime) {
+        std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+        LBVHBuilder builder(m_gpuContext, MORTON_CODES_64, ABSOLUTE_POINTERS);
+        builder.create();
+        std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+        const double createTime = static_cast<double>(std::chrono::duration_cast<std::chrono::microseconds>(end - begin).count()) * std::pow(10, -3);
+        std::cout << PRINT_PREFIX << "Persistent builder created in " << createTime << "[ms] (shaders, pipelines and descriptor sets), capacity: " << builder.getCapacity() << " elements." << std::endl;
+
+        // growing number of elements: the buffers are only reallocated if the capacity is exceeded
+        std::vector<LBVHNode> builderLBVH;
+        for (const uint32_t divisor: {4u, 2u, 1u}) {
+            const std::vector<Element> subset(elements.begin(), elements.begin() + std::max<size_t>(2, elements.size() / divisor));
+            double buildTime = builder.build(subset);
+            builder.downloadLBVH(builderLBVH);
+            std::vector<bool> visited(builderLBVH.size(), false);
+            traverse(0, builderLBVH.data(), visited);
+            if (std::find(visited.begin(), visited.end(), false) != visited.end()) {
+                std::cout << PRINT_PREFIX << "Error: Node of the persistent builder not visited." << std::endl;
+                throw std::runtime_error("TEST FAILED.");
+            }
+            std::cout << PRINT_PREFIX << "Persistent build of " << subset.size() << " elements finished in " << buildTime << "[ms], capacity: " << builder.getCapacity() << " elements, " << builder.getNumReallocations() << " reallocation(s)." << std::endl;
+        }
+
+        // rebuilds with the same number of elements: upload and dispatch only
+        const uint32_t numReallocations = builder.getNumReallocations();
+        double rebuildTime = std::numeric_limits<double>::max();
+        for (uint32_t run = 0; run < NUM_PERSISTENT_BUILD_RUNS; run++) {
+            rebuildTime = std::min(rebuildTime, builder.build(elements));
+        }
+        if (builder.getNumReallocations() != numReallocations) {
+            std::cout << PRINT_PREFIX << "Error: The persistent builder reallocated without exceeding the capacity." << std::endl;
+            throw std::runtime_error("TEST FAILED.");
+        }
+
+        // asynchronous builds: two builders are in flight at the same time, the host only blocks when it needs the results
+        LBVHBuilder secondBuilder(m_gpuContext, MORTON_CODES_64, ABSOLUTE_POINTERS);
+        secondBuilder.create(builder.getCapacity());
+        begin = std::chrono::steady_clock::now();
+        const LBVHBuilder::BuildHandle firstBuild = builder.buildAsync(elements);
+        const LBVHBuilder::BuildHandle secondBuild = secondBuilder.buildAsync(elements);
+        builder.wait(firstBuild);
+        secondBuilder.wait(secondBuild);
+        end = std::chrono::steady_clock::now();
+        const double asyncTime = static_cast<double>(std::chrono::duration_cast<std::chrono::microseconds>(end - begin).count()) * std::pow(10, -3);
+        std::cout << PRINT_PREFIX << "Two asynchronous builds of " << elements.size() << " elements in flight finished in " << asyncTime << "[ms]." << std::endl;
+
+        // the Karras build is deterministic, i.e. identical to the first build of the example
+        std::vector<LBVHNode> gpuLBVH;
+        m_builder->downloadLBVH(gpuLBVH);
+        for (LBVHBuilder *persistentBuilder: {&builder, &secondBuilder}) {
+            persistentBuilder->downloadLBVH(builderLBVH);
+            if (std::memcmp(builderLBVH.data(), gpuLBVH.data(), gpuLBVH.size() * sizeof(LBVHNode)) != 0) {
+                std::cout << PRINT_PREFIX << "Error: The persistent build differs from the first build." << std::endl;
+                throw std::runtime_error("TEST FAILED.");
+            }
+        }
+        secondBuilder.release();
+
+        begin = std::chrono::steady_clock::now();
+        builder.release();
+        end = std::chrono::steady_clock::now();
+        const double releaseTime = static_cast<double>(std::chrono::duration_cast<std::chrono::microseconds>(end - begin).count()) * std::pow(10, -3);
+        std::cout << PRINT_PREFIX << "Persistent rebuild of " << elements.size() << " elements finished in " << rebuildTime << "[ms] (create, first build and release: " << createTime + gpuTime + releaseTime << "[ms]), identical to the first build." << std::endl;
+    }
+
+    void LBVH::benchmarkBatchedBuild(const std::vector<Element> &elements) {
+        // segments of random sizes (including single elements), e.g. the meshes of a scene
+        std::mt19937 generator(17);
+        std::uniform_int_distribution<uint32_t> segmentSize(1, 2 * BATCH_SEGMENT_ELEMENTS - 1);
+        std::vector<LBVHSegment> segments;
+        for (uint32_t elementOffset = 0; elementOffset < elements.size();) {
+            const uint32_t numElements = std::min(segmentSize(generator), static_cast<uint32_t>(elements.size()) - elementOffset);
+            segments.push_back({elementOffset, numElements, 0});
+            elementOffset += numElements;
+        }
+
+        LBVHBuilder builder(m_gpuContext, MORTON_CODES_64, ABSOLUTE_POINTERS);
+        builder.create(static_cast<uint32_t>(elements.size()));
+        double batchTime = std::numeric_limits<double>::max();
+        for (uint32_t run = 0; run < NUM_PERSISTENT_BUILD_RUNS; run++) {
+            batchTime = std::min(batchTime, builder.buildBatch(elements, segments));
+        }
+        double batchGpuTime = 0;
+        for (const double stageTime: builder.getStageTimes()) {
+            batchGpuTime += stageTime;
+        }
+
+        // every segment has its own LBVH over exactly its elements
+        std::vector<LBVHNode> batchLBVHs;
+        builder.downloadLBVH(batchLBVHs);
+        std::vector<uint32_t> leafPrimitives;
+        std::vector<uint32_t> segmentPrimitives;
+        for (const auto &segment: segments) {
+            const uint32_t numNodes = 2 * segment.numElements - 1;
+            if (segment.nodeOffset + numNodes > batchLBVHs.size()) {
+                std::cout << PRINT_PREFIX << "Error: LBVH of the segment at element " << segment.elementOffset << " exceeds the batch." << std::endl;
+                throw std::runtime_error("TEST FAILED.");
+            }
+            std::vector<bool> visited(numNodes, false);
+            traverse(0, batchLBVHs.data() + segment.nodeOffset, visited);
+            if (std::find(visited.begin(), visited.end(), false) != visited.end()) {
+                std::cout << PRINT_PREFIX << "Error: Node of the LBVH of the segment at element " << segment.elementOffset << " not visited." << std::endl;
+                throw std::runtime_error("TEST FAILED.");
+            }
+            leafPrimitives.clear();
+            segmentPrimitives.clear();
+            for (uint32_t i = 0; i < segment.numElements; i++) {
+                leafPrimitives.push_back(batchLBVHs[segment.nodeOffset + segment.numElements - 1 + i].primitiveIdx);
+                segmentPrimitives.push_back(elements[segment.elementOffset + i].primitiveIdx);
+            }
+            std::sort(leafPrimitives.begin(), leafPrimitives.end());
+            std::sort(segmentPrimitives.begin(), segmentPrimitives.end());
+            if (leafPrimitives != segmentPrimitives) {
+                std::cout << PRINT_PREFIX << "Error: The leaves of the LBVH of the segment at element " << segment.elementOffset << " differ from the elements of the segment." << std::endl;
+                throw std::runtime_error("TEST FAILED.");
+            }
+        }
+
+        // reference: one build per segment with the same builder (single element segments do not need a build)
+        std::vector<Element> segmentElements;
+        std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+        for (const auto &segment: segments) {
+            if (segment.numElements > 1) {
+                segmentElements.assign(elements.begin() + segment.elementOffset, elements.begin() + segment.elementOffset + segment.numElements);
+                builder.build(segmentElements);
+            }
+        }
+        std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+        const double sequentialTime = static_cast<double>(std::chrono::duration_cast<std::chrono::microseconds>(end - begin).count()) * std::pow(10, -3);
+
+        // the per segment builds have to match the LBVHs of the batch: same root aabb and same leaf primitives (the topology may differ, the batch quantizes the morton codes relative to the extent of the segment with fewer bits)
+        std::vector<LBVHNode> segmentLBVH;
+        for (const auto &segment: segments) {
+            if (segment.numElements > 1) {
+                segmentElements.assign(elements.begin() + segment.elementOffset, elements.begin() + segment.elementOffset + segment.numElements);
+                builder.build(segmentElements);
+                builder.downloadLBVH(segmentLBVH);
+            } else {
+                const Element &element = elements[segment.elementOffset];
+                segmentLBVH = {{INVALID_POINTER, INVALID_POINTER, element.primitiveIdx, element.aabbMinX, element.aabbMinY, element.aabbMinZ, element.aabbMaxX, element.aabbMaxY, element.aabbMaxZ}};
+            }
+            const LBVHNode &a = segmentLBVH[0];
+            const LBVHNode &b = batchLBVHs[segment.nodeOffset];
+            if (a.aabbMinX != b.aabbMinX || a.aabbMinY != b.aabbMinY || a.aabbMinZ != b.aabbMinZ || a.aabbMaxX != b.aabbMaxX || a.aabbMaxY != b.aabbMaxY || a.aabbMaxZ != b.aabbMaxZ) {
+                std::cout << PRINT_PREFIX << "Error: The root AABB of the LBVH of the segment at element " << segment.elementOffset << " differs between the batched and the single build." << std::endl;
+                throw std::runtime_error("TEST FAILED.");
+            }
+            leafPrimitives.clear();
+            segmentPrimitives.clear();
+            for (uint32_t i = 0; i < segment.numElements; i++) {
+                leafPrimitives.push_back(batchLBVHs[segment.nodeOffset + segment.numElements - 1 + i].primitiveIdx);
+                segmentPrimitives.push_back(segmentLBVH[segment.numElements - 1 + i].primitiveIdx);
+            }
+            std::sort(leafPrimitives.begin(), leafPrimitives.end());
+            std::sort(segmentPrimitives.begin(), segmentPrimitives.end());
+            if (leafPrimitives != segmentPrimitives) {
+                std::cout << PRINT_PREFIX << "Error: The leaves of the LBVH of the segment at element " << segment.elementOffset << " differ between the batched and the single build." << std::endl;
+                throw std::runtime_error("TEST FAILED.");
+            }
+        }
+        builder.release();
+
+        std::cout << PRINT_PREFIX << "Batched build of " << segments.size() << " LBVHs (" << elements.size() << " elements) finished in " << batchTime << "[ms] (GPU: " << batchGpuTime << "[ms]), sequential builds: " << sequentialTime << "[ms], speedup: " << sequentialTime / batchTime << "x, verified against the single builds." << std::endl;
+    }
+
+    void LBVH::benchmarkInstancedScene(const std::vector<Element> &elements) {
+        // meshes: consecutive chunks of the elements centered at their origin, the primitive ids are the indices within the mesh
+        const uint32_t meshElements = std::max(1u, std::min(INSTANCE_MESH_ELEMENTS, static_cast<uint32_t>(elements.size()) / NUM_INSTANCE_MESHES));
+        std::vector<std::vector<Element>> meshes(NUM_INSTANCE_MESHES);
+        float meshSize = 0;
+        uint32_t numMeshElements = 0;
+        for (uint32_t meshIdx = 0; meshIdx < NUM_INSTANCE_MESHES; meshIdx++) {
+            std::vector<Element> &mesh = meshes[meshIdx];
+            const uint32_t elementOffset = (meshIdx * meshElements) % static_cast<uint32_t>(elements.size());
+            mesh.assign(elements.begin() + elementOffset, elements.begin() + std::min(elementOffset + meshElements, static_cast<uint32_t>(elements.size())));
+            AABB aabb;
+            for (const auto &element: mesh) {
+                aabb.expand({element.aabbMinX, element.aabbMinY, element.aabbMinZ});
+                aabb.expand({element.aabbMaxX, element.aabbMaxY, element.aabbMaxZ});
+            }
+            const glm::vec3 center = glm::vec3(aabb.min + aabb.max) * 0.5f;
+            for (uint32_t i = 0; i < mesh.size(); i++) {
+                Element &element = mesh[i];
+                element = {i, element.aabbMinX - center.x, element.aabbMinY - center.y, element.aabbMinZ - center.z, element.aabbMaxX - center.x, element.aabbMaxY - center.y, element.aabbMaxZ - center.z};
+            }
+            meshSize = std::max(meshSize, glm::length(glm::vec3(aabb.max - aabb.min)));
+            numMeshElements += mesh.size();
+        }
+
+        // instances: random meshes with a random rotation (unit quaternion), uniform scale and position within a cube that leaves space between the instances
+        std::mt19937 generator(23);
+        std::uniform_int_distribution<uint32_t> meshDistribution(0, NUM_INSTANCE_MESHES - 1);
+        std::uniform_real_distribution<float> distribution(0.f, 1.f);
+        std::normal_distribution<float> normalDistribution;
+        const float sceneSize = 2.f * meshSize * std::cbrt(static_cast<float>(NUM_INSTANCES));
+        std::vector<LBVHTwoLevelBuilder::Instance> instances(NUM_INSTANCES);
+        for (auto &instance: instances) {
+            const glm::vec4 q = glm::normalize(glm::vec4(normalDistribution(generator), normalDistribution(generator), normalDistribution(generator), normalDistribution(generator)));
+            const float rotation[3][3] = {{1 - 2 * (q.y * q.y + q.z * q.z), 2 * (q.x * q.y - q.w * q.z), 2 * (q.x * q.z + q.w * q.y)},
+                                          {2 * (q.x * q.y + q.w * q.z), 1 - 2 * (q.x * q.x + q.z * q.z), 2 * (q.y * q.z - q.w * q.x)},
+                                          {2 * (q.x * q.z - q.w * q.y), 2 * (q.y * q.z + q.w * q.x), 1 - 2 * (q.x * q.x + q.y * q.y)}};
+            const float scale = 0.5f + distribution(generator);
+            for (uint32_t row = 0; row < 3; row++) {
+                for (uint32_t column = 0; column < 3; column++) {
+                    instance.transform[4 * row + column] = scale * rotation[row][column];
+                }
+                instance.transform[4 * row + 3] = sceneSize * distribution(generator);
+            }
+            instance.meshIdx = meshDistribution(generator);
+        }
+
+        LBVHTwoLevelBuilder builder(m_gpuContext, MORTON_CODES_64, ABSOLUTE_POINTERS);
+        builder.create(NUM_INSTANCES);
+        const double meshesTime = builder.buildMeshes(meshes);
+
+        // moving instances: only the TLAS is rebuilt, the BLAS of the meshes are reused
+        double instancesTime = builder.buildInstances(instances);
+        double minInstancesTime = instancesTime;
+        for (uint32_t frame = 1; frame <= NUM_INSTANCE_FRAMES; frame++) {
+            for (auto &instance: instances) {
+                for (uint32_t row = 0; row < 3; row++) {
+                    instance.transform[4 * row + 3] += 0.01f * meshSize * normalDistribution(generator);
+                }
+            }
+            instancesTime = builder.buildInstances(instances);
+            minInstancesTime = std::min(minInstancesTime, instancesTime);
+        }
+        double instancesGpuTime = 0;
+        for (const double stageTime: builder.getTLASBuilder().getStageTimes()) {
+            instancesGpuTime += stageTime;
+        }
+
+        // the TLAS bounds all instances, its leaves are the instances
+        std::vector<LBVHNode> tlas;
+        builder.downloadTLAS(tlas);
+        std::vector<bool> visited(tlas.size(), false);
+        traverse(0, tlas.data(), visited);
+        std::vector<uint32_t> leafInstances;
+        for (uint32_t i = NUM_INSTANCES - 1; i < tlas.size(); i++) {
+            leafInstances.push_back(tlas[i].primitiveIdx);
+        }
+        std::sort(leafInstances.begin(), leafInstances.end());
+        for (uint32_t i = 0; i < leafInstances.size(); i++) {
+            if (leafInstances[i] != i || !visited[NUM_INSTANCES - 1 + i]) {
+                std::cout << PRINT_PREFIX << "Error: Instance " << i << " is not a leaf of the TLAS." << std::endl;
+                throw std::runtime_error("TEST FAILED.");
+            }
+        }
+
+        // ray queries against the instanced scene
+        std::vector<Ray> rays;
+        std::mt19937 rayGenerator(29);
+        generateRays(rays, AABB({tlas[0].aabbMinX, tlas[0].aabbMinY, tlas[0].aabbMinZ, 0}, {tlas[0].aabbMaxX, tlas[0].aabbMaxY, tlas[0].aabbMaxZ, 0}), rayGenerator);
+        auto settingsRays = Buffer::BufferSettings{.m_sizeBytes = static_cast<uint32_t>(rays.size() * sizeof(Ray)), .m_bufferUsages = VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, .m_memoryProperties = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, .m_name = "lbvh.instanceRaysBuffer"};
+        auto raysBuffer = std::make_shared<Buffer>(m_gpuContext, settingsRays);
+        raysBuffer->uploadWithStagingBuffer(rays.data());
+        auto settingsHits = Buffer::BufferSettings{.m_sizeBytes = static_cast<uint32_t>(rays.size() * sizeof(InstanceRayHit)), .m_bufferUsages = VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, .m_memoryProperties = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, .m_name = "lbvh.instanceRayHitsBuffer"};
+        auto hitsBuffer = std::make_shared<Buffer>(m_gpuContext, settingsHits);
+
+        // the stack is shared by the top-level and the bottom-level traversal, i.e. it has to cover the TLAS and the deepest mesh
+        uint32_t maxLeafDepth = m_qualityAnalyzer->analyze(tlas, ABSOLUTE_POINTERS).maxLeafDepth;
+        std::vector<LBVHNode> blas;
+        builder.downloadBLAS(blas);
+        for (const LBVHSegment &mesh: builder.getMeshes()) {
+            const std::vector<LBVHNode> meshLBVH(blas.begin() + mesh.nodeOffset, blas.begin() + mesh.nodeOffset + 2 * mesh.numElements - 1);
+            maxLeafDepth = std::max(maxLeafDepth, m_qualityAnalyzer->analyze(meshLBVH, ABSOLUTE_POINTERS).maxLeafDepth);
+        }
+        reserveQueryStack(maxLeafDepth);
+
+        m_queryPass->setStorageBuffer(3, 0, builder.getTLASBuffer());
+        m_queryPass->setStorageBuffer(3, 1, builder.getBLASBuffer());
+        m_queryPass->setStorageBuffer(3, 2, builder.getInstancesBuffer());
+        m_queryPass->setStorageBuffer(3, 3, raysBuffer.get());
+        m_queryPass->setStorageBuffer(3, 4, hitsBuffer.get());
+        m_queryPass->setGlobalInvocationSize(LBVHQueryPass::INSTANCE_RAY_CLOSEST_HIT, rays.size(), 1, 1);
+        m_queryPass->setGlobalInvocationSize(LBVHQueryPass::INSTANCE_RAY_ANY_HIT, rays.size(), 1, 1);
+        m_queryPass->m_pushConstantsInstanceRayQuery.g_num_rays = rays.size();
+        m_queryPass->m_pushConstantsInstanceRayQuery.g_absolute_pointers = ABSOLUTE_POINTERS;
+
+        std::vector<InstanceRayHit> hits(rays.size());
+        for (const bool anyHit: {false, true}) {
+            m_queryPass->m_stage = anyHit ? LBVHQueryPass::INSTANCE_RAY_ANY_HIT : LBVHQueryPass::INSTANCE_RAY_CLOSEST_HIT;
+            double queryTime = executeQueryPass();
+            hitsBuffer->downloadWithStagingBuffer(hits.data());
+            verifyInstanceRayQueries(builder, meshes, rays, hits, anyHit);
+
+            uint32_t numHits = 0;
+            for (const auto &hit: hits) {
+                numHits += hit.instanceIdx != INVALID_PRIMITIVE;
+            }
+            std::cout << PRINT_PREFIX << "Instance ray queries (" << (anyHit ? "any hit" : "closest hit") << "): " << hits.size() << " rays in " << queryTime << "[ms] (" << static_cast<double>(hits.size()) / (queryTime * 1000) << " Mrays/s), " << numHits << " hits." << std::endl;
+        }
+        m_queryPass->m_stage = LBVHQueryPass::RAY_CLOSEST_HIT;
+
+        // a single LBVH over the transformed elements of all instances would have to be rebuilt (and stored) for all of them
+        const uint64_t numInstanceElements = static_cast<uint64_t>(NUM_INSTANCES) * (numMeshElements / NUM_INSTANCE_MESHES);
+        std::cout << PRINT_PREFIX << "Instanced scene: " << NUM_INSTANCE_MESHES << " meshes (" << numMeshElements << " elements) built in " << meshesTime << "[ms], BLAS memory: " << builder.getBLASMemoryBytes() / 1024 << "[KB]." << std::endl;
+        std::cout << PRINT_PREFIX << "Instanced scene: TLAS over " << NUM_INSTANCES << " instances rebuilt in " << minInstancesTime << "[ms] (GPU: " << instancesGpuTime << "[ms]), TLAS memory: " << builder.getTLASMemoryBytes() / 1024 << "[KB], a flat LBVH over the ~" << numInstanceElements << " instanced elements would have " << 2 * numInstanceElements - 1 << " nodes (" << (2 * numInstanceElements - 1) * sizeof(LBVHNode) / 1024 << "[KB])." << std::endl;
+
+        raysBuffer->release();
+        hitsBuffer->release();
+        builder.release();
+    }
+
+    void LBVH::benchmarkMortonCodeWidths(uint32_t numElements) {
+        std::vector<Element> elements;
+        std::mt19937 generator(23);
+        generateDenseElements(elements, std::max(numElements, 2u), generator);
+
+        VkPhysicalDeviceFeatures2 deviceFeatures{.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2};
+        vkGetPhysicalDeviceFeatures2(m_gpuContext->m_physicalDevice, &deviceFeatures);
+        std::vector<bool> mortonCodes64 = {false};
+        if (deviceFeatures.features.shaderInt64) {
+            mortonCodes64.push_back(true);
+        } else {
+            std::cout << PRINT_PREFIX << "The device does not support shaderInt64, the dense input is only built with 30-bit morton codes." << std::endl;
+        }
+
+        // the builders differ only in the morton code width, i.e. the differences of the LBVHs are caused by the duplicate codes
+        std::vector<LBVHQualityAnalyzer::Report> reports;
+        std::vector<double> buildTimes;
+        std::vector<LBVHNode> LBVH;
+        for (const bool codes64: mortonCodes64) {
+            LBVHBuilder builder(m_gpuContext, codes64, ABSOLUTE_POINTERS);
+            builder.create(static_cast<uint32_t>(elements.size()));
+            buildTimes.push_back(builder.build(elements));
+            builder.downloadLBVH(LBVH);
+            builder.release();
+
+            std::vector<bool> visited(LBVH.size(), false);
+            traverse(0, LBVH.data(), visited);
+            if (std::find(visited.begin(), visited.end(), false) != visited.end()) {
+                std::cout << PRINT_PREFIX << "Error: Node of the " << (codes64 ? "63" : "30") << "-bit build of the dense input not visited." << std::endl;
+                throw std::runtime_error("TEST FAILED.");
+            }
+            reports.push_back(m_qualityAnalyzer->analyze(LBVH, ABSOLUTE_POINTERS));
+        }
+
+        // side by side: 30-bit / 63-bit
+        std::cout << PRINT_PREFIX << "Dense input (" << elements.size() << " elements, cluster of " << DENSE_CLUSTER_SIZE << " of the extent) with 30-bit" << (reports.size() > 1 ? " / 63-bit" : "") << " morton codes:" << std::endl;
+        auto printValues = [&](const char *name, auto getValue) {
+            std::cout << PRINT_PREFIX << name << ": " << getValue(0);
+            if (reports.size() > 1) {
+                std::cout << " / " << getValue(1);
+            }
+            std::cout << std::endl;
+        };
+        printValues("Build time [ms]", [&](size_t i) { return buildTimes[i]; });
+        printValues("Max leaf depth", [&](size_t i) { return reports[i].maxLeafDepth; });
+        printValues("Average leaf depth", [&](size_t i) { return reports[i].averageLeafDepth; });
+        printValues("SAH cost", [&](size_t i) { return reports[i].sahCost; });
     }
 
-    void LBVH::verify(uint numLBVHElements) {
-        std::vector<LBVHNode> LBVH(numLBVHElements);
-        m_LBVHBuffer->downloadWithStagingBuffer(LBVH.data());
+    void LBVH::verifyInstanceRayQueries(const LBVHTwoLevelBuilder &builder, const std::vector<std::vector<Element>> &meshes, const std::vector<Ray> &rays, const std::vector<InstanceRayHit> &hits, bool anyHit) {
+        // a skipped subtree of either level may hide the correct hit of any ray, not only of the verified ones
+        for (uint32_t r = 0; r < hits.size(); r++) {
+            if (hits[r].stackOverflow != 0) {
+                std::cout << PRINT_PREFIX << "Error: Instance ray " << r << " overflowed the traversal stack, the TLAS or a BLAS is too deep for the stack size of the query pass." << std::endl;
+                throw std::runtime_error("TEST FAILED.");
+            }
+        }
 
-        std::cout << PRINT_PREFIX << "Writing LBVH to file (lbvh.csv)..." << std::endl;
+        // brute force over all elements of all instances for the first rays, the instances are culled with the aabb of their mesh in object space
+        const auto elementNode = [](const Element &element) {
+            return LBVHNode{INVALID_POINTER, INVALID_POINTER, element.primitiveIdx, element.aabbMinX, element.aabbMinY, element.aabbMinZ, element.aabbMaxX, element.aabbMaxY, element.aabbMaxZ};
+        };
+        std::vector<LBVHNode> meshAABBs(meshes.size());
+        for (uint32_t meshIdx = 0; meshIdx < meshes.size(); meshIdx++) {
+            LBVHNode &aabb = meshAABBs[meshIdx];
+            aabb = elementNode(meshes[meshIdx][0]);
+            for (const auto &element: meshes[meshIdx]) {
+                aabb = {INVALID_POINTER, INVALID_POINTER, 0, std::min(aabb.aabbMinX, element.aabbMinX), std::min(aabb.aabbMinY, element.aabbMinY), std::min(aabb.aabbMinZ, element.aabbMinZ), std::max(aabb.aabbMaxX, element.aabbMaxX), std::max(aabb.aabbMaxY, element.aabbMaxY), std::max(aabb.aabbMaxZ, element.aabbMaxZ)};
+            }
+        }
 
-        std::ofstream myfile;
-        myfile.open("lbvh.csv");
-        myfile << "left right primitiveIdx aabb_min_x aabb_min_y aabb_min_z aabb_max_x aabb_max_y aabb_max_z\n";
-        for (uint32_t i = 0; i < numLBVHElements; i++) {
-            myfile << LBVH[i].left << " "
-                   << LBVH[i].right << " "
-                   << LBVH[i].primitiveIdx << " "
-                   << LBVH[i].aabbMinX << " "
-                   << LBVH[i].aabbMinY << " "
-                   << LBVH[i].aabbMinZ << " "
-                   << LBVH[i].aabbMaxX << " "
-                   << LBVH[i].aabbMaxY << " "
-                   << LBVH[i].aabbMaxZ << "\n";
+        const std::vector<LBVHInstance> &instances = builder.getInstances();
+        const float EPS = 0.0001;
+        for (uint32_t r = 0; r < std::min(NUM_VERIFIED_RAYS, static_cast<uint32_t>(rays.size())); r++) {
+            float tClosest = rays[r].tMax;
+            bool hit = false;
+            for (const auto &instance: instances) {
+                const Ray objectRay = LBVHTwoLevelBuilder::transformRay(instance, rays[r]);
+                float tEntry;
+                if (!intersectAABB(objectRay, meshAABBs[instance.meshIdx], tClosest, tEntry)) {
+                    continue;
+                }
+                for (const auto &element: meshes[instance.meshIdx]) {
+                    if (intersectAABB(objectRay, elementNode(element), tClosest, tEntry)) {
+                        tClosest = tEntry;
+                        hit = true;
+                    }
+                }
+            }
+
+            const InstanceRayHit &gpuHit = hits[r];
+            if (hit != (gpuHit.instanceIdx != INVALID_PRIMITIVE)) {
+                std::cout << PRINT_PREFIX << "Error: Instance ray " << r << " hit (CPU): " << hit << ", hit (GPU): " << (gpuHit.instanceIdx != INVALID_PRIMITIVE) << "." << std::endl;
+                throw std::runtime_error("TEST FAILED.");
+            }
+            if (!hit) {
+                continue;
+            }
+            // the reported primitive of the reported instance has to be hit at the reported t, in case of closest hit no other primitive may be hit before
+            float tEntry;
+            if (gpuHit.instanceIdx >= instances.size() || gpuHit.primitiveIdx >= meshes[instances[gpuHit.instanceIdx].meshIdx].size() ||
+                !intersectAABB(LBVHTwoLevelBuilder::transformRay(instances[gpuHit.instanceIdx], rays[r]), elementNode(meshes[instances[gpuHit.instanceIdx].meshIdx][gpuHit.primitiveIdx]), rays[r].tMax, tEntry) ||
+                glm::abs(tEntry - gpuHit.t) > EPS * glm::max(1.f, tEntry) || (!anyHit && glm::abs(tClosest - gpuHit.t) > EPS * glm::max(1.f, tClosest))) {
+                std::cout << PRINT_PREFIX << "Error: Instance ray " << r << " hit primitive " << gpuHit.primitiveIdx << " of instance " << gpuHit.instanceIdx << " at t=" << gpuHit.t << " (GPU), closest t=" << tClosest << " (CPU)." << std::endl;
+                throw std::runtime_error("TEST FAILED.");
+            }
         }
-        myfile.close();
+    }
+
+    void LBVH::benchmarkNearestNeighbourQueries(const std::vector<Element> &points, const AABB &extent, float radius) {
+        std::mt19937 generator(13);
+        std::vector<PointQuery> queries;
+        std::vector<Neighbour> neighbours(NUM_KNN_QUERIES * KNN_K);
 
-        std::cout << PRINT_PREFIX << "Writing successful." << std::endl;
+        m_queryPass->m_stage = LBVHQueryPass::KNN;
+        for (const bool radiusSearch: {false, true}) {
+            generatePointQueries(queries, extent, radiusSearch ? radius : std::numeric_limits<float>::infinity(), generator);
+            m_pointQueriesBuffer->uploadWithStagingBuffer(queries.data());
+            double queryTime = executeQueryPass();
+            LBVHKNNState state{};
+            m_knnStateBuffer->downloadAsync(&state);
+            m_gpuContext->m_stagingRing->wait(m_neighboursBuffer->downloadAsync(neighbours.data())); // both downloads in one submit
+            if (state.stackOverflowCount != 0) {
+                std::cout << PRINT_PREFIX << "Error: " << state.stackOverflowCount << " nearest neighbour queries overflowed the traversal stack (" << m_queryPass->getStackSize() << " entries), the LBVH is too deep for the stack size of the query pass." << std::endl;
+                throw std::runtime_error("TEST FAILED.");
+            }
+            verifyNearestNeighbourQueries(points, queries, neighbours);
+
+            uint64_t numNeighbours = 0;
+            for (const auto &neighbour: neighbours) {
+                numNeighbours += neighbour.primitiveIdx != INVALID_PRIMITIVE;
+            }
+            std::cout << PRINT_PREFIX << "Nearest neighbour queries (" << (radiusSearch ? "radius search" : "k nearest neighbours") << ", k=" << KNN_K << "): " << queries.size() << " queries in " << queryTime << "[ms] (" << static_cast<double>(queries.size()) / (queryTime * 1000) << " Mqueries/s), " << numNeighbours << " neighbours." << std::endl;
+        }
+    }
+
+    void LBVH::verifyNearestNeighbourQueries(const std::vector<Element> &points, const std::vector<PointQuery> &queries, const std::vector<Neighbour> &neighbours) {
+        std::vector<float> primitiveDistanceSquared(points.size());
+        std::vector<float> distancesSquared;
+        for (uint32_t q = 0; q < std::min(NUM_VERIFIED_KNN_QUERIES, static_cast<uint32_t>(queries.size())); q++) {
+            // brute force over all points, the KNN_K smallest distances within maxDistance
+            const PointQuery &query = queries[q];
+            const float maxDistanceSquared = query.maxDistance * query.maxDistance;
+            distancesSquared.clear();
+            for (const auto &point: points) {
+                const float dx = point.aabbMinX - query.x;
+                const float dy = point.aabbMinY - query.y;
+                const float dz = point.aabbMinZ - query.z;
+                const float d = dx * dx + dy * dy + dz * dz;
+                primitiveDistanceSquared[point.primitiveIdx] = d;
+                if (d <= maxDistanceSquared) {
+                    distancesSquared.push_back(d);
+                }
+            }
+            const uint32_t numExpected = std::min(KNN_K, static_cast<uint32_t>(distancesSquared.size()));
+            std::partial_sort(distancesSquared.begin(), distancesSquared.begin() + numExpected, distancesSquared.end());
+
+            // the distances have to match, the primitives may differ in case of equal distances
+            const float EPS = 0.0001;
+            for (uint32_t i = 0; i < KNN_K; i++) {
+                const Neighbour &neighbour = neighbours[q * KNN_K + i];
+                const bool valid = neighbour.primitiveIdx != INVALID_PRIMITIVE;
+                if (valid != (i < numExpected) || (valid && (neighbour.primitiveIdx >= points.size() || glm::abs(neighbour.distanceSquared - distancesSquared[i]) > EPS * glm::max(1.f, distancesSquared[i]) || glm::abs(primitiveDistanceSquared[neighbour.primitiveIdx] - neighbour.distanceSquared) > EPS * glm::max(1.f, neighbour.distanceSquared)))) {
+                    std::cout << PRINT_PREFIX << "Error: Query " << q << " neighbour " << i << " is primitive " << neighbour.primitiveIdx << " with squared distance " << neighbour.distanceSquared << " (GPU), expected squared distance: " << (i < numExpected ? distancesSquared[i] : -1.f) << " (CPU)." << std::endl;
+                    throw std::runtime_error("TEST FAILED.");
+                }
+            }
+        }
+    }
+
+    bool LBVH::intersectAABB(const Ray &ray, const LBVHNode &node, float tMax, float &tEntry) {
+        // slab test as in lbvh_ray_query.comp
+        const glm::vec3 origin(ray.originX, ray.originY, ray.originZ);
+        const glm::vec3 invDirection = glm::vec3(1.f) / glm::vec3(ray.directionX, ray.directionY, ray.directionZ);
+        const glm::vec3 t0 = (glm::vec3(node.aabbMinX, node.aabbMinY, node.aabbMinZ) - origin) * invDirection;
+        const glm::vec3 t1 = (glm::vec3(node.aabbMaxX, node.aabbMaxY, node.aabbMaxZ) - origin) * invDirection;
+        const glm::vec3 tNear = glm::min(t0, t1);
+        const glm::vec3 tFar = glm::max(t0, t1);
+        tEntry = glm::max(glm::max(tNear.x, tNear.y), glm::max(tNear.z, ray.tMin));
+        const float tExit = glm::min(glm::min(tFar.x, tFar.y), glm::min(tFar.z, tMax));
+        return tEntry <= tExit;
+    }
+
+    void LBVH::generatePointElements(const std::vector<Element> &elements, std::vector<Element> &points) {
+        // point elements: min == max
+        points.resize(elements.size());
+        for (uint32_t i = 0; i < elements.size(); i++) {
+            const Element &element = elements[i];
+            const float x = 0.5f * (element.aabbMinX + element.aabbMaxX);
+            const float y = 0.5f * (element.aabbMinY + element.aabbMaxY);
+            const float z = 0.5f * (element.aabbMinZ + element.aabbMaxZ);
+            points[i] = {element.primitiveIdx, x, y, z, x, y, z};
+        }
+    }
+
+    void LBVH::generatePointQueries(std::vector<PointQuery> &queries, const AABB &extent, float maxDistance, std::mt19937 &generator) {
+        std::uniform_real_distribution<float> distribution(0.f, 1.f);
+        queries.resize(NUM_KNN_QUERIES);
+        for (auto &query: queries) {
+            const glm::vec3 point = glm::vec3(extent.min) + glm::vec3(distribution(generator), distribution(generator), distribution(generator)) * glm::vec3(extent.max - extent.min);
+            query = {point.x, point.y, point.z, maxDistance};
+        }
+    }
+
+    void LBVH::generateRays(std::vector<Ray> &rays, const AABB &extent, std::mt19937 &generator) {
+        const glm::vec3 center = glm::vec3(extent.min + extent.max) * 0.5f;
+        const float radius = glm::length(glm::vec3(extent.max - extent.min));
+        std::uniform_real_distribution<float> distribution(0.f, 1.f);
+        std::normal_distribution<float> normalDistribution;
+
+        rays.resize(NUM_RAYS);
+        for (auto &ray: rays) {
+            // origin on a sphere around the model, target within the extent
+            const glm::vec3 origin = center + radius * glm::normalize(glm::vec3(normalDistribution(generator), normalDistribution(generator), normalDistribution(generator)));
+            const glm::vec3 target = glm::vec3(extent.min) + glm::vec3(distribution(generator), distribution(generator), distribution(generator)) * glm::vec3(extent.max - extent.min);
+            const glm::vec3 direction = glm::normalize(target - origin);
+            ray = {origin.x, origin.y, origin.z, 0.f, direction.x, direction.y, direction.z, std::numeric_limits<float>::max()};
+        }
+    }
+
+    void LBVH::moveElements(std::vector<Element> &elements, float maxDistance, std::mt19937 &generator) {
+        // every element is moved independently, i.e. the morton order of the last full build becomes worse with every frame
+        std::uniform_real_distribution<float> distribution(-maxDistance, maxDistance);
+        for (auto &element: elements) {
+            glm::vec3 translation(distribution(generator), distribution(generator), distribution(generator));
+            element.aabbMinX += translation.x;
+            element.aabbMinY += translation.y;
+            element.aabbMinZ += translation.z;
+            element.aabbMaxX += translation.x;
+            element.aabbMaxY += translation.y;
+            element.aabbMaxZ += translation.z;
+        }
+    }
+
+    void LBVH::generateDenseElements(std::vector<Element> &elements, uint32_t numElements, std::mt19937 &generator) {
+        // the centroids of the cluster share a few cells of the 30-bit codes (duplicate codes), the 63-bit codes still separate most of them
+        std::uniform_real_distribution<float> distribution(0.5f - 0.5f * DENSE_CLUSTER_SIZE, 0.5f + 0.5f * DENSE_CLUSTER_SIZE);
+        const float halfSize = 1e-3f * DENSE_CLUSTER_SIZE;
+        elements.resize(numElements);
+        elements[0] = {0, 0.f, 0.f, 0.f, 0.f, 0.f, 0.f};
+        elements[1] = {1, 1.f, 1.f, 1.f, 1.f, 1.f, 1.f};
+        for (uint32_t i = 2; i < numElements; i++) {
+            glm::vec3 centroid(distribution(generator), distribution(generator), distribution(generator));
+            elements[i] = {i, centroid.x - halfSize, centroid.y - halfSize, centroid.z - halfSize, centroid.x + halfSize, centroid.y + halfSize, centroid.z + halfSize};
+        }
+    }
+
+    void LBVH::verify(bool writeFile) {
+        std::vector<LBVHNode> LBVH;
+        m_builder->downloadLBVH(LBVH);
+
+        if (writeFile) {
+            std::cout << PRINT_PREFIX << "Writing LBVH to file (lbvh.csv)..." << std::endl;
+
+            std::ofstream myfile;
+            myfile.open("lbvh.csv");
+            myfile << "left right primitiveIdx aabb_min_x aabb_min_y aabb_min_z aabb_max_x aabb_max_y aabb_max_z\n";
+            for (uint32_t i = 0; i < LBVH.size(); i++) {
+                myfile << LBVH[i].left << " "
+                       << LBVH[i].right << " "
+                       << LBVH[i].primitiveIdx << " "
+                       << LBVH[i].aabbMinX << " "
+                       << LBVH[i].aabbMinY << " "
+                       << LBVH[i].aabbMinZ << " "
+                       << LBVH[i].aabbMaxX << " "
+                       << LBVH[i].aabbMaxY << " "
+                       << LBVH[i].aabbMaxZ << "\n";
+            }
+            myfile.close();
+
+            std::cout << PRINT_PREFIX << "Writing successful." << std::endl;
+        }
 
         std::cout << PRINT_PREFIX << "Starting verification of hierarchy and bounding boxes..." << std::endl;
 
-        std::vector<bool> visited(numLBVHElements, false);
+        std::vector<bool> visited(LBVH.size(), false);
         traverse(0, LBVH.data(), visited);
         for (uint32_t i = 0; i < LBVH.size(); i++) {
             if (!visited[i]) {
@@ -125,6 +991,185 @@ namespace engine {
         }
 
         std::cout << PRINT_PREFIX << "Verification successful." << std::endl;
+
+        // SAH cost, EPO, sibling overlap and leaf depth histogram of the build
+        const LBVHQualityAnalyzer::Report report = m_qualityAnalyzer->analyze(LBVH, ABSOLUTE_POINTERS);
+        LBVHQualityAnalyzer::print(report);
+
+        // the queries of the example run against the last verified build
+        reserveQueryStack(report.maxLeafDepth);
+    }
+
+    void LBVH::reserveQueryStack(uint32_t maxLeafDepth) {
+        const uint32_t stackSize = LBVHQueryPass::getRequiredStackSize(maxLeafDepth);
+        if (m_queryPass && stackSize <= m_queryPass->getStackSize()) {
+            return;
+        }
+        if (m_queryPass) {
+            m_queryPass->release();
+        }
+        std::cout << PRINT_PREFIX << "Creating the query pass with a traversal stack of " << stackSize << " entries (max leaf depth " << maxLeafDepth << ")." << std::endl;
+
+        const uint32_t numElements = m_builder->getNumElements();
+        m_queryPass = std::make_shared<LBVHQueryPass>(m_gpuContext, KNN_K, stackSize);
+        m_queryPass->create();
+        m_queryPass->setGlobalInvocationSize(LBVHQueryPass::RAY_CLOSEST_HIT, NUM_RAYS, 1, 1);
+        m_queryPass->setGlobalInvocationSize(LBVHQueryPass::RAY_ANY_HIT, NUM_RAYS, 1, 1);
+        m_queryPass->m_pushConstantsRayQuery.g_num_rays = NUM_RAYS;
+        m_queryPass->m_pushConstantsRayQuery.g_absolute_pointers = ABSOLUTE_POINTERS;
+        m_queryPass->setGlobalInvocationSize(LBVHQueryPass::OVERLAP, numElements, 1, 1); // self collision: the elements are the query aabbs
+        m_queryPass->m_pushConstantsOverlap.g_num_queries = numElements;
+        m_queryPass->m_pushConstantsOverlap.g_max_pairs = MAX_OVERLAP_PAIRS;
+        m_queryPass->m_pushConstantsOverlap.g_absolute_pointers = ABSOLUTE_POINTERS;
+        m_queryPass->m_pushConstantsOverlap.g_self_collision = 1;
+        m_queryPass->setGlobalInvocationSize(LBVHQueryPass::KNN, NUM_KNN_QUERIES, 1, 1);
+        m_queryPass->m_pushConstantsKNN.g_num_queries = NUM_KNN_QUERIES;
+        m_queryPass->m_pushConstantsKNN.g_absolute_pointers = ABSOLUTE_POINTERS;
+
+        // the buffers of the builder are allocated for NUM_ELEMENTS by create, i.e. they are not reallocated by the builds of the example
+        m_queryPass->setStorageBuffer(0, 0, m_builder->getLBVHBuffer());
+        m_queryPass->setStorageBuffer(0, 1, m_raysBuffer.get());
+        m_queryPass->setStorageBuffer(0, 2, m_rayHitsBuffer.get());
+
+        m_queryPass->setStorageBuffer(1, 0, m_builder->getLBVHBuffer());
+        m_queryPass->setStorageBuffer(1, 1, m_builder->getElementsBuffer());
+        m_queryPass->setStorageBuffer(1, 2, m_overlapPairsBuffer.get());
+        m_queryPass->setOverlapStateBuffer(m_overlapStateBuffer.get()); // (1, 3)
+
+        m_queryPass->setStorageBuffer(2, 0, m_builder->getLBVHBuffer());
+        m_queryPass->setStorageBuffer(2, 1, m_pointQueriesBuffer.get());
+        m_queryPass->setStorageBuffer(2, 2, m_neighboursBuffer.get());
+        m_queryPass->setKNNStateBuffer(m_knnStateBuffer.get()); // (2, 3)
+    }
+
+    void LBVH::verifyWide(uint numElements) {
+        LBVHWideState wideState{};
+        m_builder->getWideStateBuffer()->downloadAsync(&wideState);
+        std::vector<LBVHWideNode<WIDE_BVH_WIDTH>> wideLBVH(m_builder->getWideLBVHBuffer()->getSizeBytes() / sizeof(LBVHWideNode<WIDE_BVH_WIDTH>));
+        m_builder->getWideLBVHBuffer()->downloadAsync(wideLBVH.data());
+        std::vector<LBVHNode> LBVH(2 * numElements - 1);
+        m_gpuContext->m_stagingRing->wait(m_builder->getLBVHBuffer()->downloadAsync(LBVH.data(), static_cast<uint32_t>(LBVH.size() * sizeof(LBVHNode)))); // waits for all downloads above, they are batched into as few submits as the staging ring allows
+
+        std::cout << PRINT_PREFIX << "Starting verification of the BVH" << WIDE_BVH_WIDTH << "..." << std::endl;
+
+        if (wideState.nodeCounter > wideLBVH.size()) {
+            std::cout << PRINT_PREFIX << "Error: " << wideState.nodeCounter << " wide nodes allocated, but the buffer only holds " << wideLBVH.size() << "." << std::endl;
+            throw std::runtime_error("TEST FAILED.");
+        }
+
+        std::vector<bool> visitedNodes(wideState.nodeCounter, false);
+        std::vector<bool> visitedPrimitives(numElements, false);
+        uint32_t maxLeafDepth = 0;
+        AABB rootAABB({LBVH[0].aabbMinX, LBVH[0].aabbMinY, LBVH[0].aabbMinZ, 0}, {LBVH[0].aabbMaxX, LBVH[0].aabbMaxY, LBVH[0].aabbMaxZ, 0});
+        traverseWide(0, rootAABB, wideLBVH.data(), visitedNodes, visitedPrimitives, 1, maxLeafDepth);
+        for (uint32_t i = 0; i < visitedNodes.size(); i++) {
+            if (!visitedNodes[i]) {
+                std::cout << PRINT_PREFIX << "Error: Wide node " << i << " not visited." << std::endl;
+                throw std::runtime_error("TEST FAILED.");
+            }
+        }
+        for (uint32_t i = 0; i < visitedPrimitives.size(); i++) {
+            if (!visitedPrimitives[i]) {
+                std::cout << PRINT_PREFIX << "Error: Primitive " << i << " not referenced by the wide BVH." << std::endl;
+                throw std::runtime_error("TEST FAILED.");
+            }
+        }
+
+        std::cout << PRINT_PREFIX << "Verification successful." << std::endl;
+        std::cout << PRINT_PREFIX << "Wide nodes: " << wideState.nodeCounter << " (" << wideState.nodeCounter * sizeof(LBVHWideNode<WIDE_BVH_WIDTH>) << " bytes, binary: " << (2 * numElements - 1) * sizeof(LBVHNode) << " bytes), max leaf depth: " << maxLeafDepth << std::endl;
+    }
+
+    void LBVH::verifyCollapsed(uint numElements) {
+        // the buffers of the builder are allocated for its capacity, only the nodes of the last build are downloaded
+        std::vector<LBVHNode> LBVH(2 * numElements - 1);
+        m_builder->getLBVHBuffer()->downloadAsync(LBVH.data(), static_cast<uint32_t>(LBVH.size() * sizeof(LBVHNode)));
+        LBVHCollapseState collapseState{};
+        m_builder->getCollapseStateBuffer()->downloadAsync(&collapseState);
+        std::vector<LBVHCollapsedNode> collapsedLBVH(LBVH.size());
+        m_builder->getCollapsedLBVHBuffer()->downloadAsync(collapsedLBVH.data(), static_cast<uint32_t>(collapsedLBVH.size() * sizeof(LBVHCollapsedNode)));
+        std::vector<uint32_t> primitiveIndices(numElements);
+        m_gpuContext->m_stagingRing->wait(m_builder->getCollapsedPrimitiveIndicesBuffer()->downloadAsync(primitiveIndices.data(), static_cast<uint32_t>(primitiveIndices.size() * sizeof(uint32_t))));
+
+        std::cout << PRINT_PREFIX << "Starting verification of the collapsed LBVH..." << std::endl;
+
+        // aabbs of the primitives from the leaves of the LBVH
+        std::vector<AABB> primitiveAABBs(numElements);
+        for (uint32_t i = numElements - 1; i < LBVH.size(); i++) {
+            const LBVHNode &leaf = LBVH[i];
+            primitiveAABBs[leaf.primitiveIdx] = AABB({leaf.aabbMinX, leaf.aabbMinY, leaf.aabbMinZ, 0}, {leaf.aabbMaxX, leaf.aabbMaxY, leaf.aabbMaxZ, 0});
+        }
+
+        std::vector<bool> visitedNodes(collapseState.nodeCounter, false);
+        std::vector<bool> visitedPrimitives(numElements, false);
+        uint32_t numLeaves = 0;
+        traverseCollapsed(0, collapsedLBVH.data(), primitiveIndices.data(), primitiveAABBs, visitedNodes, visitedPrimitives, numLeaves);
+        for (uint32_t i = 0; i < visitedNodes.size(); i++) {
+            if (!visitedNodes[i]) {
+                std::cout << PRINT_PREFIX << "Error: Collapsed node " << i << " not visited." << std::endl;
+                throw std::runtime_error("TEST FAILED.");
+            }
+        }
+        for (uint32_t i = 0; i < visitedPrimitives.size(); i++) {
+            if (!visitedPrimitives[i]) {
+                std::cout << PRINT_PREFIX << "Error: Primitive " << i << " not referenced by the collapsed LBVH." << std::endl;
+                throw std::runtime_error("TEST FAILED.");
+            }
+        }
+
+        std::cout << PRINT_PREFIX << "Verification successful." << std::endl;
+
+        const size_t collapsedBytes = collapseState.nodeCounter * sizeof(LBVHCollapsedNode) + primitiveIndices.size() * sizeof(uint32_t);
+        const size_t binaryBytes = LBVH.size() * sizeof(LBVHNode);
+        std::cout << PRINT_PREFIX << "Collapsed nodes: " << collapseState.nodeCounter << " (binary: " << LBVH.size() << "), leaves: " << numLeaves << " (" << static_cast<double>(numElements) / numLeaves << " primitives per leaf), memory including the primitive index list: " << collapsedBytes << " bytes (binary: " << binaryBytes << " bytes)" << std::endl;
+    }
+
+    void LBVH::verifyCompressed(uint numElements) {
+        std::vector<LBVHNode> LBVH(2 * numElements - 1);
+        m_builder->getLBVHBuffer()->downloadAsync(LBVH.data(), static_cast<uint32_t>(LBVH.size() * sizeof(LBVHNode)));
+        std::vector<LBVHCompressedNode<COMPRESSED_NODE_BITS>> compressedLBVH(numElements - 1);
+        m_gpuContext->m_stagingRing->wait(m_builder->getCompressedLBVHBuffer()->downloadAsync(compressedLBVH.data(), static_cast<uint32_t>(compressedLBVH.size() * sizeof(LBVHCompressedNode<COMPRESSED_NODE_BITS>))));
+
+        std::cout << PRINT_PREFIX << "Starting verification of the compressed nodes..." << std::endl;
+
+        double sumDecodedArea = 0; // surface area of all decoded child aabbs, i.e. all nodes except the root
+        for (uint32_t i = 0; i < compressedLBVH.size(); i++) {
+            const LBVHCompressedNode<COMPRESSED_NODE_BITS> &compressedNode = compressedLBVH[i];
+            const uint32_t childIndices[2] = {static_cast<uint32_t>(POINTER(i, LBVH[i].left)), static_cast<uint32_t>(POINTER(i, LBVH[i].right))};
+            for (uint32_t c = 0; c < 2; c++) {
+                const LBVHNode &child = LBVH[childIndices[c]];
+                const uint32_t expectedChild = child.left == INVALID_POINTER ? COMPRESSED_NODE_LEAF | child.primitiveIdx : childIndices[c];
+                if (compressedNode.children[c] != expectedChild) {
+                    std::cout << PRINT_PREFIX << "Error: Compressed node " << i << " has child " << compressedNode.children[c] << ", expected " << expectedChild << "." << std::endl;
+                    throw std::runtime_error("TEST FAILED.");
+                }
+
+                // exact: every decoded bound contains the original bound and the next value towards the inside does not, i.e. the quantization is conservative and as tight as possible
+                const float bounds[6] = {child.aabbMinX, child.aabbMinY, child.aabbMinZ, child.aabbMaxX, child.aabbMaxY, child.aabbMaxZ};
+                for (uint32_t bound = 0; bound < 6; bound++) {
+                    const uint32_t axis = bound % 3;
+                    const uint32_t value = getCompressedValue(compressedNode, 6 * c + bound);
+                    const float decodedBound = dequantize(compressedNode, axis, value);
+                    const bool valid = bound < 3 ? decodedBound <= bounds[bound] && (value == LBVHCompressedNode<COMPRESSED_NODE_BITS>::MAX_VALUE || dequantize(compressedNode, axis, value + 1) > bounds[bound])
+                                                 : decodedBound >= bounds[bound] && (value == 0 || dequantize(compressedNode, axis, value - 1) < bounds[bound]);
+                    if (!valid) {
+                        std::cout << PRINT_PREFIX << "Error: Compressed node " << i << " has a decoded bound " << bound << " of child " << childIndices[c] << " that does not tightly contain the child AABB. decoded=" << decodedBound << " (value " << value << ") original=" << bounds[bound] << std::endl;
+                        throw std::runtime_error("TEST FAILED.");
+                    }
+                }
+                const AABB decoded = decodeCompressedChild(compressedNode, c);
+                const glm::vec3 extent = glm::vec3(decoded.max - decoded.min);
+                sumDecodedArea += 2 * (extent.x * extent.y + extent.x * extent.z + extent.y * extent.z);
+            }
+        }
+
+        std::cout << PRINT_PREFIX << "Verification successful." << std::endl;
+
+        // the SAH cost of the decoded aabbs shows the quality loss of the quantization (traversal and intersection cost of 1, normalized by the surface area of the root)
+        const double rootArea = surfaceArea(LBVH[0]);
+        const double decodedSAHCost = rootArea > 0 ? (rootArea + sumDecodedArea) / rootArea : 0;
+        const size_t compressedBytes = compressedLBVH.size() * sizeof(LBVHCompressedNode<COMPRESSED_NODE_BITS>);
+        const size_t binaryBytes = LBVH.size() * sizeof(LBVHNode);
+        std::cout << PRINT_PREFIX << "Compressed nodes: " << compressedBytes << " bytes (" << static_cast<double>(compressedBytes) / numElements << " bytes per primitive), binary: " << binaryBytes << " bytes (" << static_cast<double>(binaryBytes) / numElements << " bytes per primitive), SAH cost (decoded): " << decodedSAHCost << std::endl;
     }
 
     bool LBVH::aabbIsUnion(AABB parentAABB, AABB childAAABB, AABB childBAABB) {
@@ -145,7 +1190,41 @@ namespace engine {
         return true;
     }
 
-    void LBVH::traverse(uint32_t index, LBVH::LBVHNode *LBVH, std::vector<bool> &visited) {
+    float LBVH::surfaceArea(const LBVHNode &node) {
+        float x = node.aabbMaxX - node.aabbMinX;
+        float y = node.aabbMaxY - node.aabbMinY;
+        float z = node.aabbMaxZ - node.aabbMinZ;
+        return 2 * (x * y + x * z + y * z);
+    }
+
+    float LBVH::orderedUintToFloat(uint32_t u) {
+        // inverse of floatToOrderedUint in lbvh_common.glsl
+        u = (u & 0x80000000u) != 0 ? u & 0x7FFFFFFFu : ~u;
+        float f;
+        std::memcpy(&f, &u, sizeof(float));
+        return f;
+    }
+
+    uint32_t LBVH::getCompressedValue(const LBVHCompressedNode<COMPRESSED_NODE_BITS> &node, uint32_t valueIdx) {
+        using Node = LBVHCompressedNode<COMPRESSED_NODE_BITS>;
+        return (node.childBounds[valueIdx / Node::VALUES_PER_WORD] >> ((valueIdx % Node::VALUES_PER_WORD) * COMPRESSED_NODE_BITS)) & Node::MAX_VALUE;
+    }
+
+    float LBVH::dequantize(const LBVHCompressedNode<COMPRESSED_NODE_BITS> &node, uint32_t axis, uint32_t value) {
+        // inverse of the quantization in lbvh_compress.comp: bound = origin + value * 2^(exponent - 127), the product is exact, i.e. the same float operations as on the GPU
+        const float origin = axis == 0 ? node.originX : axis == 1 ? node.originY : node.originZ;
+        const float spacing = std::ldexp(1.f, static_cast<int>((node.exponents >> (8 * axis)) & 0xFF) - 127);
+        return origin + static_cast<float>(value) * spacing;
+    }
+
+    AABB LBVH::decodeCompressedChild(const LBVHCompressedNode<COMPRESSED_NODE_BITS> &node, uint32_t child) {
+        AABB aabb;
+        aabb.expand(glm::vec3(dequantize(node, 0, getCompressedValue(node, 6 * child + 0)), dequantize(node, 1, getCompressedValue(node, 6 * child + 1)), dequantize(node, 2, getCompressedValue(node, 6 * child + 2))));
+        aabb.expand(glm::vec3(dequantize(node, 0, getCompressedValue(node, 6 * child + 3)), dequantize(node, 1, getCompressedValue(node, 6 * child + 4)), dequantize(node, 2, getCompressedValue(node, 6 * child + 5))));
+        return aabb;
+    }
+
+    void LBVH::traverse(uint32_t index, LBVHNode *LBVH, std::vector<bool> &visited) {
         LBVHNode node = LBVH[index];
 
         if (node.left == INVALID_POINTER && node.right != INVALID_POINTER || node.left != INVALID_POINTER && node.right == INVALID_POINTER) {
@@ -188,7 +1267,95 @@ namespace engine {
         }
     }
 
-    void LBVH::generateElements(std::vector<Element> &elements, AABB *extent) {
+    void LBVH::traverseCollapsed(uint32_t index, LBVH::LBVHCollapsedNode *collapsedLBVH, uint32_t *primitiveIndices, const std::vector<AABB> &primitiveAABBs, std::vector<bool> &visitedNodes, std::vector<bool> &visitedPrimitives, uint32_t &numLeaves) {
+        if (index >= visitedNodes.size() || visitedNodes[index]) {
+            std::cout << PRINT_PREFIX << "Error: Collapsed node " << index << " is invalid or visited twice." << std::endl;
+            throw std::runtime_error("TEST FAILED.");
+        }
+        visitedNodes[index] = true;
+
+        const LBVHCollapsedNode &node = collapsedLBVH[index];
+        AABB nodeAABB({node.aabbMinX, node.aabbMinY, node.aabbMinZ, 0}, {node.aabbMaxX, node.aabbMaxY, node.aabbMaxZ, 0});
+        if (node.left == INVALID_POINTER) {
+            // leaf, the primitives have to be inside the aabb of the leaf
+            if (node.primitiveCount == 0 || node.primitiveCount > COLLAPSE_MAX_LEAF_SIZE || node.primitiveOffset + node.primitiveCount > visitedPrimitives.size()) {
+                std::cout << PRINT_PREFIX << "Error: Collapsed leaf " << index << " has an invalid primitive range (offset=" << node.primitiveOffset << ",count=" << node.primitiveCount << ")." << std::endl;
+                throw std::runtime_error("TEST FAILED.");
+            }
+            AABB primitivesAABB;
+            for (uint32_t i = node.primitiveOffset; i < node.primitiveOffset + node.primitiveCount; i++) {
+                const uint32_t primitiveIdx = primitiveIndices[i];
+                if (primitiveIdx >= visitedPrimitives.size() || visitedPrimitives[primitiveIdx]) {
+                    std::cout << PRINT_PREFIX << "Error: Primitive " << primitiveIdx << " is invalid or referenced twice by the collapsed LBVH." << std::endl;
+                    throw std::runtime_error("TEST FAILED.");
+                }
+                visitedPrimitives[primitiveIdx] = true;
+                primitivesAABB.expand(primitiveAABBs[primitiveIdx].min);
+                primitivesAABB.expand(primitiveAABBs[primitiveIdx].max);
+            }
+            if (!aabbIsUnion(nodeAABB, primitivesAABB, primitivesAABB)) {
+                std::cout << PRINT_PREFIX << "Error: Collapsed leaf " << index << " has an AABB that is not the union of its primitive AABBs. leafAABB=" << nodeAABB << " primitivesAABB=" << primitivesAABB << std::endl;
+                throw std::runtime_error("TEST FAILED.");
+            }
+            numLeaves++;
+        } else {
+            // inner node
+            const uint32_t leftChildIndex = POINTER(index, node.left);
+            const uint32_t rightChildIndex = POINTER(index, node.right);
+            const LBVHCollapsedNode &childA = collapsedLBVH[leftChildIndex];
+            const LBVHCollapsedNode &childB = collapsedLBVH[rightChildIndex];
+            AABB childAAABB({childA.aabbMinX, childA.aabbMinY, childA.aabbMinZ, 0}, {childA.aabbMaxX, childA.aabbMaxY, childA.aabbMaxZ, 0});
+            AABB childBAABB({childB.aabbMinX, childB.aabbMinY, childB.aabbMinZ, 0}, {childB.aabbMaxX, childB.aabbMaxY, childB.aabbMaxZ, 0});
+            if (node.primitiveCount != 0 || !aabbIsUnion(nodeAABB, childAAABB, childBAABB)) {
+                std::cout << PRINT_PREFIX << "Error: Collapsed inner node " << index << " has primitives or an AABB that is not the union of the children (left=" << leftChildIndex << ",right=" << rightChildIndex << ") AABBs." << std::endl;
+                throw std::runtime_error("TEST FAILED.");
+            }
+            traverseCollapsed(leftChildIndex, collapsedLBVH, primitiveIndices, primitiveAABBs, visitedNodes, visitedPrimitives, numLeaves);
+            traverseCollapsed(rightChildIndex, collapsedLBVH, primitiveIndices, primitiveAABBs, visitedNodes, visitedPrimitives, numLeaves);
+        }
+    }
+
+    void LBVH::traverseWide(uint32_t index, const AABB &aabb, LBVH::LBVHWideNode<WIDE_BVH_WIDTH> *wideLBVH, std::vector<bool> &visitedNodes, std::vector<bool> &visitedPrimitives, uint32_t depth, uint32_t &maxLeafDepth) {
+        if (index >= visitedNodes.size() || visitedNodes[index]) {
+            std::cout << PRINT_PREFIX << "Error: Wide node " << index << " is invalid or visited twice." << std::endl;
+            throw std::runtime_error("TEST FAILED.");
+        }
+        visitedNodes[index] = true;
+
+        const LBVHWideNode<WIDE_BVH_WIDTH> &node = wideLBVH[index];
+        AABB childrenAABB;
+        uint32_t numChildren = 0;
+        for (uint32_t i = 0; i < WIDE_BVH_WIDTH; i++) {
+            const uint32_t child = node.children[i];
+            if (child == WIDE_BVH_INVALID_CHILD) {
+                continue;
+            }
+            numChildren++;
+            AABB childAABB({node.childMinX[i], node.childMinY[i], node.childMinZ[i], 0}, {node.childMaxX[i], node.childMaxY[i], node.childMaxZ[i], 0});
+            childrenAABB.expand(childAABB.min);
+            childrenAABB.expand(childAABB.max);
+            if ((child & WIDE_BVH_LEAF) != 0) {
+                // leaf
+                const uint32_t primitiveIdx = child & ~WIDE_BVH_LEAF;
+                if (primitiveIdx >= visitedPrimitives.size() || visitedPrimitives[primitiveIdx]) {
+                    std::cout << PRINT_PREFIX << "Error: Primitive " << primitiveIdx << " is invalid or referenced twice by the wide BVH." << std::endl;
+                    throw std::runtime_error("TEST FAILED.");
+                }
+                visitedPrimitives[primitiveIdx] = true;
+                maxLeafDepth = std::max(maxLeafDepth, depth);
+            } else {
+                traverseWide(child, childAABB, wideLBVH, visitedNodes, visitedPrimitives, depth + 1, maxLeafDepth);
+            }
+        }
+
+        // the aabb of the node (stored in the parent) has to be the union of the aabbs of its children
+        if (numChildren < 2 || !aabbIsUnion(aabb, childrenAABB, childrenAABB)) {
+            std::cout << PRINT_PREFIX << "Error: Wide node " << index << " has " << numChildren << " children or an AABB that is not the union of the children AABBs. parentAABB=" << aabb << " childrenAABB=" << childrenAABB << std::endl;
+            throw std::runtime_error("TEST FAILED.");
+        }
+    }
+
+    void LBVH::generateElements(std::vector<Element> &elements) {
         const std::string MODEL_FILE_NAME = "dragon.obj";
         const std::string MODEL_PATH_DIRECTORY = engine::Paths::m_resourceDirectoryPath + "/models";
 
@@ -236,8 +1403,6 @@ namespace engine {
                 aabb.expand(maxV);
                 elements.push_back({primitiveIndex, aabb.min.x, aabb.min.y, aabb.min.z, aabb.max.x, aabb.max.y, aabb.max.z});
                 primitiveIndex++;
-                extent->expand(minV);
-                extent->expand(maxV);
             }
         }
     }
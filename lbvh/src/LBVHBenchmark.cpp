@@ -0,0 +1,439 @@
+#include "LBVHBenchmark.h"
+
+#ifdef __linux__
+#include <sys/resource.h>
+#endif
+
+namespace engine {
+    static std::vector<std::string> splitList(const std::string &list) {
+        std::vector<std::string> items;
+        std::stringstream stream(list);
+        std::string item;
+        while (std::getline(stream, item, ',')) {
+            if (!item.empty()) {
+                items.push_back(item);
+            }
+        }
+        return items;
+    }
+
+    static std::string escapeJSON(const std::string &value) {
+        std::string escaped;
+        for (const char c: value) {
+            if (c == '"' || c == '\\') {
+                escaped += '\\';
+            }
+            escaped += c;
+        }
+        return escaped;
+    }
+
+    static double median(std::vector<double> values) {
+        if (values.empty()) {
+            return 0;
+        }
+        std::sort(values.begin(), values.end());
+        const size_t middle = values.size() / 2;
+        return values.size() % 2 == 1 ? values[middle] : 0.5 * (values[middle - 1] + values[middle]);
+    }
+
+    bool LBVHBenchmark::parseArguments(int argc, char *argv[], Settings &settings, GPUContext &gpuContext) {
+        for (int i = 1; i < argc; i++) {
+            const std::string argument = argv[i];
+            if (argument == "--help") {
+                return false;
+            }
+            if (i + 1 >= argc) {
+                throw std::runtime_error("Missing value of " + argument + "!");
+            }
+            const std::string value = argv[++i];
+
+            if (argument == "--sizes") {
+                settings.m_sizes.clear();
+                for (const auto &size: splitList(value)) {
+                    settings.m_sizes.push_back(std::stoul(size));
+                }
+            } else if (argument == "--max-size") {
+                const uint32_t maxSize = std::stoul(value);
+                std::erase_if(settings.m_sizes, [maxSize](uint32_t size) { return size > maxSize; });
+            } else if (argument == "--distributions") {
+                settings.m_distributions.clear();
+                for (const auto &name: splitList(value)) {
+                    bool found = false;
+                    for (uint32_t distribution = 0; distribution < NUM_DISTRIBUTIONS; distribution++) {
+                        if (name == getDistributionName(static_cast<Distribution>(distribution))) {
+                            settings.m_distributions.push_back(static_cast<Distribution>(distribution));
+                            found = true;
+                        }
+                    }
+                    if (!found) {
+                        throw std::runtime_error("Unknown distribution " + name + "!");
+                    }
+                }
+            } else if (argument == "--algorithms") {
+                settings.m_algorithms.clear();
+                for (const auto &name: splitList(value)) {
+                    if (name == getAlgorithmName(LBVHPass::KARRAS)) {
+                        settings.m_algorithms.push_back(LBVHPass::KARRAS);
+                    } else if (name == getAlgorithmName(LBVHPass::PLOC)) {
+                        settings.m_algorithms.push_back(LBVHPass::PLOC);
+                    } else {
+                        throw std::runtime_error("Unknown build algorithm " + name + "!");
+                    }
+                }
+            } else if (argument == "--warmup") {
+                settings.m_warmupRuns = std::stoul(value);
+            } else if (argument == "--runs") {
+                settings.m_runs = std::max(1ul, std::stoul(value));
+            } else if (argument == "--seed") {
+                settings.m_seed = std::stoul(value);
+            } else if (argument == "--json") {
+                settings.m_jsonPath = value;
+            } else if (argument == "--csv") {
+                settings.m_csvPath = value;
+            } else if (argument == "--batch") {
+                const std::vector<std::string> items = splitList(value);
+                if (value == "off") {
+                    settings.m_batchMeshes = 0;
+                } else if (items.size() == 2) {
+                    settings.m_batchMeshes = std::stoul(items[0]);
+                    settings.m_batchMeshElements = std::stoul(items[1]);
+                } else {
+                    throw std::runtime_error("The batch has to be given as meshes,elements or off!");
+                }
+            } else if (argument == "--device") {
+                if (value == "cpu") {
+                    gpuContext.m_deviceType = VK_PHYSICAL_DEVICE_TYPE_CPU;
+                } else {
+                    gpuContext.m_deviceIndex = std::stoul(value);
+                }
+            } else if (argument == "--validation") {
+                gpuContext.m_validationLayers = value == "on";
+            } else {
+                throw std::runtime_error("Unknown argument " + argument + "!");
+            }
+        }
+        for (const uint32_t size: settings.m_sizes) {
+            if (size < 2) {
+                throw std::runtime_error("The LBVH has to contain at least two elements!");
+            }
+        }
+        if (settings.m_batchMeshes > 0 && settings.m_batchMeshElements < 2) {
+            throw std::runtime_error("The LBVH has to contain at least two elements!");
+        }
+        return true;
+    }
+
+    void LBVHBenchmark::execute(GPUContext *gpuContext) {
+        m_gpuContext = gpuContext;
+        m_deviceName = gpuContext->m_deviceProperties.deviceName;
+        m_results.clear();
+        std::cout << PRINT_PREFIX << "Device: " << m_deviceName << ", " << m_settings.m_warmupRuns << " warmup runs and " << m_settings.m_runs << " runs per configuration." << std::endl;
+
+        std::vector<Element> elements;
+        for (const uint32_t size: m_settings.m_sizes) {
+            // one builder per size, i.e. the device memory is allocated for exactly this size and reused by all distributions and algorithms
+            LBVHBuilder builder(gpuContext);
+            std::string skipReason;
+            if (size > builder.getMaxCapacity()) {
+                skipReason = "skipped: exceeds maxStorageBufferRange";
+            } else {
+                try {
+                    builder.create(size);
+                    m_timestamps = builder.getPass()->hasTimestamps();
+                } catch (const std::exception &e) {
+                    skipReason = std::string("skipped: ") + e.what();
+                }
+            }
+
+            for (const Distribution distribution: m_settings.m_distributions) {
+                if (skipReason.empty()) {
+                    generateElements(distribution, size, m_settings.m_seed, elements);
+                }
+                for (const LBVHPass::BuildAlgorithm algorithm: m_settings.m_algorithms) {
+                    Result result{.distribution = distribution, .algorithm = algorithm, .numElements = size, .status = skipReason};
+                    if (skipReason.empty()) {
+                        try {
+                            result = benchmark(builder, elements, distribution, algorithm);
+                        } catch (const std::exception &e) {
+                            result.status = std::string("failed: ") + e.what();
+                        }
+                    }
+                    result.processPeakRSSBytes = getProcessPeakRSSBytes();
+                    m_results.push_back(result);
+
+                    std::cout << PRINT_PREFIX << getDistributionName(distribution) << ", " << getAlgorithmName(algorithm) << ", " << size << " elements: ";
+                    if (result.status == "ok") {
+                        std::cout << "build " << result.buildTimeMedian << "[ms] (median), GPU " << result.gpuTimeMedian << "[ms] (median), " << result.primitivesPerSecond * 1e-6 << " MPrims/s, " << result.deviceMemoryBytes / (1024 * 1024) << " MiB." << std::endl;
+                    } else {
+                        std::cout << result.status << std::endl;
+                    }
+                }
+            }
+
+            if (skipReason.empty()) {
+                builder.release();
+            }
+        }
+
+        m_batchResult = {};
+        if (m_settings.m_batchMeshes > 0) {
+            m_batchResult = benchmarkBatch();
+            m_batchResult.numMeshes = m_settings.m_batchMeshes;
+            m_batchResult.numElementsPerMesh = m_settings.m_batchMeshElements;
+            std::cout << PRINT_PREFIX << "Batch of " << m_batchResult.numMeshes << " meshes with " << m_batchResult.numElementsPerMesh << " elements: ";
+            if (m_batchResult.status == "ok") {
+                std::cout << "batched build " << m_batchResult.batchTimeMedian << "[ms] (median), GPU " << m_batchResult.gpuTimeMedian << "[ms] (median), sequential builds " << m_batchResult.sequentialTime << "[ms], speedup " << m_batchResult.speedup << "x." << std::endl;
+            } else {
+                std::cout << m_batchResult.status << std::endl;
+            }
+        }
+
+        writeJSON();
+        writeCSV();
+        std::cout << PRINT_PREFIX << "Results written to " << m_settings.m_jsonPath << " and " << m_settings.m_csvPath << "." << std::endl;
+    }
+
+    LBVHBenchmark::Result LBVHBenchmark::benchmark(LBVHBuilder &builder, const std::vector<Element> &elements, Distribution distribution, LBVHPass::BuildAlgorithm algorithm) const {
+        for (uint32_t run = 0; run < m_settings.m_warmupRuns; run++) {
+            builder.build(elements, algorithm);
+        }
+
+        Result result{.distribution = distribution, .algorithm = algorithm, .numElements = static_cast<uint32_t>(elements.size())};
+        std::vector<double> buildTimes;
+        std::vector<double> gpuTimes;
+        const uint64_t blockAllocations = m_gpuContext->m_memoryAllocator->getStatistics().totalBlockAllocations;
+        for (uint32_t run = 0; run < m_settings.m_runs; run++) {
+            buildTimes.push_back(builder.build(elements, algorithm));
+            double gpuTime = 0;
+            for (uint32_t stage = 0; stage < LBVHPass::NUM_TIMED_STAGES; stage++) {
+                result.stageTimesMean[stage] += builder.getStageTimes()[stage] / m_settings.m_runs;
+                gpuTime += builder.getStageTimes()[stage];
+            }
+            gpuTimes.push_back(gpuTime);
+        }
+
+        result.buildTimeMean = std::accumulate(buildTimes.begin(), buildTimes.end(), 0.0) / m_settings.m_runs;
+        result.buildTimeMin = *std::min_element(buildTimes.begin(), buildTimes.end());
+        result.buildTimeMedian = median(buildTimes);
+        result.gpuTimeMedian = median(gpuTimes);
+        const double time = result.gpuTimeMedian > 0 ? result.gpuTimeMedian : result.buildTimeMedian;
+        result.primitivesPerSecond = time > 0 ? static_cast<double>(elements.size()) / (time * 1e-3) : 0;
+        result.deviceMemoryBytes = builder.getDeviceMemoryBytes();
+        result.deviceAllocationsPerBuild = static_cast<double>(m_gpuContext->m_memoryAllocator->getStatistics().totalBlockAllocations - blockAllocations) / m_settings.m_runs;
+        return result;
+    }
+
+    LBVHBenchmark::BatchResult LBVHBenchmark::benchmarkBatch() const {
+        BatchResult result;
+        const uint64_t numElements = static_cast<uint64_t>(m_settings.m_batchMeshes) * m_settings.m_batchMeshElements;
+        // 63-bit morton codes, the segment index takes ceil(log2(meshes)) bits of the sort key
+        LBVHBuilder builder(m_gpuContext, true);
+        if (numElements > builder.getMaxCapacity()) {
+            result.status = "skipped: exceeds maxStorageBufferRange";
+            return result;
+        }
+        try {
+            builder.create(static_cast<uint32_t>(numElements));
+        } catch (const std::exception &e) {
+            result.status = std::string("skipped: ") + e.what();
+            return result;
+        }
+
+        // every mesh is a uniform distribution with its own seed and primitive ids starting at 0
+        std::vector<Element> elements;
+        std::vector<Element> meshElements;
+        std::vector<LBVHSegment> segments;
+        elements.reserve(numElements);
+        for (uint32_t mesh = 0; mesh < m_settings.m_batchMeshes; mesh++) {
+            generateElements(UNIFORM, m_settings.m_batchMeshElements, m_settings.m_seed + mesh, meshElements);
+            segments.push_back({static_cast<uint32_t>(elements.size()), m_settings.m_batchMeshElements, 0});
+            elements.insert(elements.end(), meshElements.begin(), meshElements.end());
+        }
+
+        try {
+            for (uint32_t run = 0; run < m_settings.m_warmupRuns; run++) {
+                builder.buildBatch(elements, segments);
+            }
+            std::vector<double> batchTimes;
+            std::vector<double> gpuTimes;
+            for (uint32_t run = 0; run < m_settings.m_runs; run++) {
+                batchTimes.push_back(builder.buildBatch(elements, segments));
+                gpuTimes.push_back(std::accumulate(builder.getStageTimes().begin(), builder.getStageTimes().end(), 0.0));
+            }
+            result.batchTimeMedian = median(batchTimes);
+            result.gpuTimeMedian = median(gpuTimes);
+            result.deviceMemoryBytes = builder.getDeviceMemoryBytes();
+
+            // the copy of the elements of a mesh is not part of the measurement
+            std::chrono::steady_clock::duration sequentialTime{};
+            for (uint32_t mesh = 0; mesh < m_settings.m_batchMeshes; mesh++) {
+                meshElements.assign(elements.begin() + segments[mesh].elementOffset, elements.begin() + segments[mesh].elementOffset + segments[mesh].numElements);
+                std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+                builder.build(meshElements);
+                sequentialTime += std::chrono::steady_clock::now() - begin;
+            }
+            result.sequentialTime = static_cast<double>(std::chrono::duration_cast<std::chrono::microseconds>(sequentialTime).count()) * std::pow(10, -3);
+            result.speedup = result.batchTimeMedian > 0 ? result.sequentialTime / result.batchTimeMedian : 0;
+        } catch (const std::exception &e) {
+            result.status = std::string("failed: ") + e.what();
+        }
+        builder.release();
+        return result;
+    }
+
+    void LBVHBenchmark::generateElements(Distribution distribution, uint32_t numElements, uint32_t seed, std::vector<Element> &elements) {
+        std::mt19937 generator(seed);
+        std::uniform_real_distribution<float> uniform(0.f, 1.f);
+        std::normal_distribution<float> normal(0.f, CLUSTER_SIGMA);
+
+        // boxes of roughly the spacing of the elements
+        const float spacing = distribution == PLANAR ? 1.f / std::sqrt(static_cast<float>(numElements)) : 1.f / std::cbrt(static_cast<float>(numElements));
+
+        std::vector<glm::vec3> clusterCenters(NUM_CLUSTERS);
+        for (auto &center: clusterCenters) {
+            center = glm::vec3(uniform(generator), uniform(generator), uniform(generator));
+        }
+
+        elements.resize(numElements);
+        for (uint32_t i = 0; i < numElements; i++) {
+            glm::vec3 centroid;
+            glm::vec3 halfSize = glm::vec3(0.5f * spacing * (0.1f + 0.9f * uniform(generator)));
+            switch (distribution) {
+                case UNIFORM:
+                    centroid = glm::vec3(uniform(generator), uniform(generator), uniform(generator));
+                    break;
+                case CLUSTERED:
+                    centroid = clusterCenters[generator() % NUM_CLUSTERS] + glm::vec3(normal(generator), normal(generator), normal(generator));
+                    break;
+                case DUPLICATE:
+                    centroid = glm::vec3(0.5f);
+                    break;
+                case THIN: {
+                    centroid = glm::vec3(uniform(generator), uniform(generator), uniform(generator));
+                    halfSize = glm::vec3(0.5f * THIN_WIDTH);
+                    halfSize[generator() % 3] = 0.5f * THIN_LENGTH;
+                    break;
+                }
+                case PLANAR:
+                default:
+                    centroid = glm::vec3(uniform(generator), uniform(generator), 0.f);
+                    halfSize.z = 0.f;
+                    break;
+            }
+            elements[i] = {i, centroid.x - halfSize.x, centroid.y - halfSize.y, centroid.z - halfSize.z, centroid.x + halfSize.x, centroid.y + halfSize.y, centroid.z + halfSize.z};
+        }
+    }
+
+    uint64_t LBVHBenchmark::getProcessPeakRSSBytes() {
+#ifdef __linux__
+        rusage usage{};
+        if (getrusage(RUSAGE_SELF, &usage) == 0) {
+            return static_cast<uint64_t>(usage.ru_maxrss) * 1024; // kilobytes on linux
+        }
+#endif
+        return 0;
+    }
+
+    const char *LBVHBenchmark::getDistributionName(Distribution distribution) {
+        switch (distribution) {
+            case UNIFORM:
+                return "uniform";
+            case CLUSTERED:
+                return "clustered";
+            case DUPLICATE:
+                return "duplicate";
+            case THIN:
+                return "thin";
+            case PLANAR:
+                return "planar";
+            default:
+                return "unknown";
+        }
+    }
+
+    const char *LBVHBenchmark::getAlgorithmName(LBVHPass::BuildAlgorithm algorithm) {
+        return algorithm == LBVHPass::PLOC ? "ploc" : "karras";
+    }
+
+    // e.g. "Bounding boxes" -> "bounding_boxes"
+    static std::string getStageKey(LBVHPass::TimedStage stage) {
+        std::string key = LBVHPass::getTimedStageName(stage);
+        for (char &c: key) {
+            c = c == ' ' ? '_' : static_cast<char>(std::tolower(c));
+        }
+        return key;
+    }
+
+    void LBVHBenchmark::writeJSON() const {
+        std::ofstream file(m_settings.m_jsonPath);
+        if (!file) {
+            throw std::runtime_error("Failed to open " + m_settings.m_jsonPath + "!");
+        }
+        file << std::setprecision(9);
+        file << "{\n";
+        file << "  \"device\": \"" << escapeJSON(m_deviceName) << "\",\n";
+        file << "  \"timestamps\": " << (m_timestamps ? "true" : "false") << ",\n";
+        file << "  \"warmup_runs\": " << m_settings.m_warmupRuns << ",\n";
+        file << "  \"runs\": " << m_settings.m_runs << ",\n";
+        file << "  \"seed\": " << m_settings.m_seed << ",\n";
+        file << "  \"results\": [";
+        for (size_t i = 0; i < m_results.size(); i++) {
+            const Result &result = m_results[i];
+            file << (i > 0 ? "," : "") << "\n    {";
+            file << "\"distribution\": \"" << getDistributionName(result.distribution) << "\", ";
+            file << "\"algorithm\": \"" << getAlgorithmName(result.algorithm) << "\", ";
+            file << "\"num_elements\": " << result.numElements << ", ";
+            file << "\"status\": \"" << escapeJSON(result.status) << "\", ";
+            file << "\"build_ms_mean\": " << result.buildTimeMean << ", ";
+            file << "\"build_ms_min\": " << result.buildTimeMin << ", ";
+            file << "\"build_ms_median\": " << result.buildTimeMedian << ", ";
+            file << "\"gpu_ms_median\": " << result.gpuTimeMedian << ", ";
+            file << "\"stage_ms_mean\": {";
+            for (uint32_t stage = 0; stage < LBVHPass::NUM_TIMED_STAGES; stage++) {
+                file << (stage > 0 ? ", " : "") << "\"" << getStageKey(static_cast<LBVHPass::TimedStage>(stage)) << "\": " << result.stageTimesMean[stage];
+            }
+            file << "}, ";
+            file << "\"primitives_per_second\": " << result.primitivesPerSecond << ", ";
+            file << "\"device_memory_bytes\": " << result.deviceMemoryBytes << ", ";
+            file << "\"device_allocations_per_build\": " << result.deviceAllocationsPerBuild << ", ";
+            file << "\"process_peak_rss_bytes\": " << result.processPeakRSSBytes << "}";
+        }
+        file << "\n  ],\n";
+        file << "  \"batch\": ";
+        if (m_settings.m_batchMeshes == 0) {
+            file << "null\n";
+        } else {
+            file << "{\"num_meshes\": " << m_batchResult.numMeshes << ", ";
+            file << "\"elements_per_mesh\": " << m_batchResult.numElementsPerMesh << ", ";
+            file << "\"status\": \"" << escapeJSON(m_batchResult.status) << "\", ";
+            file << "\"batch_ms_median\": " << m_batchResult.batchTimeMedian << ", ";
+            file << "\"gpu_ms_median\": " << m_batchResult.gpuTimeMedian << ", ";
+            file << "\"sequential_ms\": " << m_batchResult.sequentialTime << ", ";
+            file << "\"speedup\": " << m_batchResult.speedup << ", ";
+            file << "\"device_memory_bytes\": " << m_batchResult.deviceMemoryBytes << "}\n";
+        }
+        file << "}\n";
+    }
+
+    void LBVHBenchmark::writeCSV() const {
+        std::ofstream file(m_settings.m_csvPath);
+        if (!file) {
+            throw std::runtime_error("Failed to open " + m_settings.m_csvPath + "!");
+        }
+        file << std::setprecision(9);
+        file << "distribution,algorithm,num_elements,status,build_ms_mean,build_ms_min,build_ms_median,gpu_ms_median";
+        for (uint32_t stage = 0; stage < LBVHPass::NUM_TIMED_STAGES; stage++) {
+            file << "," << getStageKey(static_cast<LBVHPass::TimedStage>(stage)) << "_ms_mean";
+        }
+        file << ",primitives_per_second,device_memory_bytes,device_allocations_per_build,process_peak_rss_bytes\n";
+        for (const Result &result: m_results) {
+            file << getDistributionName(result.distribution) << "," << getAlgorithmName(result.algorithm) << "," << result.numElements << ",\"" << std::regex_replace(result.status, std::regex("\""), "\"\"") << "\","
+                 << result.buildTimeMean << "," << result.buildTimeMin << "," << result.buildTimeMedian << "," << result.gpuTimeMedian;
+            for (uint32_t stage = 0; stage < LBVHPass::NUM_TIMED_STAGES; stage++) {
+                file << "," << result.stageTimesMean[stage];
+            }
+            file << "," << result.primitivesPerSecond << "," << result.deviceMemoryBytes << "," << result.deviceAllocationsPerBuild << "," << result.processPeakRSSBytes << "\n";
+        }
+    }
+} // namespace engine
@@ -0,0 +1,536 @@
+#include "LBVHBuilder.h"
+
+namespace engine {
+
+    void LBVHBuilder::create(uint32_t initialCapacity) {
+        m_pass = std::make_shared<LBVHPass>(m_gpuContext, m_mortonCodes64, m_wideBVHWidth, m_compressedNodeBits);
+        m_pass->create();
+        createBuffers(std::max(initialCapacity, MIN_CAPACITY));
+    }
+
+    void LBVHBuilder::release() {
+        finishBuild();
+        releaseBuffers();
+        if (m_segmentsBuffer) {
+            m_segmentsBuffer->release();
+            m_segmentsBuffer = nullptr;
+            m_segmentsCapacity = 0;
+        }
+        releasePostBuildBuffers();
+        m_pass->release();
+    }
+
+    double LBVHBuilder::build(const std::vector<Element> &elements, LBVHPass::BuildAlgorithm buildAlgorithm) {
+        const auto numElements = static_cast<uint32_t>(elements.size());
+        if (numElements < 2) {
+            throw std::runtime_error("The LBVH has to contain at least two elements!");
+        }
+
+        std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+        finishBuild(); // a pending asynchronous build reads the elements buffer, which is overwritten by the upload below
+        if (buildAlgorithm == LBVHPass::KARRAS && !m_pass->m_wideBVH && !m_pass->m_collapseLeaves) {
+            wait(buildAsync(elements));
+        } else {
+            reserve(numElements);
+            reservePostBuild();
+            // the upload is submitted while the pass is prepared
+            const StagingRing::TransferHandle upload = m_elementsBuffer->uploadAsync(elements.data(), static_cast<uint32_t>(numElements * sizeof(Element)));
+            m_gpuContext->m_stagingRing->submit();
+            if (numElements != m_numElements) {
+                setNumElements(numElements);
+            }
+            m_numLBVHs = 1;
+
+            m_pass->m_buildAlgorithm = buildAlgorithm;
+            m_gpuContext->m_stagingRing->wait(upload);
+            executePass();
+        }
+        std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+        return static_cast<double>(std::chrono::duration_cast<std::chrono::microseconds>(end - begin).count()) * std::pow(10, -3);
+    }
+
+    LBVHBuilder::BuildHandle LBVHBuilder::buildAsync(const std::vector<Element> &elements, const std::vector<ComputePass::SemaphoreWait> &waits) {
+        const auto numElements = static_cast<uint32_t>(elements.size());
+        if (numElements < 2) {
+            throw std::runtime_error("The LBVH has to contain at least two elements!");
+        }
+
+        reserve(numElements);
+        finishBuild(); // the previous build reads the elements buffer
+        const StagingRing::TransferHandle upload = m_elementsBuffer->uploadAsync(elements.data(), static_cast<uint32_t>(numElements * sizeof(Element)));
+        m_gpuContext->m_stagingRing->submit();
+
+        // the first dispatch waits for the upload on the GPU instead of the host
+        std::vector<ComputePass::SemaphoreWait> buildWaits = waits;
+        if (upload.m_batchId != 0) {
+            buildWaits.push_back({m_gpuContext->m_stagingRing->getTimelineSemaphore(), upload.m_batchId});
+        }
+        return buildAsync(numElements, buildWaits);
+    }
+
+    LBVHBuilder::BuildHandle LBVHBuilder::buildAsync(uint32_t numElements, const std::vector<ComputePass::SemaphoreWait> &waits) {
+        if (numElements < 2) {
+            throw std::runtime_error("The LBVH has to contain at least two elements!");
+        }
+        if (numElements > m_capacity) {
+            throw std::runtime_error("The elements exceed the capacity of the builder, see LBVHBuilder::reserve!");
+        }
+        if (m_pass->m_wideBVH || m_pass->m_collapseLeaves) {
+            throw std::runtime_error("The wide BVH and the leaf collapse are not supported by the asynchronous build, see LBVHBuilder::build!");
+        }
+
+        finishBuild();
+        reservePostBuild();
+        if (numElements != m_numElements) {
+            setNumElements(numElements);
+        }
+        m_numLBVHs = 1;
+        m_pass->m_buildAlgorithm = LBVHPass::KARRAS;
+        m_pass->m_recordMode = LBVHPass::BUILD;
+        m_pendingBuild.m_value = m_pass->submit(waits);
+        return m_pendingBuild;
+    }
+
+    double LBVHBuilder::buildBatch(const std::vector<Element> &elements, std::vector<LBVHSegment> &segments) {
+        std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+        wait(buildBatchAsync(elements, segments));
+        std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+        return static_cast<double>(std::chrono::duration_cast<std::chrono::microseconds>(end - begin).count()) * std::pow(10, -3);
+    }
+
+    LBVHBuilder::BuildHandle LBVHBuilder::buildBatchAsync(const std::vector<Element> &elements, std::vector<LBVHSegment> &segments, const std::vector<ComputePass::SemaphoreWait> &waits) {
+        const auto numElements = static_cast<uint32_t>(elements.size());
+        const auto numSegments = static_cast<uint32_t>(segments.size());
+        if (numSegments == 0) {
+            throw std::runtime_error("The batch has to contain at least one segment!");
+        }
+        // the LBVHs are stored in the order of the segments, every LBVH has 2 * numElements - 1 nodes
+        uint32_t elementOffset = 0;
+        for (uint32_t segmentIdx = 0; segmentIdx < numSegments; segmentIdx++) {
+            LBVHSegment &segment = segments[segmentIdx];
+            if (segment.elementOffset != elementOffset || segment.numElements == 0 || segment.numElements > numElements - elementOffset) {
+                throw std::runtime_error("The segments have to cover the elements in order with at least one element per segment!");
+            }
+            segment.nodeOffset = 2 * elementOffset - segmentIdx;
+            elementOffset += segment.numElements;
+        }
+        if (elementOffset != numElements) {
+            throw std::runtime_error("The segments have to cover the elements in order with at least one element per segment!");
+        }
+        const uint32_t codeBits = getBatchCodeBits(numSegments);
+
+        reserve(numElements);
+        reserveSegments(numSegments);
+        finishBuild(); // the previous build reads the elements and segments buffers
+        m_elementsBuffer->uploadAsync(elements.data(), static_cast<uint32_t>(numElements * sizeof(Element)));
+        const StagingRing::TransferHandle upload = m_segmentsBuffer->uploadAsync(segments.data(), static_cast<uint32_t>(numSegments * sizeof(LBVHSegment)));
+        m_gpuContext->m_stagingRing->submit();
+
+        // the first dispatch waits for the uploads on the GPU instead of the host (the batch of the segments contains the elements or follows the batch of the elements)
+        std::vector<ComputePass::SemaphoreWait> buildWaits = waits;
+        if (upload.m_batchId != 0) {
+            buildWaits.push_back({m_gpuContext->m_stagingRing->getTimelineSemaphore(), upload.m_batchId});
+        }
+
+        if (numElements != m_numElements) {
+            setNumElements(numElements);
+        }
+        const uint32_t maxWorkGroups = m_gpuContext->m_deviceProperties.limits.maxComputeWorkGroupCount[0];
+        m_pass->setGlobalInvocationSize(LBVHPass::SEGMENTED_MORTON_CODES, std::min(numSegments, maxWorkGroups) * LBVH::SEGMENTED_WORKGROUP_SIZE, 1, 1);
+        m_pass->setGlobalInvocationSize(LBVHPass::SEGMENTED_HIERARCHY, numElements, 1, 1);
+        m_pass->setGlobalInvocationSize(LBVHPass::SEGMENTED_BOUNDING_BOXES, numElements, 1, 1);
+        m_pass->m_pushConstantsSegmented = {.g_num_elements = numElements, .g_num_segments = numSegments, .g_code_bits = codeBits, .g_absolute_pointers = m_absolutePointers};
+
+        m_numLBVHs = numSegments;
+        m_pass->m_recordMode = LBVHPass::BATCH_BUILD;
+        m_pendingBuild.m_value = m_pass->submit(buildWaits);
+        m_pass->m_recordMode = LBVHPass::BUILD;
+        return m_pendingBuild;
+    }
+
+    uint32_t LBVHBuilder::getBatchCodeBits(uint32_t numSegments) const {
+        // the segment index is stored above the morton code in the sort key, i.e. the more segments the less bits per axis
+        uint32_t segmentBits = 0;
+        while (segmentBits < 32 && (1ull << segmentBits) < numSegments) {
+            segmentBits++;
+        }
+        const uint32_t keyBits = m_mortonCodes64 ? 64 : 32;
+        const uint32_t codeBits = std::min(m_mortonCodes64 ? 63u : 30u, (keyBits - segmentBits) / 3 * 3);
+        if (codeBits < 3) {
+            throw std::runtime_error("Too many segments for the sort key of the batched build, use 63-bit morton codes!");
+        }
+        return codeBits;
+    }
+
+    void LBVHBuilder::reserveSegments(uint32_t numSegments) {
+        if (numSegments <= m_segmentsCapacity) {
+            return;
+        }
+        finishBuild();
+        if (m_segmentsBuffer) {
+            m_segmentsBuffer->release();
+        }
+        m_segmentsCapacity = std::max(numSegments, GROWTH_FACTOR * m_segmentsCapacity);
+        auto settingsSegments = Buffer::BufferSettings{.m_sizeBytes = static_cast<uint32_t>(m_segmentsCapacity * sizeof(LBVHSegment)), .m_bufferUsages = VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, .m_memoryProperties = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, .m_name = "lbvhBuilder.segmentsBuffer"};
+        m_segmentsBuffer = std::make_shared<Buffer>(m_gpuContext, settingsSegments);
+        m_pass->setStorageBuffer(3, 19, m_segmentsBuffer.get());
+    }
+
+    void LBVHBuilder::reservePostBuild() {
+        if (!m_pass->m_wideBVH && !m_pass->m_compressedNodes && !m_pass->m_collapseLeaves) {
+            return;
+        }
+        if (m_postBuildCapacity == m_capacity) {
+            return;
+        }
+        finishBuild();
+        releasePostBuildBuffers();
+        m_postBuildCapacity = m_capacity;
+        const uint32_t NUM_LBVH_ELEMENTS = 2 * m_capacity - 1;
+
+        // every internal wide node has at least two children, i.e. at most ceil((capacity - 1) / (wideBVHWidth - 1)) wide nodes are created
+        const uint32_t NUM_WIDE_NODES = std::max(1u, (m_capacity - 1 + m_wideBVHWidth - 2) / (m_wideBVHWidth - 1)) + m_capacity / 2;
+        auto settingsWideLBVH = Buffer::BufferSettings{.m_sizeBytes = static_cast<uint32_t>(NUM_WIDE_NODES * LBVH::getWideNodeSizeBytes(m_wideBVHWidth)), .m_bufferUsages = VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, .m_memoryProperties = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, .m_name = "lbvhBuilder.wideLBVHBuffer"};
+        m_wideLBVHBuffer = std::make_shared<Buffer>(m_gpuContext, settingsWideLBVH);
+
+        auto settingsWideToBinary = Buffer::BufferSettings{.m_sizeBytes = static_cast<uint32_t>(NUM_WIDE_NODES * sizeof(uint32_t)), .m_bufferUsages = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, .m_memoryProperties = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, .m_name = "lbvhBuilder.wideToBinaryBuffer"};
+        m_wideToBinaryBuffer = std::make_shared<Buffer>(m_gpuContext, settingsWideToBinary);
+
+        auto settingsWideState = Buffer::BufferSettings{.m_sizeBytes = sizeof(LBVH::LBVHWideState), .m_bufferUsages = VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT, .m_memoryProperties = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, .m_name = "lbvhBuilder.wideStateBuffer"};
+        m_wideStateBuffer = std::make_shared<Buffer>(m_gpuContext, settingsWideState);
+
+        auto settingsCompressedLBVH = Buffer::BufferSettings{.m_sizeBytes = static_cast<uint32_t>((m_capacity - 1) * LBVH::getCompressedNodeSizeBytes(m_compressedNodeBits)), .m_bufferUsages = VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, .m_memoryProperties = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, .m_name = "lbvhBuilder.compressedLBVHBuffer"};
+        m_compressedLBVHBuffer = std::make_shared<Buffer>(m_gpuContext, settingsCompressedLBVH);
+
+        auto settingsCollapseInfos = Buffer::BufferSettings{.m_sizeBytes = static_cast<uint32_t>(NUM_LBVH_ELEMENTS * sizeof(LBVH::LBVHCollapseInfo)), .m_bufferUsages = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, .m_memoryProperties = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, .m_name = "lbvhBuilder.collapseInfosBuffer"};
+        m_collapseInfosBuffer = std::make_shared<Buffer>(m_gpuContext, settingsCollapseInfos);
+
+        // the collapsed LBVH has at most as many nodes as the LBVH
+        auto settingsCollapsedLBVH = Buffer::BufferSettings{.m_sizeBytes = static_cast<uint32_t>(NUM_LBVH_ELEMENTS * sizeof(LBVH::LBVHCollapsedNode)), .m_bufferUsages = VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, .m_memoryProperties = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, .m_name = "lbvhBuilder.collapsedLBVHBuffer"};
+        m_collapsedLBVHBuffer = std::make_shared<Buffer>(m_gpuContext, settingsCollapsedLBVH);
+
+        auto settingsCollapsedToBinary = Buffer::BufferSettings{.m_sizeBytes = static_cast<uint32_t>(NUM_LBVH_ELEMENTS * sizeof(uint32_t)), .m_bufferUsages = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, .m_memoryProperties = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, .m_name = "lbvhBuilder.collapsedToBinaryBuffer"};
+        m_collapsedToBinaryBuffer = std::make_shared<Buffer>(m_gpuContext, settingsCollapsedToBinary);
+
+        auto settingsCollapsedPrimitiveIndices = Buffer::BufferSettings{.m_sizeBytes = static_cast<uint32_t>(m_capacity * sizeof(uint32_t)), .m_bufferUsages = VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, .m_memoryProperties = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, .m_name = "lbvhBuilder.collapsedPrimitiveIndicesBuffer"};
+        m_collapsedPrimitiveIndicesBuffer = std::make_shared<Buffer>(m_gpuContext, settingsCollapsedPrimitiveIndices);
+
+        auto settingsCollapseState = Buffer::BufferSettings{.m_sizeBytes = sizeof(LBVH::LBVHCollapseState), .m_bufferUsages = VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT, .m_memoryProperties = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, .m_name = "lbvhBuilder.collapseStateBuffer"};
+        m_collapseStateBuffer = std::make_shared<Buffer>(m_gpuContext, settingsCollapseState);
+
+        m_pass->setStorageBuffer(3, 10, m_wideLBVHBuffer.get());
+        m_pass->setStorageBuffer(3, 11, m_wideToBinaryBuffer.get());
+        m_pass->setWideStateBuffer(m_wideStateBuffer.get()); // (3, 12)
+        m_pass->setStorageBuffer(3, 13, m_compressedLBVHBuffer.get());
+        m_pass->setStorageBuffer(3, 14, m_collapseInfosBuffer.get());
+        m_pass->setStorageBuffer(3, 15, m_collapsedLBVHBuffer.get());
+        m_pass->setStorageBuffer(3, 16, m_collapsedToBinaryBuffer.get());
+        m_pass->setStorageBuffer(3, 17, m_collapsedPrimitiveIndicesBuffer.get());
+        m_pass->setCollapseStateBuffer(m_collapseStateBuffer.get()); // (3, 18)
+    }
+
+    void LBVHBuilder::releasePostBuildBuffers() {
+        if (m_postBuildCapacity == 0) {
+            return;
+        }
+        m_wideLBVHBuffer->release();
+        m_wideToBinaryBuffer->release();
+        m_wideStateBuffer->release();
+        m_compressedLBVHBuffer->release();
+        m_collapseInfosBuffer->release();
+        m_collapsedLBVHBuffer->release();
+        m_collapsedToBinaryBuffer->release();
+        m_collapsedPrimitiveIndicesBuffer->release();
+        m_collapseStateBuffer->release();
+        m_wideLBVHBuffer = nullptr;
+        m_wideToBinaryBuffer = nullptr;
+        m_wideStateBuffer = nullptr;
+        m_compressedLBVHBuffer = nullptr;
+        m_collapseInfosBuffer = nullptr;
+        m_collapsedLBVHBuffer = nullptr;
+        m_collapsedToBinaryBuffer = nullptr;
+        m_collapsedPrimitiveIndicesBuffer = nullptr;
+        m_collapseStateBuffer = nullptr;
+        m_postBuildCapacity = 0;
+    }
+
+    void LBVHBuilder::wait(BuildHandle handle) {
+        // older builds of this builder finished before the next build was submitted
+        if (handle.m_value != 0 && handle.m_value == m_pendingBuild.m_value) {
+            finishBuild();
+        }
+    }
+
+    void LBVHBuilder::reserve(uint32_t numElements) {
+        if (numElements <= m_capacity) {
+            return;
+        }
+        finishBuild();
+        releaseBuffers();
+        createBuffers(std::max(numElements, std::min(GROWTH_FACTOR * m_capacity, getMaxCapacity())));
+        m_numReallocations++;
+    }
+
+    void LBVHBuilder::finishBuild() {
+        if (m_pendingBuild.m_value == 0) {
+            return;
+        }
+        m_pass->wait(m_pendingBuild.m_value);
+        m_pass->resetStageTimes();
+        m_pass->accumulateStageTimes();
+        m_pendingBuild = {};
+    }
+
+    double LBVHBuilder::refit(const std::vector<Element> &elements) {
+        if (m_numLBVHs != 1) {
+            throw std::runtime_error("The refit of a batched build is not supported!");
+        }
+        if (elements.size() != m_numElements) {
+            throw std::runtime_error("The refit requires the same number of elements as the last build!");
+        }
+
+        std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+        finishBuild();
+        reservePostBuild(); // the refit records the compression if it is enabled
+        m_elementsBuffer->uploadWithStagingBuffer(const_cast<Element *>(elements.data()), static_cast<uint32_t>(m_numElements * sizeof(Element)));
+
+        m_pass->m_recordMode = LBVHPass::REFIT;
+        executePass();
+        m_pass->m_recordMode = LBVHPass::BUILD;
+        std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+        return static_cast<double>(std::chrono::duration_cast<std::chrono::microseconds>(end - begin).count()) * std::pow(10, -3);
+    }
+
+    void LBVHBuilder::downloadLBVH(std::vector<LBVHNode> &LBVH) {
+        finishBuild();
+        LBVH.resize(2 * m_numElements - m_numLBVHs);
+        m_LBVHBuffer->downloadWithStagingBuffer(LBVH.data(), static_cast<uint32_t>(LBVH.size() * sizeof(LBVHNode)));
+    }
+
+    uint32_t LBVHBuilder::getMaxCapacity() const {
+        // the LBVH (2 * capacity - 1 nodes) is the largest buffer
+        const uint64_t maxNodes = m_gpuContext->m_deviceProperties.limits.maxStorageBufferRange / sizeof(LBVHNode);
+        return static_cast<uint32_t>(std::min<uint64_t>((maxNodes + 1) / 2, std::numeric_limits<uint32_t>::max() / sizeof(LBVHNode) / 2));
+    }
+
+    uint64_t LBVHBuilder::getDeviceMemoryBytes() const {
+        uint64_t sizeBytes = 0;
+        for (const auto &buffer: {m_elementsBuffer, m_extentBuffer, m_mortonCodeBuffer, m_mortonCodePingPongBuffer, m_radixSortHistogramsBuffer, m_LBVHBuffer, m_LBVHConstructionInfoBuffer, m_SAHCostBuffer, m_PLOCClustersBuffer, m_PLOCMergedClustersBuffer, m_PLOCNearestNeighboursBuffer, m_PLOCBlockCountsBuffer, m_PLOCStateBuffer, m_segmentsBuffer,
+                                   m_wideLBVHBuffer, m_wideToBinaryBuffer, m_wideStateBuffer, m_compressedLBVHBuffer, m_collapseInfosBuffer, m_collapsedLBVHBuffer, m_collapsedToBinaryBuffer, m_collapsedPrimitiveIndicesBuffer, m_collapseStateBuffer}) {
+            sizeBytes += buffer ? buffer->getSizeBytes() : 0;
+        }
+        return sizeBytes;
+    }
+
+    double LBVHBuilder::downloadSAHCost() {
+        if (m_numLBVHs != 1) {
+            throw std::runtime_error("The SAH cost of a batched build is not calculated!");
+        }
+        finishBuild();
+        // only the partial costs of the work groups of the last build, the buffer is allocated for the capacity
+        std::vector<float> partialSAHCosts((2 * m_numElements - 1 + LBVH::SAH_COST_NODES_PER_WORKGROUP - 1) / LBVH::SAH_COST_NODES_PER_WORKGROUP);
+        m_SAHCostBuffer->downloadWithStagingBuffer(partialSAHCosts.data(), static_cast<uint32_t>(partialSAHCosts.size() * sizeof(float)));
+        double sahCost = 0;
+        for (const auto &partialSAHCost: partialSAHCosts) {
+            sahCost += partialSAHCost;
+        }
+        return sahCost;
+    }
+
+    void LBVHBuilder::createBuffers(uint32_t capacity) {
+        m_capacity = capacity;
+        const uint32_t NUM_LBVH_ELEMENTS = 2 * capacity - 1;
+        const uint32_t NUM_RADIX_SORT_WORKGROUPS = (capacity + LBVH::RADIX_SORT_ELEMENTS_PER_WORKGROUP - 1) / LBVH::RADIX_SORT_ELEMENTS_PER_WORKGROUP;
+        const uint32_t NUM_SAH_COST_WORKGROUPS = (NUM_LBVH_ELEMENTS + LBVH::SAH_COST_NODES_PER_WORKGROUP - 1) / LBVH::SAH_COST_NODES_PER_WORKGROUP;
+        const uint32_t NUM_PLOC_BLOCKS = (capacity + m_pass->getWorkGroupSize() - 1) / m_pass->getWorkGroupSize(); // one block count per work group of the specialized PLOC stages
+        const uint32_t MORTON_CODE_ELEMENT_SIZE = m_mortonCodes64 ? sizeof(LBVH::MortonCodeElement64) : sizeof(LBVH::MortonCodeElement);
+
+        auto settingsElement = Buffer::BufferSettings{.m_sizeBytes = static_cast<uint32_t>(capacity * sizeof(Element)), .m_bufferUsages = VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, .m_memoryProperties = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, .m_name = "lbvhBuilder.elementsBuffer"};
+        m_elementsBuffer = std::make_shared<Buffer>(m_gpuContext, settingsElement);
+
+        auto settingsExtent = Buffer::BufferSettings{.m_sizeBytes = sizeof(LBVH::LBVHExtent), .m_bufferUsages = VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, .m_memoryProperties = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, .m_name = "lbvhBuilder.extentBuffer"};
+        m_extentBuffer = std::make_shared<Buffer>(m_gpuContext, settingsExtent);
+
+        auto settingsMortonCode = Buffer::BufferSettings{.m_sizeBytes = capacity * MORTON_CODE_ELEMENT_SIZE, .m_bufferUsages = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, .m_memoryProperties = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, .m_name = "lbvhBuilder.mortonCodeBuffer"};
+        m_mortonCodeBuffer = std::make_shared<Buffer>(m_gpuContext, settingsMortonCode);
+
+        auto settingsMortonCodePingPong = Buffer::BufferSettings{.m_sizeBytes = capacity * MORTON_CODE_ELEMENT_SIZE, .m_bufferUsages = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, .m_memoryProperties = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, .m_name = "lbvhBuilder.mortonCodePingPongBuffer"};
+        m_mortonCodePingPongBuffer = std::make_shared<Buffer>(m_gpuContext, settingsMortonCodePingPong);
+
+        auto settingsRadixSortHistograms = Buffer::BufferSettings{.m_sizeBytes = static_cast<uint32_t>((NUM_RADIX_SORT_WORKGROUPS + 1) * LBVH::RADIX_SORT_BINS * sizeof(uint32_t)), .m_bufferUsages = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, .m_memoryProperties = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, .m_name = "lbvhBuilder.radixSortHistogramsBuffer"};
+        m_radixSortHistogramsBuffer = std::make_shared<Buffer>(m_gpuContext, settingsRadixSortHistograms);
+
+        auto settingsLBVH = Buffer::BufferSettings{.m_sizeBytes = static_cast<uint32_t>(NUM_LBVH_ELEMENTS * sizeof(LBVHNode)), .m_bufferUsages = VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, .m_memoryProperties = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, .m_name = "lbvhBuilder.LBVHBuffer"};
+        m_LBVHBuffer = std::make_shared<Buffer>(m_gpuContext, settingsLBVH);
+
+        auto settingsLBVHConstructionInfo = Buffer::BufferSettings{.m_sizeBytes = static_cast<uint32_t>(NUM_LBVH_ELEMENTS * sizeof(LBVH::LBVHConstructionInfo)), .m_bufferUsages = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, .m_memoryProperties = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, .m_name = "lbvhBuilder.LBVHConstructionInfoBuffer"};
+        m_LBVHConstructionInfoBuffer = std::make_shared<Buffer>(m_gpuContext, settingsLBVHConstructionInfo);
+
+        auto settingsSAHCost = Buffer::BufferSettings{.m_sizeBytes = static_cast<uint32_t>(NUM_SAH_COST_WORKGROUPS * sizeof(float)), .m_bufferUsages = VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, .m_memoryProperties = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, .m_name = "lbvhBuilder.SAHCostBuffer"};
+        m_SAHCostBuffer = std::make_shared<Buffer>(m_gpuContext, settingsSAHCost);
+
+        auto settingsPLOCClusters = Buffer::BufferSettings{.m_sizeBytes = static_cast<uint32_t>(capacity * sizeof(uint32_t)), .m_bufferUsages = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, .m_memoryProperties = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, .m_name = "lbvhBuilder.PLOCClustersBuffer"};
+        m_PLOCClustersBuffer = std::make_shared<Buffer>(m_gpuContext, settingsPLOCClusters);
+
+        auto settingsPLOCMergedClusters = Buffer::BufferSettings{.m_sizeBytes = static_cast<uint32_t>(capacity * sizeof(uint32_t)), .m_bufferUsages = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, .m_memoryProperties = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, .m_name = "lbvhBuilder.PLOCMergedClustersBuffer"};
+        m_PLOCMergedClustersBuffer = std::make_shared<Buffer>(m_gpuContext, settingsPLOCMergedClusters);
+
+        auto settingsPLOCNearestNeighbours = Buffer::BufferSettings{.m_sizeBytes = static_cast<uint32_t>(capacity * sizeof(uint32_t)), .m_bufferUsages = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, .m_memoryProperties = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, .m_name = "lbvhBuilder.PLOCNearestNeighboursBuffer"};
+        m_PLOCNearestNeighboursBuffer = std::make_shared<Buffer>(m_gpuContext, settingsPLOCNearestNeighbours);
+
+        auto settingsPLOCBlockCounts = Buffer::BufferSettings{.m_sizeBytes = static_cast<uint32_t>(NUM_PLOC_BLOCKS * sizeof(uint32_t)), .m_bufferUsages = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, .m_memoryProperties = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, .m_name = "lbvhBuilder.PLOCBlockCountsBuffer"};
+        m_PLOCBlockCountsBuffer = std::make_shared<Buffer>(m_gpuContext, settingsPLOCBlockCounts);
+
+        auto settingsPLOCState = Buffer::BufferSettings{.m_sizeBytes = sizeof(LBVH::PLOCState), .m_bufferUsages = VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT, .m_memoryProperties = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, .m_name = "lbvhBuilder.PLOCStateBuffer"};
+        m_PLOCStateBuffer = std::make_shared<Buffer>(m_gpuContext, settingsPLOCState);
+
+        // the descriptor sets of the pass are kept, only the bindings are updated
+        m_pass->setStorageBuffer(0, 0, m_mortonCodeBuffer.get());
+        m_pass->setStorageBuffer(0, 1, m_elementsBuffer.get());
+        m_pass->setExtentBuffer(m_extentBuffer.get()); // (0, 2)
+        m_pass->setStorageBuffer(1, 0, m_mortonCodeBuffer.get());
+        m_pass->setStorageBuffer(1, 1, m_mortonCodePingPongBuffer.get());
+        m_pass->setStorageBuffer(1, 2, m_radixSortHistogramsBuffer.get());
+        m_pass->setStorageBuffer(2, 0, m_mortonCodeBuffer.get());
+        m_pass->setStorageBuffer(2, 1, m_elementsBuffer.get());
+        m_pass->setStorageBuffer(2, 2, m_LBVHBuffer.get());
+        m_pass->setStorageBuffer(2, 3, m_LBVHConstructionInfoBuffer.get());
+        m_pass->setStorageBuffer(3, 0, m_LBVHBuffer.get());
+        m_pass->setStorageBuffer(3, 1, m_LBVHConstructionInfoBuffer.get());
+        m_pass->setStorageBuffer(3, 2, m_SAHCostBuffer.get());
+        m_pass->setStorageBuffer(3, 3, m_mortonCodeBuffer.get());
+        m_pass->setStorageBuffer(3, 4, m_elementsBuffer.get());
+        m_pass->setStorageBuffer(3, 5, m_PLOCClustersBuffer.get());
+        m_pass->setStorageBuffer(3, 6, m_PLOCMergedClustersBuffer.get());
+        m_pass->setStorageBuffer(3, 7, m_PLOCNearestNeighboursBuffer.get());
+        m_pass->setStorageBuffer(3, 8, m_PLOCBlockCountsBuffer.get());
+        m_pass->setPLOCStateBuffer(m_PLOCStateBuffer.get()); // (3, 9)
+    }
+
+    void LBVHBuilder::releaseBuffers() {
+        m_elementsBuffer->release();
+        m_extentBuffer->release();
+        m_mortonCodeBuffer->release();
+        m_mortonCodePingPongBuffer->release();
+        m_radixSortHistogramsBuffer->release();
+        m_LBVHBuffer->release();
+        m_LBVHConstructionInfoBuffer->release();
+        m_SAHCostBuffer->release();
+        m_PLOCClustersBuffer->release();
+        m_PLOCMergedClustersBuffer->release();
+        m_PLOCNearestNeighboursBuffer->release();
+        m_PLOCBlockCountsBuffer->release();
+        m_PLOCStateBuffer->release();
+    }
+
+    void LBVHBuilder::setNumElements(uint32_t numElements) {
+        m_numElements = numElements;
+        const uint32_t NUM_LBVH_ELEMENTS = 2 * numElements - 1;
+        const uint32_t NUM_RADIX_SORT_WORKGROUPS = (numElements + LBVH::RADIX_SORT_ELEMENTS_PER_WORKGROUP - 1) / LBVH::RADIX_SORT_ELEMENTS_PER_WORKGROUP;
+        const uint32_t NUM_SAH_COST_WORKGROUPS = (NUM_LBVH_ELEMENTS + LBVH::SAH_COST_NODES_PER_WORKGROUP - 1) / LBVH::SAH_COST_NODES_PER_WORKGROUP;
+
+        m_pass->setGlobalInvocationSize(LBVHPass::EXTENT, (numElements + LBVH::EXTENT_ELEMENTS_PER_THREAD - 1) / LBVH::EXTENT_ELEMENTS_PER_THREAD, 1, 1);
+        m_pass->setGlobalInvocationSize(LBVHPass::MORTON_CODES, numElements, 1, 1);
+        m_pass->setGlobalInvocationSize(LBVHPass::RADIX_SORT, 256, 1, 1);
+        m_pass->setGlobalInvocationSize(LBVHPass::MULTI_RADIX_SORT_HISTOGRAMS, NUM_RADIX_SORT_WORKGROUPS * LBVH::RADIX_SORT_WORKGROUP_SIZE, 1, 1);
+        m_pass->setGlobalInvocationSize(LBVHPass::MULTI_RADIX_SORT_SCAN, LBVH::RADIX_SORT_BINS * LBVH::RADIX_SORT_WORKGROUP_SIZE, 1, 1); // one work group per bin
+        m_pass->setGlobalInvocationSize(LBVHPass::MULTI_RADIX_SORT, NUM_RADIX_SORT_WORKGROUPS * LBVH::RADIX_SORT_WORKGROUP_SIZE, 1, 1);
+        m_pass->m_multiRadixSort = numElements > LBVH::SINGLE_RADIX_SORT_THRESHOLD;
+        m_pass->setGlobalInvocationSize(LBVHPass::HIERARCHY, numElements, 1, 1);
+        m_pass->setGlobalInvocationSize(LBVHPass::BOUNDING_BOXES, numElements, 1, 1);
+        m_pass->setGlobalInvocationSize(LBVHPass::REFIT_LEAVES, numElements, 1, 1);
+        m_pass->setGlobalInvocationSize(LBVHPass::SAH_COST, NUM_SAH_COST_WORKGROUPS * LBVH::SAH_COST_WORKGROUP_SIZE, 1, 1);
+        m_pass->setGlobalInvocationSize(LBVHPass::TREELET_INIT, numElements, 1, 1);
+        m_pass->setGlobalInvocationSize(LBVHPass::TREELET_RESTRUCTURE, numElements, 1, 1);
+        m_pass->setGlobalInvocationSize(LBVHPass::PLOC_INIT, numElements, 1, 1);
+        m_pass->setGlobalInvocationSize(LBVHPass::PLOC_SCAN, m_pass->getWorkGroupSize(), 1, 1); // single work group, PLOC_NEAREST_NEIGHBOUR, PLOC_MERGE and PLOC_COMPACT are dispatched indirectly
+        m_pass->setGlobalInvocationSize(LBVHPass::WIDE_INIT, 1, 1, 1);
+        m_pass->setGlobalInvocationSize(LBVHPass::WIDE_UPDATE, 1, 1, 1); // WIDE_COLLAPSE is dispatched indirectly
+        m_pass->setGlobalInvocationSize(LBVHPass::COMPRESS, numElements - 1, 1, 1);
+        m_pass->setGlobalInvocationSize(LBVHPass::COLLAPSE_COST, numElements, 1, 1);
+        m_pass->setGlobalInvocationSize(LBVHPass::COLLAPSE_INIT, 1, 1, 1);
+        m_pass->setGlobalInvocationSize(LBVHPass::COLLAPSE_UPDATE, 1, 1, 1); // COLLAPSE_EMIT is dispatched indirectly
+
+        m_pass->m_pushConstantsExtent.g_num_elements = numElements;
+        m_pass->m_pushConstantsMortonCodes.g_num_elements = numElements;
+        m_pass->m_pushConstantsRadixSort.g_num_elements = numElements;
+        m_pass->m_pushConstantsMultiRadixSort.g_num_elements = numElements;
+        m_pass->m_pushConstantsMultiRadixSort.g_num_workgroups = NUM_RADIX_SORT_WORKGROUPS;
+        m_pass->m_pushConstantsMultiRadixSort.g_num_blocks_per_workgroup = LBVH::RADIX_SORT_BLOCKS_PER_WORKGROUP;
+        m_pass->m_pushConstantsHierarchy.g_num_elements = numElements;
+        m_pass->m_pushConstantsHierarchy.g_absolute_pointers = m_absolutePointers;
+        m_pass->m_pushConstantsBoundingBoxes.g_num_elements = numElements;
+        m_pass->m_pushConstantsBoundingBoxes.g_absolute_pointers = m_absolutePointers;
+        m_pass->m_pushConstantsRefitLeaves.g_num_elements = numElements;
+        m_pass->m_pushConstantsSAHCost.g_num_elements = numElements;
+        m_pass->m_pushConstantsTreelet.g_num_elements = numElements;
+        m_pass->m_pushConstantsTreelet.g_absolute_pointers = m_absolutePointers;
+        m_pass->m_pushConstantsPLOC.g_num_elements = numElements;
+        m_pass->m_pushConstantsPLOC.g_absolute_pointers = m_absolutePointers;
+        m_pass->m_pushConstantsWide.g_num_elements = numElements;
+        m_pass->m_pushConstantsWide.g_absolute_pointers = m_absolutePointers;
+        m_pass->m_pushConstantsCompress.g_num_elements = numElements;
+        m_pass->m_pushConstantsCompress.g_absolute_pointers = m_absolutePointers;
+        m_pass->m_pushConstantsCollapse.g_num_elements = numElements;
+        m_pass->m_pushConstantsCollapse.g_absolute_pointers = m_absolutePointers;
+        m_pass->m_pushConstantsCollapse.g_traversal_cost = LBVH::COLLAPSE_TRAVERSAL_COST;
+        m_pass->m_pushConstantsCollapse.g_intersection_cost = LBVH::COLLAPSE_INTERSECTION_COST;
+    }
+
+    double LBVHBuilder::executePass() {
+        std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+        m_pass->resetStageTimes();
+        m_pass->execute(VK_NULL_HANDLE);
+        vkQueueWaitIdle(m_gpuContext->m_queues->getQueue(Queues::COMPUTE));
+        m_pass->accumulateStageTimes();
+        if (m_pass->m_recordMode == LBVHPass::BUILD && m_pass->m_buildAlgorithm == LBVHPass::PLOC) {
+            // the number of PLOC iterations is not known in advance, continue until all clusters are merged
+            LBVH::PLOCState plocState{};
+            m_PLOCStateBuffer->downloadWithStagingBuffer(&plocState);
+            m_pass->m_recordMode = LBVHPass::PLOC_ITERATIONS;
+            while (plocState.numClusters > 1) {
+                const uint32_t numClusters = plocState.numClusters;
+                m_pass->execute(VK_NULL_HANDLE);
+                vkQueueWaitIdle(m_gpuContext->m_queues->getQueue(Queues::COMPUTE));
+                m_pass->accumulateStageTimes();
+                m_PLOCStateBuffer->downloadWithStagingBuffer(&plocState);
+                if (plocState.numClusters >= numClusters) {
+                    throw std::runtime_error("PLOC did not merge any clusters!");
+                }
+            }
+            m_pass->m_recordMode = LBVHPass::POST_BUILD;
+            m_pass->execute(VK_NULL_HANDLE);
+            vkQueueWaitIdle(m_gpuContext->m_queues->getQueue(Queues::COMPUTE));
+            m_pass->accumulateStageTimes();
+            m_pass->m_recordMode = LBVHPass::BUILD;
+        }
+        if (m_pass->m_recordMode == LBVHPass::BUILD && m_pass->m_wideBVH) {
+            // the depth of the wide BVH is not known in advance, continue until the collapse reached the leaves
+            LBVH::LBVHWideState wideState{};
+            m_wideStateBuffer->downloadWithStagingBuffer(&wideState);
+            m_pass->m_recordMode = LBVHPass::WIDE_ITERATIONS;
+            while (wideState.levelBegin < wideState.levelEnd) {
+                m_pass->execute(VK_NULL_HANDLE);
+                vkQueueWaitIdle(m_gpuContext->m_queues->getQueue(Queues::COMPUTE));
+                m_pass->accumulateStageTimes();
+                m_wideStateBuffer->downloadWithStagingBuffer(&wideState);
+            }
+            m_pass->m_recordMode = LBVHPass::BUILD;
+        }
+        if (m_pass->m_recordMode == LBVHPass::BUILD && m_pass->m_collapseLeaves) {
+            // the depth of the collapsed LBVH is not known in advance, continue until all leaves are emitted
+            LBVH::LBVHCollapseState collapseState{};
+            m_collapseStateBuffer->downloadWithStagingBuffer(&collapseState);
+            m_pass->m_recordMode = LBVHPass::COLLAPSE_ITERATIONS;
+            while (collapseState.levelBegin < collapseState.levelEnd) {
+                m_pass->execute(VK_NULL_HANDLE);
+                vkQueueWaitIdle(m_gpuContext->m_queues->getQueue(Queues::COMPUTE));
+                m_pass->accumulateStageTimes();
+                m_collapseStateBuffer->downloadWithStagingBuffer(&collapseState);
+            }
+            m_pass->m_recordMode = LBVHPass::BUILD;
+        }
+        std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+        return static_cast<double>(std::chrono::duration_cast<std::chrono::microseconds>(end - begin).count()) * std::pow(10, -3);
+    }
+} // namespace engine
@@ -0,0 +1,324 @@
+#include "LBVHCPUBuilder.h"
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+
+namespace engine {
+
+    void LBVHCPUBuilder::build(const std::vector<Element> &elements, std::vector<LBVHNode> &LBVH, bool absolutePointers) {
+        const auto numElements = static_cast<uint32_t>(elements.size());
+        if (numElements == 0) {
+            throw std::runtime_error("The LBVH has to contain at least one element!");
+        }
+        LBVH.resize(2 * numElements - 1);
+        m_mortonCodes.resize(numElements);
+        m_elementIndices.resize(numElements);
+        m_mortonCodesPingPong.resize(numElements);
+        m_elementIndicesPingPong.resize(numElements);
+        m_radixSortHistograms.resize(RADIX_SORT_BINS * m_threadPool.getNumThreads());
+        m_parents.resize(2 * numElements - 1);
+        if (m_visitationCountsCapacity < numElements) {
+            m_visitationCounts = std::make_unique<std::atomic<uint32_t>[]>(numElements);
+            m_visitationCountsCapacity = numElements;
+        }
+
+        glm::vec3 extentMin;
+        glm::vec3 extentMax;
+        computeExtent(elements, extentMin, extentMax);
+        computeMortonCodes(elements, extentMin, extentMax);
+        radixSort(numElements);
+        buildHierarchy(elements, LBVH, absolutePointers);
+        buildBoundingBoxes(LBVH, absolutePointers);
+    }
+
+    void LBVHCPUBuilder::computeExtent(const std::vector<Element> &elements, glm::vec3 &extentMin, glm::vec3 &extentMax) {
+        // same as lbvh_extent.comp: the centers are reduced as order-preserving uints, i.e. the result does not depend on the order of the reduction (e.g. -0 and 0)
+        std::vector<std::array<uint32_t, 6>> threadExtents(m_threadPool.getNumThreads(), {0xFFFFFFFFu, 0xFFFFFFFFu, 0xFFFFFFFFu, 0u, 0u, 0u});
+        m_threadPool.parallelFor(elements.size(), [&](uint32_t threadIdx, uint32_t begin, uint32_t end) {
+            uint32_t minX = 0xFFFFFFFFu, minY = 0xFFFFFFFFu, minZ = 0xFFFFFFFFu;
+            uint32_t maxX = 0u, maxY = 0u, maxZ = 0u;
+            ElementBlock block;
+            for (uint32_t blockBegin = begin; blockBegin < end; blockBegin += BLOCK_SIZE) {
+                const uint32_t count = std::min(BLOCK_SIZE, end - blockBegin);
+                loadBlock(elements, blockBegin, count, block);
+                for (uint32_t j = 0; j < count; j++) {
+                    // same center as in lbvh_extent.comp and lbvh_morton_codes.comp
+                    const uint32_t centerX = floatToOrderedUint(block.minX[j] + 0.5f * (block.maxX[j] - block.minX[j]));
+                    const uint32_t centerY = floatToOrderedUint(block.minY[j] + 0.5f * (block.maxY[j] - block.minY[j]));
+                    const uint32_t centerZ = floatToOrderedUint(block.minZ[j] + 0.5f * (block.maxZ[j] - block.minZ[j]));
+                    minX = std::min(minX, centerX);
+                    minY = std::min(minY, centerY);
+                    minZ = std::min(minZ, centerZ);
+                    maxX = std::max(maxX, centerX);
+                    maxY = std::max(maxY, centerY);
+                    maxZ = std::max(maxZ, centerZ);
+                }
+            }
+            threadExtents[threadIdx] = {minX, minY, minZ, maxX, maxY, maxZ};
+        });
+        std::array<uint32_t, 6> extent = threadExtents[0];
+        for (uint32_t t = 1; t < m_threadPool.getNumThreads(); t++) {
+            for (uint32_t i = 0; i < 3; i++) {
+                extent[i] = std::min(extent[i], threadExtents[t][i]);
+                extent[3 + i] = std::max(extent[3 + i], threadExtents[t][3 + i]);
+            }
+        }
+        extentMin = glm::vec3(orderedUintToFloat(extent[0]), orderedUintToFloat(extent[1]), orderedUintToFloat(extent[2]));
+        extentMax = glm::vec3(orderedUintToFloat(extent[3]), orderedUintToFloat(extent[4]), orderedUintToFloat(extent[5]));
+    }
+
+    void LBVHCPUBuilder::computeMortonCodes(const std::vector<Element> &elements, const glm::vec3 &extentMin, const glm::vec3 &extentMax) {
+        // same computation as in lbvh_morton_codes.comp (lbvhcpu is compiled without floating point contraction, i.e. no FMA)
+        const float sizeX = std::max(extentMax.x - extentMin.x, 1e-30f);
+        const float sizeY = std::max(extentMax.y - extentMin.y, 1e-30f);
+        const float sizeZ = std::max(extentMax.z - extentMin.z, 1e-30f);
+        // one loop per morton code width, i.e. the width is not selected per element
+        const auto computeCodes = [&](auto expand, float scale, float maxValue) {
+            m_threadPool.parallelFor(elements.size(), [&](uint32_t, uint32_t begin, uint32_t end) {
+                ElementBlock block;
+                for (uint32_t blockBegin = begin; blockBegin < end; blockBegin += BLOCK_SIZE) {
+                    const uint32_t count = std::min(BLOCK_SIZE, end - blockBegin);
+                    loadBlock(elements, blockBegin, count, block);
+                    uint64_t *mortonCodes = m_mortonCodes.data() + blockBegin;
+                    uint32_t *elementIndices = m_elementIndices.data() + blockBegin;
+                    // branch-free, vectorized by the compiler (checked with -fopt-info-vec)
+                    for (uint32_t j = 0; j < count; j++) {
+                        const uint32_t x = quantize(block.minX[j] + 0.5f * (block.maxX[j] - block.minX[j]) - extentMin.x, sizeX, scale, maxValue);
+                        const uint32_t y = quantize(block.minY[j] + 0.5f * (block.maxY[j] - block.minY[j]) - extentMin.y, sizeY, scale, maxValue);
+                        const uint32_t z = quantize(block.minZ[j] + 0.5f * (block.maxZ[j] - block.minZ[j]) - extentMin.z, sizeZ, scale, maxValue);
+                        mortonCodes[j] = expand(x) * 4 + expand(y) * 2 + expand(z);
+                        elementIndices[j] = blockBegin + j;
+                    }
+                }
+            });
+        };
+        if (m_mortonCodes64) {
+            computeCodes([](uint32_t v) { return expandBits64(v); }, 2097152.0f, 2097151.0f);
+        } else {
+            computeCodes([](uint32_t v) { return static_cast<uint64_t>(expandBits(v)); }, 1024.0f, 1023.0f);
+        }
+    }
+
+    void LBVHCPUBuilder::radixSort(uint32_t numElements) {
+        // parallel stable LSD radix sort: per pass, each thread counts the digits of its chunk, the prefix sum over (digit, thread) gives the scatter offsets
+        const uint32_t numThreads = m_threadPool.getNumThreads();
+        const uint32_t numBits = m_mortonCodes64 ? 63 : 30;
+        for (uint32_t shift = 0; shift < numBits; shift += RADIX_SORT_BITS_PER_PASS) {
+            // threads with an empty chunk are not called, i.e. their histograms have to be reset here
+            std::fill(m_radixSortHistograms.begin(), m_radixSortHistograms.end(), 0);
+            m_threadPool.parallelFor(numElements, [&](uint32_t threadIdx, uint32_t begin, uint32_t end) {
+                uint32_t *histogram = &m_radixSortHistograms[threadIdx * RADIX_SORT_BINS];
+                for (uint32_t i = begin; i < end; i++) {
+                    histogram[(m_mortonCodes[i] >> shift) & (RADIX_SORT_BINS - 1)]++;
+                }
+            });
+
+            // skip the pass if all elements have the same digit
+            bool singleDigit = false;
+            uint32_t offset = 0;
+            for (uint32_t digit = 0; digit < RADIX_SORT_BINS; digit++) {
+                uint32_t digitCount = 0;
+                for (uint32_t t = 0; t < numThreads; t++) {
+                    const uint32_t count = m_radixSortHistograms[t * RADIX_SORT_BINS + digit];
+                    m_radixSortHistograms[t * RADIX_SORT_BINS + digit] = offset;
+                    offset += count;
+                    digitCount += count;
+                }
+                singleDigit |= digitCount == numElements;
+            }
+            if (singleDigit) {
+                continue;
+            }
+
+            m_threadPool.parallelFor(numElements, [&](uint32_t threadIdx, uint32_t begin, uint32_t end) {
+                uint32_t *offsets = &m_radixSortHistograms[threadIdx * RADIX_SORT_BINS];
+                for (uint32_t i = begin; i < end; i++) {
+                    const uint32_t dst = offsets[(m_mortonCodes[i] >> shift) & (RADIX_SORT_BINS - 1)]++;
+                    m_mortonCodesPingPong[dst] = m_mortonCodes[i];
+                    m_elementIndicesPingPong[dst] = m_elementIndices[i];
+                }
+            });
+            std::swap(m_mortonCodes, m_mortonCodesPingPong);
+            std::swap(m_elementIndices, m_elementIndicesPingPong);
+        }
+    }
+
+    void LBVHCPUBuilder::buildHierarchy(const std::vector<Element> &elements, std::vector<LBVHNode> &LBVH, bool absolutePointers) {
+        // same as lbvh_hierarchy.comp
+        const auto numElements = static_cast<uint32_t>(elements.size());
+        const int LEAF_OFFSET = static_cast<int>(numElements) - 1;
+        m_threadPool.parallelFor(numElements, [&](uint32_t, uint32_t begin, uint32_t end) {
+            for (uint32_t i = begin; i < end; i++) {
+                // construct leaf nodes
+                const Element &element = elements[m_elementIndices[i]];
+                LBVH[LEAF_OFFSET + i] = {INVALID_POINTER, INVALID_POINTER, element.primitiveIdx, element.aabbMinX, element.aabbMinY, element.aabbMinZ, element.aabbMaxX, element.aabbMaxY, element.aabbMaxZ};
+
+                // construct internal nodes
+                if (i >= numElements - 1) {
+                    continue;
+                }
+                int first;
+                int last;
+                determineRange(static_cast<int>(i), first, last);
+                const int split = findSplit(first, last);
+                const int childA = split == first ? LEAF_OFFSET + split : split;
+                const int childB = split + 1 == last ? LEAF_OFFSET + split + 1 : split + 1;
+                if (absolutePointers) {
+                    LBVH[i] = {childA, childB, 0, 0, 0, 0, 0, 0, 0};
+                } else {
+                    LBVH[i] = {childA - static_cast<int>(i), childB - static_cast<int>(i), 0, 0, 0, 0, 0, 0, 0};
+                }
+                m_parents[childA] = i;
+                m_parents[childB] = i;
+                m_visitationCounts[i].store(0, std::memory_order_relaxed);
+            }
+        });
+        m_parents[0] = 0;
+    }
+
+    void LBVHCPUBuilder::buildBoundingBoxes(std::vector<LBVHNode> &LBVH, bool absolutePointers) {
+        // same as lbvh_bounding_boxes.comp: one thread per leaf goes up, the second thread that arrives at an internal node computes its aabb
+        const auto numElements = static_cast<uint32_t>((LBVH.size() + 1) / 2);
+        if (numElements == 1) {
+            return;
+        }
+        const uint32_t LEAF_OFFSET = numElements - 1;
+        m_threadPool.parallelFor(numElements, [&](uint32_t, uint32_t begin, uint32_t end) {
+            for (uint32_t i = begin; i < end; i++) {
+                uint32_t nodeIdx = m_parents[LEAF_OFFSET + i];
+                while (true) {
+                    // acquire the aabb of the child written by the other thread, release the own child
+                    if (m_visitationCounts[nodeIdx].fetch_add(1, std::memory_order_acq_rel) == 0) {
+                        break;
+                    }
+                    LBVHNode &node = LBVH[nodeIdx];
+                    const LBVHNode &left = LBVH[absolutePointers ? node.left : static_cast<int>(nodeIdx) + node.left];
+                    const LBVHNode &right = LBVH[absolutePointers ? node.right : static_cast<int>(nodeIdx) + node.right];
+                    node.aabbMinX = std::min(left.aabbMinX, right.aabbMinX);
+                    node.aabbMinY = std::min(left.aabbMinY, right.aabbMinY);
+                    node.aabbMinZ = std::min(left.aabbMinZ, right.aabbMinZ);
+                    node.aabbMaxX = std::max(left.aabbMaxX, right.aabbMaxX);
+                    node.aabbMaxY = std::max(left.aabbMaxY, right.aabbMaxY);
+                    node.aabbMaxZ = std::max(left.aabbMaxZ, right.aabbMaxZ);
+                    if (nodeIdx == 0) {
+                        break;
+                    }
+                    nodeIdx = m_parents[nodeIdx];
+                }
+            }
+        });
+    }
+
+    int LBVHCPUBuilder::delta(int i, uint64_t codeI, int j) const {
+        if (j < 0 || j > static_cast<int>(m_mortonCodes.size()) - 1) {
+            return -1;
+        }
+        const uint64_t codeJ = m_mortonCodes[j];
+        if (codeI == codeJ) {
+            // handle duplicate morton codes
+            return (m_mortonCodes64 ? 64 : 32) + std::countl_zero(static_cast<uint32_t>(i ^ j));
+        }
+        return m_mortonCodes64 ? std::countl_zero(codeI ^ codeJ) : std::countl_zero(static_cast<uint32_t>(codeI ^ codeJ));
+    }
+
+    void LBVHCPUBuilder::determineRange(int idx, int &lower, int &upper) const {
+        // determine direction of the range (+1 or -1)
+        const uint64_t code = m_mortonCodes[idx];
+        const int deltaL = delta(idx, code, idx - 1);
+        const int deltaR = delta(idx, code, idx + 1);
+        const int d = (deltaR >= deltaL) ? 1 : -1;
+
+        // compute upper bound for the length of the range
+        const int deltaMin = std::min(deltaL, deltaR);
+        int lMax = 2;
+        while (delta(idx, code, idx + lMax * d) > deltaMin) {
+            lMax = lMax << 1;
+        }
+
+        // find the other end using binary search
+        int l = 0;
+        for (int t = lMax >> 1; t > 0; t >>= 1) {
+            if (delta(idx, code, idx + (l + t) * d) > deltaMin) {
+                l += t;
+            }
+        }
+        const int jdx = idx + l * d;
+
+        // ensure idx < jdx
+        lower = std::min(idx, jdx);
+        upper = std::max(idx, jdx);
+    }
+
+    int LBVHCPUBuilder::findSplit(int first, int last) const {
+        const uint64_t firstCode = m_mortonCodes[first];
+        const int commonPrefix = delta(first, firstCode, last);
+
+        // binary search for the highest object that shares more than commonPrefix bits with the first one
+        int split = first;
+        int stride = last - first;
+        do {
+            stride = (stride + 1) >> 1;
+            const int newSplit = split + stride;
+            if (newSplit < last) {
+                const int splitPrefix = delta(first, firstCode, newSplit);
+                if (splitPrefix > commonPrefix) {
+                    split = newSplit;
+                }
+            }
+        } while (stride > 1);
+
+        return split;
+    }
+
+    void LBVHCPUBuilder::loadBlock(const std::vector<Element> &elements, uint32_t begin, uint32_t count, ElementBlock &block) {
+        for (uint32_t j = 0; j < count; j++) {
+            const Element &element = elements[begin + j];
+            block.minX[j] = element.aabbMinX;
+            block.minY[j] = element.aabbMinY;
+            block.minZ[j] = element.aabbMinZ;
+            block.maxX[j] = element.aabbMaxX;
+            block.maxY[j] = element.aabbMaxY;
+            block.maxZ[j] = element.aabbMaxZ;
+        }
+    }
+
+    uint32_t LBVHCPUBuilder::quantize(float offset, float size, float scale, float maxValue) {
+        // same as quantize in lbvh_morton_codes.comp, the corrections are clamped instead of guarded, i.e. they compile to selects
+        const float scaled = std::max(offset * scale, 0.0f);
+        float q = std::min(std::floor(scaled / size), maxValue);
+        q = std::min(q + ((q + 1.0f) * size <= scaled ? 1.0f : 0.0f), maxValue);
+        q = std::max(q - (q * size > scaled ? 1.0f : 0.0f), 0.0f);
+        return static_cast<uint32_t>(static_cast<int32_t>(q)); // q < 2^21, the signed conversion has a vector instruction
+    }
+
+    uint32_t LBVHCPUBuilder::floatToOrderedUint(float value) {
+        // same as floatToOrderedUint in lbvh_common.glsl
+        const auto bits = std::bit_cast<uint32_t>(value);
+        return bits ^ (static_cast<uint32_t>(static_cast<int32_t>(bits) >> 31) | 0x80000000u);
+    }
+
+    float LBVHCPUBuilder::orderedUintToFloat(uint32_t value) {
+        return std::bit_cast<float>(value ^ ((value >> 31) != 0 ? 0x80000000u : 0xFFFFFFFFu));
+    }
+
+    uint32_t LBVHCPUBuilder::expandBits(uint32_t v) {
+        v = (v * 0x00010001u) & 0xFF0000FFu;
+        v = (v * 0x00000101u) & 0x0F00F00Fu;
+        v = (v * 0x00000011u) & 0xC30C30C3u;
+        v = (v * 0x00000005u) & 0x49249249u;
+        return v;
+    }
+
+    uint64_t LBVHCPUBuilder::expandBits64(uint64_t v) {
+        v = (v | (v << 32)) & 0x001F00000000FFFFul;
+        v = (v | (v << 16)) & 0x001F0000FF0000FFul;
+        v = (v | (v << 8)) & 0x100F00F00F00F00Ful;
+        v = (v | (v << 4)) & 0x10C30C30C30C30C3ul;
+        v = (v | (v << 2)) & 0x1249249249249249ul;
+        return v;
+    }
+} // namespace engine
@@ -2,88 +2,479 @@
 
 namespace engine {
 
+    void LBVHPass::create() {
+        if (m_wideBVHWidth != 4 && m_wideBVHWidth != 8) {
+            throw std::runtime_error("The wide BVH width has to be 4 or 8!");
+        }
+        if (m_compressedNodeBits != 8 && m_compressedNodeBits != 16) {
+            throw std::runtime_error("The compressed nodes have to use 8 or 16 bits per bound!");
+        }
+        if (m_mortonCodes64) {
+            VkPhysicalDeviceFeatures2 deviceFeatures{.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2};
+            vkGetPhysicalDeviceFeatures2(m_gpuContext->m_physicalDevice, &deviceFeatures);
+            if (!deviceFeatures.features.shaderInt64) {
+                throw std::runtime_error("63-bit morton codes require the shaderInt64 feature!");
+            }
+        }
+        ComputePass::create();
+    }
+
     std::vector<std::shared_ptr<Shader>> LBVHPass::createShaders() {
-        return {std::make_shared<Shader>(m_gpuContext, Paths::m_resourceDirectoryPath + "/shaders", "lbvh_morton_codes.comp"),
-                std::make_shared<Shader>(m_gpuContext, Paths::m_resourceDirectoryPath + "/shaders", "lbvh_single_radixsort.comp"),
-                std::make_shared<Shader>(m_gpuContext, Paths::m_resourceDirectoryPath + "/shaders", "lbvh_hierarchy.comp"),
-                std::make_shared<Shader>(m_gpuContext, Paths::m_resourceDirectoryPath + "/shaders", "lbvh_bounding_boxes.comp")};
+        std::vector<std::string> defines;
+        if (m_mortonCodes64) {
+            defines.emplace_back("MORTON_CODES_64");
+        }
+        std::vector<std::string> wideDefines = defines;
+        if (m_wideBVHWidth != 4) {
+            wideDefines.emplace_back("WIDE_BVH_WIDTH=" + std::to_string(m_wideBVHWidth));
+        }
+        std::vector<std::string> compressDefines = defines;
+        if (m_compressedNodeBits != 8) {
+            compressDefines.emplace_back("COMPRESSED_NODE_BITS=" + std::to_string(m_compressedNodeBits));
+        }
+
+        // specialization instead of hand-edited defines, i.e. the same spir-v runs on all devices
+        const VkPhysicalDeviceLimits &limits = m_gpuContext->m_deviceProperties.limits;
+        if (limits.maxComputeWorkGroupInvocations < RADIX_SORT_WORKGROUP_SIZE || limits.maxComputeWorkGroupSize[0] < RADIX_SORT_WORKGROUP_SIZE) {
+            throw std::runtime_error("The radix sorts require work groups of 256 threads!");
+        }
+        m_subgroupSize = m_gpuContext->m_subgroupProperties.subgroupSize;
+        uint32_t requiredSubgroupSize = 0;
+        if (m_gpuContext->m_subgroupSizeControl) {
+            // the subgroup size of the radix sorts has to match SUBGROUP_SIZE, e.g. AMD may otherwise choose between wave32 and wave64
+            m_subgroupSize = std::clamp(m_subgroupSize, m_gpuContext->m_subgroupSizeControlProperties.minSubgroupSize, m_gpuContext->m_subgroupSizeControlProperties.maxSubgroupSize);
+            requiredSubgroupSize = m_subgroupSize;
+        }
+        m_workGroupSize = getPreferredWorkGroupSize(MAX_WORKGROUP_SIZE);
+        const std::map<uint32_t, uint32_t> radixSortConstants = {{SUBGROUP_SIZE_CONSTANT_ID, m_subgroupSize}};
+        const std::map<uint32_t, uint32_t> workGroupConstants = {{Shader::LOCAL_SIZE_X_CONSTANT_ID, m_workGroupSize}};
+        const std::map<uint32_t, uint32_t> dispatchConstants = {{DISPATCH_WORKGROUP_SIZE_CONSTANT_ID, m_workGroupSize}}; // single thread stages that write the indirect dispatch of a specialized stage
+        return {std::make_shared<Shader>(m_gpuContext, Paths::m_resourceDirectoryPath + "/shaders", "lbvh_morton_codes.comp", defines, workGroupConstants),
+                std::make_shared<Shader>(m_gpuContext, Paths::m_resourceDirectoryPath + "/shaders", "lbvh_single_radixsort.comp", defines, radixSortConstants, requiredSubgroupSize),
+                std::make_shared<Shader>(m_gpuContext, Paths::m_resourceDirectoryPath + "/shaders", "lbvh_hierarchy.comp", defines, workGroupConstants),
+                std::make_shared<Shader>(m_gpuContext, Paths::m_resourceDirectoryPath + "/shaders", "lbvh_bounding_boxes.comp", defines, workGroupConstants),
+                std::make_shared<Shader>(m_gpuContext, Paths::m_resourceDirectoryPath + "/shaders", "lbvh_multi_radixsort_histograms.comp", defines),
+                std::make_shared<Shader>(m_gpuContext, Paths::m_resourceDirectoryPath + "/shaders", "lbvh_multi_radixsort.comp", defines, radixSortConstants, requiredSubgroupSize),
+                std::make_shared<Shader>(m_gpuContext, Paths::m_resourceDirectoryPath + "/shaders", "lbvh_extent.comp", defines),
+                std::make_shared<Shader>(m_gpuContext, Paths::m_resourceDirectoryPath + "/shaders", "lbvh_refit_leaves.comp", defines, workGroupConstants),
+                std::make_shared<Shader>(m_gpuContext, Paths::m_resourceDirectoryPath + "/shaders", "lbvh_sah_cost.comp", defines),
+                std::make_shared<Shader>(m_gpuContext, Paths::m_resourceDirectoryPath + "/shaders", "lbvh_treelet_init.comp", defines, workGroupConstants),
+                std::make_shared<Shader>(m_gpuContext, Paths::m_resourceDirectoryPath + "/shaders", "lbvh_treelet_restructure.comp", defines, workGroupConstants),
+                std::make_shared<Shader>(m_gpuContext, Paths::m_resourceDirectoryPath + "/shaders", "lbvh_ploc_init.comp", defines, workGroupConstants),
+                std::make_shared<Shader>(m_gpuContext, Paths::m_resourceDirectoryPath + "/shaders", "lbvh_ploc_nearest_neighbour.comp", defines, workGroupConstants),
+                std::make_shared<Shader>(m_gpuContext, Paths::m_resourceDirectoryPath + "/shaders", "lbvh_ploc_merge.comp", defines, workGroupConstants),
+                std::make_shared<Shader>(m_gpuContext, Paths::m_resourceDirectoryPath + "/shaders", "lbvh_ploc_scan.comp", defines, workGroupConstants),
+                std::make_shared<Shader>(m_gpuContext, Paths::m_resourceDirectoryPath + "/shaders", "lbvh_ploc_compact.comp", defines, workGroupConstants),
+                std::make_shared<Shader>(m_gpuContext, Paths::m_resourceDirectoryPath + "/shaders", "lbvh_wide_init.comp", defines),
+                std::make_shared<Shader>(m_gpuContext, Paths::m_resourceDirectoryPath + "/shaders", "lbvh_wide_collapse.comp", wideDefines, workGroupConstants),
+                std::make_shared<Shader>(m_gpuContext, Paths::m_resourceDirectoryPath + "/shaders", "lbvh_wide_update.comp", defines, dispatchConstants),
+                std::make_shared<Shader>(m_gpuContext, Paths::m_resourceDirectoryPath + "/shaders", "lbvh_compress.comp", compressDefines, workGroupConstants),
+                std::make_shared<Shader>(m_gpuContext, Paths::m_resourceDirectoryPath + "/shaders", "lbvh_collapse_cost.comp", defines, workGroupConstants),
+                std::make_shared<Shader>(m_gpuContext, Paths::m_resourceDirectoryPath + "/shaders", "lbvh_collapse_init.comp", defines),
+                std::make_shared<Shader>(m_gpuContext, Paths::m_resourceDirectoryPath + "/shaders", "lbvh_collapse_emit.comp", defines, workGroupConstants),
+                std::make_shared<Shader>(m_gpuContext, Paths::m_resourceDirectoryPath + "/shaders", "lbvh_collapse_update.comp", defines, dispatchConstants),
+                std::make_shared<Shader>(m_gpuContext, Paths::m_resourceDirectoryPath + "/shaders", "lbvh_segmented_morton_codes.comp", defines),
+                std::make_shared<Shader>(m_gpuContext, Paths::m_resourceDirectoryPath + "/shaders", "lbvh_segmented_hierarchy.comp", defines, workGroupConstants),
+                std::make_shared<Shader>(m_gpuContext, Paths::m_resourceDirectoryPath + "/shaders", "lbvh_segmented_bounding_boxes.comp", defines, workGroupConstants),
+                std::make_shared<Shader>(m_gpuContext, Paths::m_resourceDirectoryPath + "/shaders", "lbvh_multi_radixsort_scan.comp", defines)};
+    }
+
+    void LBVHPass::setExtentBuffer(Buffer *extentBuffer) {
+        m_extentBuffer = extentBuffer;
+        setStorageBuffer(0, 2, extentBuffer);
+    }
+
+    void LBVHPass::setPLOCStateBuffer(Buffer *plocStateBuffer) {
+        m_plocStateBuffer = plocStateBuffer;
+        setStorageBuffer(3, 9, plocStateBuffer);
+    }
+
+    void LBVHPass::setWideStateBuffer(Buffer *wideStateBuffer) {
+        m_wideStateBuffer = wideStateBuffer;
+        setStorageBuffer(3, 12, wideStateBuffer);
+    }
+
+    void LBVHPass::setCollapseStateBuffer(Buffer *collapseStateBuffer) {
+        m_collapseStateBuffer = collapseStateBuffer;
+        setStorageBuffer(3, 18, collapseStateBuffer);
     }
 
     void LBVHPass::recordCommands(VkCommandBuffer commandBuffer) {
+        switch (m_recordMode) {
+            case BUILD:
+                recordBuild(commandBuffer);
+                if (m_buildAlgorithm == KARRAS) {
+                    recordStageBegin(commandBuffer, TIMED_POST_BUILD);
+                    recordPostBuild(commandBuffer);
+                    recordStageEnd(commandBuffer, TIMED_POST_BUILD);
+                }
+                break;
+            case PLOC_ITERATIONS:
+                recordStageBegin(commandBuffer, TIMED_HIERARCHY);
+                recordPLOCIterations(commandBuffer);
+                recordStageEnd(commandBuffer, TIMED_HIERARCHY);
+                break;
+            case POST_BUILD:
+                recordStageBegin(commandBuffer, TIMED_POST_BUILD);
+                recordPostBuild(commandBuffer);
+                recordStageEnd(commandBuffer, TIMED_POST_BUILD);
+                break;
+            case REFIT:
+                recordStageBegin(commandBuffer, TIMED_BOUNDING_BOXES);
+                recordRefit(commandBuffer);
+                recordStageEnd(commandBuffer, TIMED_BOUNDING_BOXES);
+                recordStageBegin(commandBuffer, TIMED_POST_BUILD);
+                recordSAHCost(commandBuffer);
+                recordCompress(commandBuffer);
+                recordStageEnd(commandBuffer, TIMED_POST_BUILD);
+                break;
+            case WIDE_ITERATIONS:
+                recordStageBegin(commandBuffer, TIMED_POST_BUILD);
+                recordWideIterations(commandBuffer);
+                recordStageEnd(commandBuffer, TIMED_POST_BUILD);
+                break;
+            case COLLAPSE_ITERATIONS:
+                recordStageBegin(commandBuffer, TIMED_POST_BUILD);
+                recordLeafCollapseIterations(commandBuffer);
+                recordStageEnd(commandBuffer, TIMED_POST_BUILD);
+                break;
+            case BATCH_BUILD:
+                recordBatchBuild(commandBuffer);
+                break;
+        }
+    }
+
+    const char *LBVHPass::getTimedStageName(TimedStage stage) {
+        switch (stage) {
+            case TIMED_MORTON_CODES:
+                return "Morton codes";
+            case TIMED_SORT:
+                return "Sort";
+            case TIMED_HIERARCHY:
+                return "Hierarchy";
+            case TIMED_BOUNDING_BOXES:
+                return "Bounding boxes";
+            case TIMED_POST_BUILD:
+                return "Post build";
+            default:
+                return "Unknown";
+        }
+    }
+
+    void LBVHPass::resetStageTimes() {
+        m_stageTimes.fill(0.0);
+    }
+
+    void LBVHPass::accumulateStageTimes() {
+        std::vector<double> durations;
+        getTimestampDurations(durations);
+        for (uint32_t stage = 0; stage < NUM_TIMED_STAGES; stage++) {
+            m_stageTimes[stage] += durations[stage];
+        }
+    }
+
+    void LBVHPass::recordStageBegin(VkCommandBuffer commandBuffer, TimedStage stage) {
+        recordTimestamp(commandBuffer, 2 * stage);
+    }
+
+    void LBVHPass::recordStageEnd(VkCommandBuffer commandBuffer, TimedStage stage) {
+        recordTimestamp(commandBuffer, 2 * stage + 1);
+    }
+
+    void LBVHPass::recordBuild(VkCommandBuffer commandBuffer) {
+        recordStageBegin(commandBuffer, TIMED_MORTON_CODES);
+        recordExtent(commandBuffer);
+
         vkCmdPushConstants(commandBuffer, m_pipelineLayouts[MORTON_CODES], VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(PushConstantsMortonCodes), &m_pushConstantsMortonCodes);
         recordCommandComputeShaderExecution(commandBuffer, MORTON_CODES);
-        VkMemoryBarrier memoryBarrier0{.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER, .srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT, .dstAccessMask = VK_ACCESS_SHADER_READ_BIT};
-        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, {}, 1, &memoryBarrier0, 0, nullptr, 0, nullptr);
+        recordComputeBarrier(commandBuffer);
+        recordStageEnd(commandBuffer, TIMED_MORTON_CODES);
+
+        recordStageBegin(commandBuffer, TIMED_SORT);
+        recordRadixSort(commandBuffer);
+        recordStageEnd(commandBuffer, TIMED_SORT);
 
-        vkCmdPushConstants(commandBuffer, m_pipelineLayouts[RADIX_SORT], VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(PushConstantsRadixSort), &m_pushConstantsRadixSort);
-        recordCommandComputeShaderExecution(commandBuffer, RADIX_SORT);
-        VkMemoryBarrier memoryBarrier1{.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER, .srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT, .dstAccessMask = VK_ACCESS_SHADER_READ_BIT};
-        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, {}, 1, &memoryBarrier1, 0, nullptr, 0, nullptr);
+        if (m_buildAlgorithm == PLOC) {
+            recordStageBegin(commandBuffer, TIMED_HIERARCHY);
+            recordPLOC(commandBuffer);
+            recordStageEnd(commandBuffer, TIMED_HIERARCHY);
+            return;
+        }
 
+        recordStageBegin(commandBuffer, TIMED_HIERARCHY);
         vkCmdPushConstants(commandBuffer, m_pipelineLayouts[HIERARCHY], VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(PushConstantsHierarchy), &m_pushConstantsHierarchy);
         recordCommandComputeShaderExecution(commandBuffer, HIERARCHY);
-        VkMemoryBarrier memoryBarrier2{.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER, .srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT, .dstAccessMask = VK_ACCESS_SHADER_READ_BIT};
-        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, {}, 1, &memoryBarrier2, 0, nullptr, 0, nullptr);
+        recordComputeBarrier(commandBuffer);
+        recordStageEnd(commandBuffer, TIMED_HIERARCHY);
 
+        recordStageBegin(commandBuffer, TIMED_BOUNDING_BOXES);
         vkCmdPushConstants(commandBuffer, m_pipelineLayouts[BOUNDING_BOXES], VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(PushConstantsBoundingBoxes), &m_pushConstantsBoundingBoxes);
         recordCommandComputeShaderExecution(commandBuffer, BOUNDING_BOXES);
-        VkMemoryBarrier memoryBarrier3{.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER, .srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT, .dstAccessMask = VK_ACCESS_SHADER_READ_BIT};
-        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, {}, 1, &memoryBarrier3, 0, nullptr, 0, nullptr);
+        recordComputeBarrier(commandBuffer);
+        recordStageEnd(commandBuffer, TIMED_BOUNDING_BOXES);
     }
 
-    void LBVHPass::createPipelineLayouts() {
-        VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
-        pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
-        pipelineLayoutInfo.setLayoutCount = m_descriptorSetLayouts.size();
-        pipelineLayoutInfo.pSetLayouts = m_descriptorSetLayouts.data();
+    void LBVHPass::recordBatchBuild(VkCommandBuffer commandBuffer) {
+        // one work group per segment reduces the extent of the segment, i.e. no global extent (EXTENT)
+        recordStageBegin(commandBuffer, TIMED_MORTON_CODES);
+        vkCmdPushConstants(commandBuffer, m_pipelineLayouts[SEGMENTED_MORTON_CODES], VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(PushConstantsSegmented), &m_pushConstantsSegmented);
+        recordCommandComputeShaderExecution(commandBuffer, SEGMENTED_MORTON_CODES);
+        recordComputeBarrier(commandBuffer);
+        recordStageEnd(commandBuffer, TIMED_MORTON_CODES);
+
+        // the segment index is stored above the morton code, i.e. the sort groups the elements by segment and each segment keeps its range of elements
+        recordStageBegin(commandBuffer, TIMED_SORT);
+        recordRadixSort(commandBuffer);
+        recordStageEnd(commandBuffer, TIMED_SORT);
+
+        recordStageBegin(commandBuffer, TIMED_HIERARCHY);
+        vkCmdPushConstants(commandBuffer, m_pipelineLayouts[SEGMENTED_HIERARCHY], VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(PushConstantsSegmented), &m_pushConstantsSegmented);
+        recordCommandComputeShaderExecution(commandBuffer, SEGMENTED_HIERARCHY);
+        recordComputeBarrier(commandBuffer);
+        recordStageEnd(commandBuffer, TIMED_HIERARCHY);
+
+        recordStageBegin(commandBuffer, TIMED_BOUNDING_BOXES);
+        vkCmdPushConstants(commandBuffer, m_pipelineLayouts[SEGMENTED_BOUNDING_BOXES], VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(PushConstantsSegmented), &m_pushConstantsSegmented);
+        recordCommandComputeShaderExecution(commandBuffer, SEGMENTED_BOUNDING_BOXES);
+        recordComputeBarrier(commandBuffer);
+        recordStageEnd(commandBuffer, TIMED_BOUNDING_BOXES);
+    }
+
+    void LBVHPass::recordPostBuild(VkCommandBuffer commandBuffer) {
+        if (m_treeletOptimization) {
+            recordTreeletOptimization(commandBuffer);
+        }
+        recordSAHCost(commandBuffer);
+        recordCompress(commandBuffer);
+        if (m_wideBVH) {
+            recordWideCollapse(commandBuffer);
+        }
+        if (m_collapseLeaves) {
+            recordLeafCollapse(commandBuffer);
+        }
+    }
+
+    void LBVHPass::recordSAHCost(VkCommandBuffer commandBuffer) {
+        if (!m_sahCost) {
+            return;
+        }
+        vkCmdPushConstants(commandBuffer, m_pipelineLayouts[SAH_COST], VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(PushConstantsSAHCost), &m_pushConstantsSAHCost);
+        recordCommandComputeShaderExecution(commandBuffer, SAH_COST);
+        recordComputeBarrier(commandBuffer);
+    }
+
+    void LBVHPass::recordPLOC(VkCommandBuffer commandBuffer) {
+        if (m_plocStateBuffer == nullptr) {
+            throw std::runtime_error("The PLOC state buffer has to be set before recording the LBVH pass with PLOC!");
+        }
+
+        // leaf nodes and initial clusters
+        vkCmdPushConstants(commandBuffer, m_pipelineLayouts[PLOC_INIT], VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(PushConstantsPLOC), &m_pushConstantsPLOC);
+        recordCommandComputeShaderExecution(commandBuffer, PLOC_INIT);
+        recordIndirectBarrier(commandBuffer);
+
+        recordPLOCIterations(commandBuffer);
+    }
+
+    void LBVHPass::recordPLOCIterations(VkCommandBuffer commandBuffer) {
+        // the number of clusters is only known on the GPU, therefore the work group counts are read from the PLOC state (indirect dispatch)
+        // once all clusters are merged, the remaining iterations only dispatch a single work group
+        for (uint32_t iteration = 0; iteration < m_plocIterations; iteration++) {
+            vkCmdPushConstants(commandBuffer, m_pipelineLayouts[PLOC_NEAREST_NEIGHBOUR], VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(PushConstantsPLOC), &m_pushConstantsPLOC);
+            recordCommandComputeShaderExecutionIndirect(commandBuffer, PLOC_NEAREST_NEIGHBOUR, m_plocStateBuffer->getBuffer(), PLOC_DISPATCH_OFFSET);
+            recordComputeBarrier(commandBuffer);
+
+            vkCmdPushConstants(commandBuffer, m_pipelineLayouts[PLOC_MERGE], VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(PushConstantsPLOC), &m_pushConstantsPLOC);
+            recordCommandComputeShaderExecutionIndirect(commandBuffer, PLOC_MERGE, m_plocStateBuffer->getBuffer(), PLOC_DISPATCH_OFFSET);
+            recordComputeBarrier(commandBuffer);
+
+            vkCmdPushConstants(commandBuffer, m_pipelineLayouts[PLOC_SCAN], VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(PushConstantsPLOC), &m_pushConstantsPLOC);
+            recordCommandComputeShaderExecution(commandBuffer, PLOC_SCAN);
+            recordIndirectBarrier(commandBuffer);
+
+            vkCmdPushConstants(commandBuffer, m_pipelineLayouts[PLOC_COMPACT], VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(PushConstantsPLOC), &m_pushConstantsPLOC);
+            recordCommandComputeShaderExecutionIndirect(commandBuffer, PLOC_COMPACT, m_plocStateBuffer->getBuffer(), PLOC_COMPACT_DISPATCH_OFFSET);
+            recordComputeBarrier(commandBuffer);
+        }
+    }
+
+    void LBVHPass::recordCompress(VkCommandBuffer commandBuffer) {
+        if (!m_compressedNodes) {
+            return;
+        }
+        vkCmdPushConstants(commandBuffer, m_pipelineLayouts[COMPRESS], VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(PushConstantsCompress), &m_pushConstantsCompress);
+        recordCommandComputeShaderExecution(commandBuffer, COMPRESS);
+        recordComputeBarrier(commandBuffer);
+    }
+
+    void LBVHPass::recordLeafCollapse(VkCommandBuffer commandBuffer) {
+        if (m_collapseStateBuffer == nullptr) {
+            throw std::runtime_error("The collapse state buffer has to be set before recording the LBVH pass with the leaf collapse!");
+        }
+
+        // bottom-up SAH cost and collapse decision of every node (reusing the visitation count reset of the treelet restructuring)
+        vkCmdPushConstants(commandBuffer, m_pipelineLayouts[TREELET_INIT], VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(PushConstantsTreelet), &m_pushConstantsTreelet);
+        recordCommandComputeShaderExecution(commandBuffer, TREELET_INIT);
+        recordComputeBarrier(commandBuffer);
+
+        vkCmdPushConstants(commandBuffer, m_pipelineLayouts[COLLAPSE_COST], VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(PushConstantsCollapse), &m_pushConstantsCollapse);
+        recordCommandComputeShaderExecution(commandBuffer, COLLAPSE_COST);
+        recordComputeBarrier(commandBuffer);
+
+        // collapsed root
+        vkCmdPushConstants(commandBuffer, m_pipelineLayouts[COLLAPSE_INIT], VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(PushConstantsCollapse), &m_pushConstantsCollapse);
+        recordCommandComputeShaderExecution(commandBuffer, COLLAPSE_INIT);
+        recordIndirectBarrier(commandBuffer);
+
+        recordLeafCollapseIterations(commandBuffer);
+    }
+
+    void LBVHPass::recordLeafCollapseIterations(VkCommandBuffer commandBuffer) {
+        // top-down, every iteration emits one level of the collapsed LBVH (work group count read from the collapse state)
+        // once all leaves are emitted, the remaining iterations dispatch no work groups
+        for (uint32_t iteration = 0; iteration < m_collapseIterations; iteration++) {
+            vkCmdPushConstants(commandBuffer, m_pipelineLayouts[COLLAPSE_EMIT], VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(PushConstantsCollapse), &m_pushConstantsCollapse);
+            recordCommandComputeShaderExecutionIndirect(commandBuffer, COLLAPSE_EMIT, m_collapseStateBuffer->getBuffer(), COLLAPSE_DISPATCH_OFFSET);
+            recordComputeBarrier(commandBuffer);
 
-        // BOUNDING_BOXES
-        VkPushConstantRange pushConstantRange{};
-        pushConstantRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
-        pushConstantRange.offset = 0;
-        pushConstantRange.size = sizeof(PushConstantsMortonCodes);
+            vkCmdPushConstants(commandBuffer, m_pipelineLayouts[COLLAPSE_UPDATE], VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(PushConstantsCollapse), &m_pushConstantsCollapse);
+            recordCommandComputeShaderExecution(commandBuffer, COLLAPSE_UPDATE);
+            recordIndirectBarrier(commandBuffer);
+        }
+    }
+
+    void LBVHPass::recordWideCollapse(VkCommandBuffer commandBuffer) {
+        if (m_wideStateBuffer == nullptr) {
+            throw std::runtime_error("The wide state buffer has to be set before recording the LBVH pass with the wide BVH collapse!");
+        }
+
+        // wide root
+        vkCmdPushConstants(commandBuffer, m_pipelineLayouts[WIDE_INIT], VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(PushConstantsWide), &m_pushConstantsWide);
+        recordCommandComputeShaderExecution(commandBuffer, WIDE_INIT);
+        recordIndirectBarrier(commandBuffer);
+
+        recordWideIterations(commandBuffer);
+    }
 
-        pipelineLayoutInfo.pushConstantRangeCount = 1;
-        pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
+    void LBVHPass::recordWideIterations(VkCommandBuffer commandBuffer) {
+        // top-down, every iteration collapses one level of the wide BVH (work group count read from the wide state)
+        // once the bottom of the LBVH is reached, the remaining iterations dispatch no work groups
+        for (uint32_t iteration = 0; iteration < m_wideIterations; iteration++) {
+            vkCmdPushConstants(commandBuffer, m_pipelineLayouts[WIDE_COLLAPSE], VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(PushConstantsWide), &m_pushConstantsWide);
+            recordCommandComputeShaderExecutionIndirect(commandBuffer, WIDE_COLLAPSE, m_wideStateBuffer->getBuffer(), WIDE_DISPATCH_OFFSET);
+            recordComputeBarrier(commandBuffer);
 
-        if (vkCreatePipelineLayout(m_gpuContext->m_device, &pipelineLayoutInfo, nullptr, &m_pipelineLayouts[MORTON_CODES]) != VK_SUCCESS) {
-            throw std::runtime_error("Failed to create pipeline layout!");
+            vkCmdPushConstants(commandBuffer, m_pipelineLayouts[WIDE_UPDATE], VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(PushConstantsWide), &m_pushConstantsWide);
+            recordCommandComputeShaderExecution(commandBuffer, WIDE_UPDATE);
+            recordIndirectBarrier(commandBuffer);
         }
+    }
+
+    void LBVHPass::recordRefit(VkCommandBuffer commandBuffer) {
+        // the morton codes, the hierarchy and the parent pointers of the last full build are kept
+        vkCmdPushConstants(commandBuffer, m_pipelineLayouts[REFIT_LEAVES], VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(PushConstantsRefitLeaves), &m_pushConstantsRefitLeaves);
+        recordCommandComputeShaderExecution(commandBuffer, REFIT_LEAVES);
+        recordComputeBarrier(commandBuffer);
+
+        vkCmdPushConstants(commandBuffer, m_pipelineLayouts[BOUNDING_BOXES], VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(PushConstantsBoundingBoxes), &m_pushConstantsBoundingBoxes);
+        recordCommandComputeShaderExecution(commandBuffer, BOUNDING_BOXES);
+        recordComputeBarrier(commandBuffer);
+    }
 
-        // RADIX_SORT
-        pushConstantRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
-        pushConstantRange.offset = 0;
-        pushConstantRange.size = sizeof(PushConstantsRadixSort);
+    void LBVHPass::recordTreeletOptimization(VkCommandBuffer commandBuffer) {
+        // every iteration is a bottom-up traversal (like BOUNDING_BOXES), therefore the visitation counts have to be reset before
+        for (uint32_t iteration = 0; iteration < m_treeletIterations; iteration++) {
+            vkCmdPushConstants(commandBuffer, m_pipelineLayouts[TREELET_INIT], VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(PushConstantsTreelet), &m_pushConstantsTreelet);
+            recordCommandComputeShaderExecution(commandBuffer, TREELET_INIT);
+            recordComputeBarrier(commandBuffer);
 
-        pipelineLayoutInfo.pushConstantRangeCount = 1;
-        pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
+            vkCmdPushConstants(commandBuffer, m_pipelineLayouts[TREELET_RESTRUCTURE], VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(PushConstantsTreelet), &m_pushConstantsTreelet);
+            recordCommandComputeShaderExecution(commandBuffer, TREELET_RESTRUCTURE);
+            recordComputeBarrier(commandBuffer);
+        }
+    }
 
-        if (vkCreatePipelineLayout(m_gpuContext->m_device, &pipelineLayoutInfo, nullptr, &m_pipelineLayouts[RADIX_SORT]) != VK_SUCCESS) {
-            throw std::runtime_error("Failed to create pipeline layout!");
+    void LBVHPass::recordExtent(VkCommandBuffer commandBuffer) {
+        if (m_extentBuffer == nullptr) {
+            throw std::runtime_error("The extent buffer has to be set before recording the LBVH pass!");
         }
 
-        // HIERARCHY
-        pushConstantRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
-        pushConstantRange.offset = 0;
-        pushConstantRange.size = sizeof(PushConstantsHierarchy);
+        // reset the extent to min = 0xFFFFFFFF and max = 0x00000000 (ordered uints, see floatToOrderedUint in lbvh_common.glsl)
+        vkCmdFillBuffer(commandBuffer, m_extentBuffer->getBuffer(), 0, 3 * sizeof(uint32_t), 0xFFFFFFFF);
+        vkCmdFillBuffer(commandBuffer, m_extentBuffer->getBuffer(), 3 * sizeof(uint32_t), 3 * sizeof(uint32_t), 0x00000000);
+        VkMemoryBarrier memoryBarrier{.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER, .srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT, .dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT};
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, {}, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
 
-        pipelineLayoutInfo.pushConstantRangeCount = 1;
-        pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
+        vkCmdPushConstants(commandBuffer, m_pipelineLayouts[EXTENT], VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(PushConstantsExtent), &m_pushConstantsExtent);
+        recordCommandComputeShaderExecution(commandBuffer, EXTENT);
+        recordComputeBarrier(commandBuffer);
+    }
 
-        if (vkCreatePipelineLayout(m_gpuContext->m_device, &pipelineLayoutInfo, nullptr, &m_pipelineLayouts[HIERARCHY]) != VK_SUCCESS) {
-            throw std::runtime_error("Failed to create pipeline layout!");
+    void LBVHPass::recordRadixSort(VkCommandBuffer commandBuffer) {
+        if (!m_multiRadixSort) {
+            vkCmdPushConstants(commandBuffer, m_pipelineLayouts[RADIX_SORT], VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(PushConstantsRadixSort), &m_pushConstantsRadixSort);
+            recordCommandComputeShaderExecution(commandBuffer, RADIX_SORT);
+            recordComputeBarrier(commandBuffer);
+            return;
         }
 
-        // RADIX_SORT
-        pushConstantRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
-        pushConstantRange.offset = 0;
-        pushConstantRange.size = sizeof(PushConstantsBoundingBoxes);
+        // an even number of iterations, i.e. the sorted morton codes end up in the same buffer as with RADIX_SORT
+        for (uint32_t iteration = 0; iteration < getRadixSortIterations(); iteration++) {
+            PushConstantsMultiRadixSort pushConstants = m_pushConstantsMultiRadixSort;
+            pushConstants.g_shift = 8 * iteration;
+
+            vkCmdPushConstants(commandBuffer, m_pipelineLayouts[MULTI_RADIX_SORT_HISTOGRAMS], VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(PushConstantsMultiRadixSort), &pushConstants);
+            recordCommandComputeShaderExecution(commandBuffer, MULTI_RADIX_SORT_HISTOGRAMS);
+            recordComputeBarrier(commandBuffer);
 
-        pipelineLayoutInfo.pushConstantRangeCount = 1;
-        pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
+            vkCmdPushConstants(commandBuffer, m_pipelineLayouts[MULTI_RADIX_SORT_SCAN], VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(PushConstantsMultiRadixSort), &pushConstants);
+            recordCommandComputeShaderExecution(commandBuffer, MULTI_RADIX_SORT_SCAN);
+            recordComputeBarrier(commandBuffer);
 
-        if (vkCreatePipelineLayout(m_gpuContext->m_device, &pipelineLayoutInfo, nullptr, &m_pipelineLayouts[BOUNDING_BOXES]) != VK_SUCCESS) {
-            throw std::runtime_error("Failed to create pipeline layout!");
+            vkCmdPushConstants(commandBuffer, m_pipelineLayouts[MULTI_RADIX_SORT], VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(PushConstantsMultiRadixSort), &pushConstants);
+            recordCommandComputeShaderExecution(commandBuffer, MULTI_RADIX_SORT);
+            recordComputeBarrier(commandBuffer);
         }
     }
-} // namespace engine
\ No newline at end of file
+
+    void LBVHPass::recordComputeBarrier(VkCommandBuffer commandBuffer) {
+        VkMemoryBarrier memoryBarrier{.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER, .srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT, .dstAccessMask = VK_ACCESS_SHADER_READ_BIT};
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, {}, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+    }
+
+    void LBVHPass::recordIndirectBarrier(VkCommandBuffer commandBuffer) {
+        VkMemoryBarrier memoryBarrier{.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER, .srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT, .dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_INDIRECT_COMMAND_READ_BIT};
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT, {}, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+    }
+
+    void LBVHPass::createPipelineLayouts() {
+        createPipelineLayout(MORTON_CODES, sizeof(PushConstantsMortonCodes));
+        createPipelineLayout(RADIX_SORT, sizeof(PushConstantsRadixSort));
+        createPipelineLayout(HIERARCHY, sizeof(PushConstantsHierarchy));
+        createPipelineLayout(BOUNDING_BOXES, sizeof(PushConstantsBoundingBoxes));
+        createPipelineLayout(MULTI_RADIX_SORT_HISTOGRAMS, sizeof(PushConstantsMultiRadixSort));
+        createPipelineLayout(MULTI_RADIX_SORT, sizeof(PushConstantsMultiRadixSort));
+        createPipelineLayout(EXTENT, sizeof(PushConstantsExtent));
+        createPipelineLayout(REFIT_LEAVES, sizeof(PushConstantsRefitLeaves));
+        createPipelineLayout(SAH_COST, sizeof(PushConstantsSAHCost));
+        createPipelineLayout(TREELET_INIT, sizeof(PushConstantsTreelet));
+        createPipelineLayout(TREELET_RESTRUCTURE, sizeof(PushConstantsTreelet));
+        createPipelineLayout(PLOC_INIT, sizeof(PushConstantsPLOC));
+        createPipelineLayout(PLOC_NEAREST_NEIGHBOUR, sizeof(PushConstantsPLOC));
+        createPipelineLayout(PLOC_MERGE, sizeof(PushConstantsPLOC));
+        createPipelineLayout(PLOC_SCAN, sizeof(PushConstantsPLOC));
+        createPipelineLayout(PLOC_COMPACT, sizeof(PushConstantsPLOC));
+        createPipelineLayout(WIDE_INIT, sizeof(PushConstantsWide));
+        createPipelineLayout(WIDE_COLLAPSE, sizeof(PushConstantsWide));
+        createPipelineLayout(WIDE_UPDATE, sizeof(PushConstantsWide));
+        createPipelineLayout(COMPRESS, sizeof(PushConstantsCompress));
+        createPipelineLayout(COLLAPSE_COST, sizeof(PushConstantsCollapse));
+        createPipelineLayout(COLLAPSE_INIT, sizeof(PushConstantsCollapse));
+        createPipelineLayout(COLLAPSE_EMIT, sizeof(PushConstantsCollapse));
+        createPipelineLayout(COLLAPSE_UPDATE, sizeof(PushConstantsCollapse));
+        createPipelineLayout(SEGMENTED_MORTON_CODES, sizeof(PushConstantsSegmented));
+        createPipelineLayout(SEGMENTED_HIERARCHY, sizeof(PushConstantsSegmented));
+        createPipelineLayout(SEGMENTED_BOUNDING_BOXES, sizeof(PushConstantsSegmented));
+        createPipelineLayout(MULTI_RADIX_SORT_SCAN, sizeof(PushConstantsMultiRadixSort));
+    }
+} // namespace engine
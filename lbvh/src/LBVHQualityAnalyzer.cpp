@@ -0,0 +1,209 @@
+#include "LBVHQualityAnalyzer.h"
+
+#include <algorithm>
+#include <atomic>
+#include <iostream>
+#include <numeric>
+#include <random>
+#include <stdexcept>
+
+namespace engine {
+    LBVHQualityAnalyzer::Report LBVHQualityAnalyzer::analyze(const std::vector<LBVHNode> &LBVH, bool absolutePointers) {
+        if (LBVH.size() < 3 || LBVH.size() % 2 == 0) {
+            throw std::runtime_error("The LBVH has to contain 2 * NUM_ELEMENTS - 1 nodes with at least two elements!");
+        }
+
+        Report report;
+        report.numNodes = static_cast<uint32_t>(LBVH.size());
+        report.numLeaves = (report.numNodes + 1) / 2;
+        computeNodeMetrics(LBVH, absolutePointers, report);
+        computeDepths(LBVH, absolutePointers, report);
+        estimateEPO(LBVH, absolutePointers, report);
+        return report;
+    }
+
+    void LBVHQualityAnalyzer::print(const Report &report) {
+        std::cout << PRINT_PREFIX << "SAH cost: " << report.sahCost << ", EPO (estimate): " << report.epo << ", sibling overlap volume: " << report.siblingOverlapVolume << ", sibling overlap area: " << report.siblingOverlapArea << std::endl;
+        std::cout << PRINT_PREFIX << "Max leaf depth: " << report.maxLeafDepth << ", average leaf depth: " << report.averageLeafDepth << ", leaves per depth:";
+        for (uint32_t depth = 0; depth < report.depthHistogram.size(); depth++) {
+            if (report.depthHistogram[depth] > 0) {
+                std::cout << " " << depth << ":" << report.depthHistogram[depth];
+            }
+        }
+        std::cout << std::endl;
+    }
+
+    void LBVHQualityAnalyzer::computeNodeMetrics(const std::vector<LBVHNode> &LBVH, bool absolutePointers, Report &report) {
+        // every node contributes independently, one partial sum per thread (deterministic for a fixed number of threads)
+        struct PartialSums {
+            double area = 0;
+            double overlapVolume = 0;
+            double overlapArea = 0;
+        };
+        std::vector<PartialSums> partialSums(m_threadPool.getNumThreads());
+        m_threadPool.parallelFor(report.numNodes, [&](uint32_t threadIdx, uint32_t begin, uint32_t end) {
+            PartialSums sums;
+            for (uint32_t i = begin; i < end; i++) {
+                const LBVHNode &node = LBVH[i];
+                sums.area += surfaceArea(node);
+                if (node.left == INVALID_POINTER) {
+                    continue;
+                }
+                LBVHNode overlap{};
+                if (intersect(LBVH[getChild(LBVH, i, node.left, absolutePointers)], LBVH[getChild(LBVH, i, node.right, absolutePointers)], overlap)) {
+                    sums.overlapVolume += volume(overlap);
+                    sums.overlapArea += surfaceArea(overlap);
+                }
+            }
+            partialSums[threadIdx] = sums;
+        });
+
+        PartialSums sums;
+        for (const auto &partial: partialSums) {
+            sums.area += partial.area;
+            sums.overlapVolume += partial.overlapVolume;
+            sums.overlapArea += partial.overlapArea;
+        }
+        const double rootArea = surfaceArea(LBVH[0]);
+        const double rootVolume = volume(LBVH[0]);
+        report.sahCost = rootArea > 0 ? sums.area / rootArea : 0;
+        report.siblingOverlapVolume = rootVolume > 0 ? sums.overlapVolume / rootVolume : 0;
+        report.siblingOverlapArea = rootArea > 0 ? sums.overlapArea / rootArea : 0;
+    }
+
+    void LBVHQualityAnalyzer::computeDepths(const std::vector<LBVHNode> &LBVH, bool absolutePointers, Report &report) {
+        // level-synchronous top-down traversal, the nodes of a level are processed in parallel
+        std::vector<uint32_t> partialLeaves(m_threadPool.getNumThreads());
+        m_frontier.assign(1, 0);
+        uint32_t numVisited = 0;
+        while (!m_frontier.empty()) {
+            numVisited += m_frontier.size();
+            if (numVisited > report.numNodes) {
+                throw std::runtime_error("The LBVH contains a cycle or a node with several parents!");
+            }
+
+            m_nextFrontier.resize(2 * m_frontier.size());
+            std::atomic<uint32_t> nextSize = 0;
+            std::fill(partialLeaves.begin(), partialLeaves.end(), 0);
+            m_threadPool.parallelFor(m_frontier.size(), [&](uint32_t threadIdx, uint32_t begin, uint32_t end) {
+                // one atomic per chunk to reserve the space for the children of its internal nodes
+                uint32_t numInternal = 0;
+                for (uint32_t i = begin; i < end; i++) {
+                    numInternal += LBVH[m_frontier[i]].left != INVALID_POINTER;
+                }
+                uint32_t offset = nextSize.fetch_add(2 * numInternal);
+                for (uint32_t i = begin; i < end; i++) {
+                    const uint32_t index = m_frontier[i];
+                    const LBVHNode &node = LBVH[index];
+                    if (node.left == INVALID_POINTER) {
+                        partialLeaves[threadIdx]++;
+                        continue;
+                    }
+                    m_nextFrontier[offset++] = getChild(LBVH, index, node.left, absolutePointers);
+                    m_nextFrontier[offset++] = getChild(LBVH, index, node.right, absolutePointers);
+                }
+            });
+
+            report.depthHistogram.push_back(std::accumulate(partialLeaves.begin(), partialLeaves.end(), 0u));
+            m_nextFrontier.resize(nextSize);
+            std::swap(m_frontier, m_nextFrontier);
+        }
+
+        if (numVisited != report.numNodes) {
+            throw std::runtime_error("Not all nodes of the LBVH are reachable from the root!");
+        }
+        uint64_t sumLeafDepth = 0;
+        for (uint32_t depth = 0; depth < report.depthHistogram.size(); depth++) {
+            sumLeafDepth += static_cast<uint64_t>(depth) * report.depthHistogram[depth];
+        }
+        report.maxLeafDepth = static_cast<uint32_t>(report.depthHistogram.size()) - 1;
+        report.averageLeafDepth = static_cast<double>(sumLeafDepth) / report.numLeaves;
+    }
+
+    void LBVHQualityAnalyzer::estimateEPO(const std::vector<LBVHNode> &LBVH, bool absolutePointers, Report &report) {
+        // EPO = sum over all nodes n of the surface area of the geometry that is inside n but not part of the subtree of n, normalized by the surface area of the root
+        // i.e. the work of a traversal that is spent on n although the hit is in another subtree; the geometry is approximated by the (clipped) leaf aabbs
+        const double rootArea = surfaceArea(LBVH[0]);
+        const uint32_t numSamples = std::min(m_epoSamples, report.numNodes);
+        if (rootArea <= 0 || numSamples == 0) {
+            return;
+        }
+
+        std::vector<uint32_t> samples(numSamples);
+        std::mt19937 generator(42);
+        std::uniform_int_distribution<uint32_t> distribution(0, report.numNodes - 1);
+        for (auto &sample: samples) {
+            sample = distribution(generator);
+        }
+
+        std::vector<double> partialSums(m_threadPool.getNumThreads());
+        m_threadPool.parallelFor(numSamples, [&](uint32_t threadIdx, uint32_t begin, uint32_t end) {
+            std::vector<uint32_t> stack;
+            double sum = 0;
+            for (uint32_t s = begin; s < end; s++) {
+                const uint32_t sample = samples[s];
+                const LBVHNode &sampleNode = LBVH[sample];
+
+                // all leaves overlapping the sample node except the leaves in its own subtree
+                stack.assign(1, 0);
+                while (!stack.empty()) {
+                    const uint32_t index = stack.back();
+                    stack.pop_back();
+                    if (index == sample) {
+                        continue;
+                    }
+                    const LBVHNode &node = LBVH[index];
+                    LBVHNode overlap{};
+                    if (!intersect(node, sampleNode, overlap)) {
+                        continue;
+                    }
+                    if (node.left == INVALID_POINTER) {
+                        sum += surfaceArea(overlap);
+                    } else {
+                        stack.push_back(getChild(LBVH, index, node.left, absolutePointers));
+                        stack.push_back(getChild(LBVH, index, node.right, absolutePointers));
+                    }
+                }
+            }
+            partialSums[threadIdx] = sum;
+        });
+
+        const double sum = std::accumulate(partialSums.begin(), partialSums.end(), 0.0);
+        report.epo = static_cast<double>(report.numNodes) / numSamples * sum / rootArea;
+    }
+
+    uint32_t LBVHQualityAnalyzer::getChild(const std::vector<LBVHNode> &LBVH, uint32_t index, int32_t pointer, bool absolutePointers) {
+        const int64_t child = absolutePointers ? pointer : static_cast<int64_t>(index) + pointer;
+        if (child <= 0 || child >= static_cast<int64_t>(LBVH.size())) {
+            throw std::runtime_error("Node " + std::to_string(index) + " of the LBVH has an invalid child pointer!");
+        }
+        return static_cast<uint32_t>(child);
+    }
+
+    double LBVHQualityAnalyzer::surfaceArea(const LBVHNode &node) {
+        const double x = node.aabbMaxX - node.aabbMinX;
+        const double y = node.aabbMaxY - node.aabbMinY;
+        const double z = node.aabbMaxZ - node.aabbMinZ;
+        return 2.0 * (x * y + x * z + y * z);
+    }
+
+    double LBVHQualityAnalyzer::volume(const LBVHNode &node) {
+        return static_cast<double>(node.aabbMaxX - node.aabbMinX) * (node.aabbMaxY - node.aabbMinY) * (node.aabbMaxZ - node.aabbMinZ);
+    }
+
+    bool LBVHQualityAnalyzer::intersect(const LBVHNode &a, const LBVHNode &b, LBVHNode &intersection) {
+        intersection.aabbMinX = std::max(a.aabbMinX, b.aabbMinX);
+        intersection.aabbMinY = std::max(a.aabbMinY, b.aabbMinY);
+        intersection.aabbMinZ = std::max(a.aabbMinZ, b.aabbMinZ);
+        intersection.aabbMaxX = std::min(a.aabbMaxX, b.aabbMaxX);
+        intersection.aabbMaxY = std::min(a.aabbMaxY, b.aabbMaxY);
+        intersection.aabbMaxZ = std::min(a.aabbMaxZ, b.aabbMaxZ);
+        // boxes that only touch do not overlap, except along the axes where both boxes are flat (e.g. planar geometry)
+        const auto overlaps = [](float aMin, float aMax, float bMin, float bMax, float lo, float hi) {
+            return hi > lo || (hi == lo && aMin == aMax && bMin == bMax);
+        };
+        return overlaps(a.aabbMinX, a.aabbMaxX, b.aabbMinX, b.aabbMaxX, intersection.aabbMinX, intersection.aabbMaxX) &&
+               overlaps(a.aabbMinY, a.aabbMaxY, b.aabbMinY, b.aabbMaxY, intersection.aabbMinY, intersection.aabbMaxY) &&
+               overlaps(a.aabbMinZ, a.aabbMaxZ, b.aabbMinZ, b.aabbMaxZ, intersection.aabbMinZ, intersection.aabbMaxZ);
+    }
+} // namespace engine
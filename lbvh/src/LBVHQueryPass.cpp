@@ -0,0 +1,89 @@
+#include "LBVHQueryPass.h"
+
+namespace engine {
+
+    void LBVHQueryPass::create() {
+        if (m_knnK < 1 || m_knnK > 32) {
+            throw std::runtime_error("The number of neighbours per nearest neighbour query has to be between 1 and 32!");
+        }
+        if (m_stackSize < 1) {
+            throw std::runtime_error("The traversal stack of the queries needs at least one entry!");
+        }
+        ComputePass::create();
+    }
+
+    std::vector<std::shared_ptr<Shader>> LBVHQueryPass::createShaders() {
+        // one thread per query, the work group size is specialized with the device limits and the stack size with the depth of the queried LBVHs
+        const std::map<uint32_t, uint32_t> workGroupConstants = {{Shader::LOCAL_SIZE_X_CONSTANT_ID, getPreferredWorkGroupSize(MAX_WORKGROUP_SIZE)}, {STACK_SIZE_CONSTANT_ID, m_stackSize}};
+        return {std::make_shared<Shader>(m_gpuContext, Paths::m_resourceDirectoryPath + "/shaders", "lbvh_ray_query.comp", std::vector<std::string>{}, workGroupConstants),
+                std::make_shared<Shader>(m_gpuContext, Paths::m_resourceDirectoryPath + "/shaders", "lbvh_ray_query.comp", std::vector<std::string>{"ANY_HIT"}, workGroupConstants),
+                std::make_shared<Shader>(m_gpuContext, Paths::m_resourceDirectoryPath + "/shaders", "lbvh_overlap_query.comp", std::vector<std::string>{}, workGroupConstants),
+                std::make_shared<Shader>(m_gpuContext, Paths::m_resourceDirectoryPath + "/shaders", "lbvh_knn_query.comp", std::vector<std::string>{"KNN_K=" + std::to_string(m_knnK)}, workGroupConstants),
+                std::make_shared<Shader>(m_gpuContext, Paths::m_resourceDirectoryPath + "/shaders", "lbvh_instance_ray_query.comp", std::vector<std::string>{}, workGroupConstants),
+                std::make_shared<Shader>(m_gpuContext, Paths::m_resourceDirectoryPath + "/shaders", "lbvh_instance_ray_query.comp", std::vector<std::string>{"ANY_HIT"}, workGroupConstants)};
+    }
+
+    void LBVHQueryPass::setOverlapStateBuffer(Buffer *overlapStateBuffer) {
+        m_overlapStateBuffer = overlapStateBuffer;
+        setStorageBuffer(1, 3, overlapStateBuffer);
+    }
+
+    void LBVHQueryPass::setKNNStateBuffer(Buffer *knnStateBuffer) {
+        m_knnStateBuffer = knnStateBuffer;
+        setStorageBuffer(2, 3, knnStateBuffer);
+    }
+
+    void LBVHQueryPass::recordCommands(VkCommandBuffer commandBuffer) {
+        switch (m_stage) {
+            case RAY_CLOSEST_HIT:
+            case RAY_ANY_HIT:
+                vkCmdPushConstants(commandBuffer, m_pipelineLayouts[m_stage], VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(PushConstantsRayQuery), &m_pushConstantsRayQuery);
+                recordCommandComputeShaderExecution(commandBuffer, m_stage);
+                break;
+            case OVERLAP: {
+                if (m_overlapStateBuffer == nullptr) {
+                    throw std::runtime_error("The overlap state buffer has to be set before recording the overlap query!");
+                }
+
+                // reset overlap state: pairCount = 0, overflowCount = 0, resumeQueryIdx = INVALID_QUERY, stackOverflowCount = 0
+                vkCmdFillBuffer(commandBuffer, m_overlapStateBuffer->getBuffer(), 0, 2 * sizeof(uint32_t), 0x00000000);
+                vkCmdFillBuffer(commandBuffer, m_overlapStateBuffer->getBuffer(), 2 * sizeof(uint32_t), sizeof(uint32_t), 0xFFFFFFFF);
+                vkCmdFillBuffer(commandBuffer, m_overlapStateBuffer->getBuffer(), 3 * sizeof(uint32_t), sizeof(uint32_t), 0x00000000);
+                VkMemoryBarrier memoryBarrier{.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER, .srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT, .dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT};
+                vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, {}, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+
+                vkCmdPushConstants(commandBuffer, m_pipelineLayouts[OVERLAP], VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(PushConstantsOverlap), &m_pushConstantsOverlap);
+                recordCommandComputeShaderExecution(commandBuffer, OVERLAP);
+                break;
+            }
+            case KNN: {
+                if (m_knnStateBuffer == nullptr) {
+                    throw std::runtime_error("The nearest neighbour state buffer has to be set before recording the nearest neighbour query!");
+                }
+
+                // reset nearest neighbour state: stackOverflowCount = 0
+                vkCmdFillBuffer(commandBuffer, m_knnStateBuffer->getBuffer(), 0, sizeof(uint32_t), 0x00000000);
+                VkMemoryBarrier memoryBarrier{.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER, .srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT, .dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT};
+                vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, {}, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+
+                vkCmdPushConstants(commandBuffer, m_pipelineLayouts[KNN], VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(PushConstantsKNN), &m_pushConstantsKNN);
+                recordCommandComputeShaderExecution(commandBuffer, KNN);
+                break;
+            }
+            case INSTANCE_RAY_CLOSEST_HIT:
+            case INSTANCE_RAY_ANY_HIT:
+                vkCmdPushConstants(commandBuffer, m_pipelineLayouts[m_stage], VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(PushConstantsInstanceRayQuery), &m_pushConstantsInstanceRayQuery);
+                recordCommandComputeShaderExecution(commandBuffer, m_stage);
+                break;
+        }
+    }
+
+    void LBVHQueryPass::createPipelineLayouts() {
+        createPipelineLayout(RAY_CLOSEST_HIT, sizeof(PushConstantsRayQuery));
+        createPipelineLayout(RAY_ANY_HIT, sizeof(PushConstantsRayQuery));
+        createPipelineLayout(OVERLAP, sizeof(PushConstantsOverlap));
+        createPipelineLayout(KNN, sizeof(PushConstantsKNN));
+        createPipelineLayout(INSTANCE_RAY_CLOSEST_HIT, sizeof(PushConstantsInstanceRayQuery));
+        createPipelineLayout(INSTANCE_RAY_ANY_HIT, sizeof(PushConstantsInstanceRayQuery));
+    }
+} // namespace engine
@@ -0,0 +1,187 @@
+#include "LBVHTwoLevelBuilder.h"
+
+namespace engine {
+
+    void LBVHTwoLevelBuilder::create(uint32_t initialInstanceCapacity) {
+        m_tlasBuilder.create(initialInstanceCapacity);
+        reserveInstances(std::max(initialInstanceCapacity, MIN_INSTANCE_CAPACITY));
+    }
+
+    void LBVHTwoLevelBuilder::release() {
+        m_tlasBuilder.release();
+        m_gpuContext->m_stagingRing->wait(m_instancesUpload);
+        m_instancesUpload = {};
+        if (m_instancesBuffer) {
+            m_instancesBuffer->release();
+            m_instancesBuffer = nullptr;
+            m_instanceCapacity = 0;
+        }
+        if (m_blasBuffer) {
+            m_blasBuffer->release();
+            m_blasBuffer = nullptr;
+        }
+        m_meshes.clear();
+        m_meshAABBs.clear();
+        m_instances.clear();
+    }
+
+    double LBVHTwoLevelBuilder::buildMeshes(const std::vector<std::vector<Element>> &meshes) {
+        if (meshes.empty()) {
+            throw std::runtime_error("The scene has to contain at least one mesh!");
+        }
+
+        std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+        // one segment per mesh, the primitive ids of the elements stay the ids of the mesh
+        std::vector<Element> elements;
+        m_meshes.resize(meshes.size());
+        for (uint32_t meshIdx = 0; meshIdx < meshes.size(); meshIdx++) {
+            if (meshes[meshIdx].empty()) {
+                throw std::runtime_error("Mesh " + std::to_string(meshIdx) + " does not contain any elements!");
+            }
+            m_meshes[meshIdx] = {.elementOffset = static_cast<uint32_t>(elements.size()), .numElements = static_cast<uint32_t>(meshes[meshIdx].size()), .nodeOffset = 0};
+            elements.insert(elements.end(), meshes[meshIdx].begin(), meshes[meshIdx].end());
+        }
+
+        // the builder of the meshes is only needed once, its buffers (capacity and construction buffers) are released after the LBVHs are copied into the compacted buffer
+        LBVHBuilder blasBuilder(m_gpuContext, m_mortonCodes64, m_absolutePointers);
+        blasBuilder.create(static_cast<uint32_t>(elements.size()));
+        blasBuilder.buildBatch(elements, m_meshes);
+        std::vector<LBVHNode> blas;
+        blasBuilder.downloadLBVH(blas);
+        blasBuilder.release();
+
+        if (m_blasBuffer) {
+            m_blasBuffer->release();
+        }
+        auto settingsBLAS = Buffer::BufferSettings{.m_sizeBytes = static_cast<uint32_t>(blas.size() * sizeof(LBVHNode)), .m_bufferUsages = VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, .m_memoryProperties = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, .m_name = "lbvhTwoLevelBuilder.BLASBuffer"};
+        m_blasBuffer = std::make_shared<Buffer>(m_gpuContext, settingsBLAS);
+        m_blasBuffer->uploadWithStagingBuffer(blas.data());
+
+        // the root of a mesh bounds the mesh in object space, it is transformed into the world aabb of every instance of the mesh
+        m_meshAABBs.resize(m_meshes.size());
+        for (uint32_t meshIdx = 0; meshIdx < m_meshes.size(); meshIdx++) {
+            m_meshAABBs[meshIdx] = blas[m_meshes[meshIdx].nodeOffset];
+        }
+        m_instances.clear();
+        std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+        return static_cast<double>(std::chrono::duration_cast<std::chrono::microseconds>(end - begin).count()) * std::pow(10, -3);
+    }
+
+    double LBVHTwoLevelBuilder::buildInstances(const std::vector<Instance> &instances) {
+        std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+        wait(buildInstancesAsync(instances));
+        std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+        return static_cast<double>(std::chrono::duration_cast<std::chrono::microseconds>(end - begin).count()) * std::pow(10, -3);
+    }
+
+    LBVHBuilder::BuildHandle LBVHTwoLevelBuilder::buildInstancesAsync(const std::vector<Instance> &instances, const std::vector<ComputePass::SemaphoreWait> &waits) {
+        const auto numInstances = static_cast<uint32_t>(instances.size());
+        if (numInstances == 0) {
+            throw std::runtime_error("The scene has to contain at least one instance!");
+        }
+        if (m_meshes.empty()) {
+            throw std::runtime_error("The meshes have to be built before the instances, see LBVHTwoLevelBuilder::buildMeshes!");
+        }
+
+        m_instances.resize(numInstances);
+        m_tlasElements.resize(numInstances);
+        for (uint32_t instanceIdx = 0; instanceIdx < numInstances; instanceIdx++) {
+            const Instance &instance = instances[instanceIdx];
+            if (instance.meshIdx >= m_meshes.size()) {
+                throw std::runtime_error("Instance " + std::to_string(instanceIdx) + " references the mesh " + std::to_string(instance.meshIdx) + " that does not exist!");
+            }
+            const float *m = instance.transform;
+
+            // world to object: inverse of the linear part and the inverse translation
+            glm::mat3 linear;
+            for (uint32_t row = 0; row < 3; row++) {
+                for (uint32_t column = 0; column < 3; column++) {
+                    linear[column][row] = m[4 * row + column];
+                }
+            }
+            if (glm::determinant(linear) == 0.0f) {
+                throw std::runtime_error("The transform of instance " + std::to_string(instanceIdx) + " is not invertible!");
+            }
+            const glm::mat3 inverse = glm::inverse(linear);
+            const glm::vec3 inverseTranslation = -(inverse * glm::vec3(m[3], m[7], m[11]));
+            LBVH::LBVHInstance &gpuInstance = m_instances[instanceIdx];
+            for (uint32_t row = 0; row < 3; row++) {
+                for (uint32_t column = 0; column < 3; column++) {
+                    gpuInstance.worldToObject[4 * row + column] = inverse[column][row];
+                }
+                gpuInstance.worldToObject[4 * row + 3] = inverseTranslation[row];
+            }
+            gpuInstance.nodeOffset = m_meshes[instance.meshIdx].nodeOffset;
+            gpuInstance.meshIdx = instance.meshIdx;
+
+            // world aabb of the transformed mesh aabb (Arvo 1990): every row accumulates the minimum and maximum of the products with the bounds
+            const LBVHNode &aabb = m_meshAABBs[instance.meshIdx];
+            const float aabbMin[3] = {aabb.aabbMinX, aabb.aabbMinY, aabb.aabbMinZ};
+            const float aabbMax[3] = {aabb.aabbMaxX, aabb.aabbMaxY, aabb.aabbMaxZ};
+            float worldMin[3];
+            float worldMax[3];
+            for (uint32_t row = 0; row < 3; row++) {
+                worldMin[row] = worldMax[row] = m[4 * row + 3];
+                for (uint32_t column = 0; column < 3; column++) {
+                    const float a = m[4 * row + column] * aabbMin[column];
+                    const float b = m[4 * row + column] * aabbMax[column];
+                    worldMin[row] += std::min(a, b);
+                    worldMax[row] += std::max(a, b);
+                }
+            }
+            m_tlasElements[instanceIdx] = {.primitiveIdx = instanceIdx, .aabbMinX = worldMin[0], .aabbMinY = worldMin[1], .aabbMinZ = worldMin[2], .aabbMaxX = worldMax[0], .aabbMaxY = worldMax[1], .aabbMaxZ = worldMax[2]};
+        }
+
+        // the instances are uploaded before the elements of the TLAS build, i.e. the build waits for both uploads on the GPU (the batches of the staging ring finish in order)
+        reserveInstances(numInstances);
+        m_instancesUpload = m_instancesBuffer->uploadAsync(m_instances.data(), static_cast<uint32_t>(numInstances * sizeof(LBVH::LBVHInstance)));
+        if (numInstances == 1) {
+            // the Karras build requires two elements, a single segment yields the same layout (the root is a leaf)
+            std::vector<LBVHSegment> segments = {{.elementOffset = 0, .numElements = 1, .nodeOffset = 0}};
+            return m_tlasBuilder.buildBatchAsync(m_tlasElements, segments, waits);
+        }
+        return m_tlasBuilder.buildAsync(m_tlasElements, waits);
+    }
+
+    void LBVHTwoLevelBuilder::reserveInstances(uint32_t numInstances) {
+        if (numInstances <= m_instanceCapacity) {
+            return;
+        }
+        m_gpuContext->m_stagingRing->wait(m_instancesUpload);
+        m_instancesUpload = {};
+        if (m_instancesBuffer) {
+            m_instancesBuffer->release();
+        }
+        m_instanceCapacity = std::max(numInstances, GROWTH_FACTOR * m_instanceCapacity);
+        auto settingsInstances = Buffer::BufferSettings{.m_sizeBytes = static_cast<uint32_t>(m_instanceCapacity * sizeof(LBVH::LBVHInstance)), .m_bufferUsages = VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, .m_memoryProperties = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, .m_name = "lbvhTwoLevelBuilder.instancesBuffer"};
+        m_instancesBuffer = std::make_shared<Buffer>(m_gpuContext, settingsInstances);
+    }
+
+    void LBVHTwoLevelBuilder::downloadTLAS(std::vector<LBVHNode> &LBVH) {
+        m_tlasBuilder.downloadLBVH(LBVH);
+    }
+
+    void LBVHTwoLevelBuilder::downloadBLAS(std::vector<LBVHNode> &LBVH) {
+        if (!m_blasBuffer) {
+            throw std::runtime_error("The meshes have to be built before the download, see LBVHTwoLevelBuilder::buildMeshes!");
+        }
+        LBVH.resize(m_blasBuffer->getSizeBytes() / sizeof(LBVHNode));
+        m_blasBuffer->downloadWithStagingBuffer(LBVH.data());
+    }
+
+    uint64_t LBVHTwoLevelBuilder::getTLASMemoryBytes() const {
+        return m_tlasBuilder.getDeviceMemoryBytes() + (m_instancesBuffer ? m_instancesBuffer->getSizeBytes() : 0);
+    }
+
+    LBVH::Ray LBVHTwoLevelBuilder::transformRay(const LBVH::LBVHInstance &instance, const LBVH::Ray &ray) {
+        const float *m = instance.worldToObject;
+        LBVH::Ray objectRay = ray;
+        objectRay.originX = m[0] * ray.originX + m[1] * ray.originY + m[2] * ray.originZ + m[3];
+        objectRay.originY = m[4] * ray.originX + m[5] * ray.originY + m[6] * ray.originZ + m[7];
+        objectRay.originZ = m[8] * ray.originX + m[9] * ray.originY + m[10] * ray.originZ + m[11];
+        objectRay.directionX = m[0] * ray.directionX + m[1] * ray.directionY + m[2] * ray.directionZ;
+        objectRay.directionY = m[4] * ray.directionX + m[5] * ray.directionY + m[6] * ray.directionZ;
+        objectRay.directionZ = m[8] * ray.directionX + m[9] * ray.directionY + m[10] * ray.directionZ;
+        return objectRay;
+    }
+} // namespace engine
@@ -0,0 +1,51 @@
+#define TINYOBJLOADER_IMPLEMENTATION
+
+#include "LBVHBenchmark.h"
+#include "engine/core/GPUContext.h"
+#include "engine/util/Paths.h"
+
+static void printUsage() {
+    std::cout << "Usage: lbvhbenchmark [options]\n"
+                 "  --sizes 1000,10000,...        element counts (default: 1000,10000,100000,1000000,10000000,50000000)\n"
+                 "  --max-size N                  drop all sizes > N, e.g. for CI on a software implementation\n"
+                 "  --distributions a,b,...       uniform, clustered, duplicate, thin, planar (default: all)\n"
+                 "  --algorithms a,b              karras, ploc (default: karras)\n"
+                 "  --warmup N                    builds without measurement per configuration (default: 2)\n"
+                 "  --runs N                      builds with measurement per configuration (default: 5)\n"
+                 "  --seed N                      seed of the element generator (default: 42)\n"
+                 "  --json path                   (default: lbvh_benchmark.json)\n"
+                 "  --csv path                    (default: lbvh_benchmark.csv)\n"
+                 "  --batch meshes,elements|off   batched build of many small meshes vs. one build per mesh (default: 10000,1000)\n"
+                 "  --device N|cpu                device index, or the first software device (e.g. lavapipe)\n"
+                 "  --validation on|off           Vulkan validation layers (default: off)" << std::endl;
+}
+
+int main(int argc, char *argv[]) {
+#ifdef RESOURCE_DIRECTORY_PATH
+    engine::Paths::m_resourceDirectoryPath = RESOURCE_DIRECTORY_PATH;
+#endif
+
+    engine::GPUContext gpu(engine::Queues::QueueFamilies::COMPUTE_FAMILY | engine::Queues::TRANSFER_FAMILY);
+    gpu.m_validationLayers = false; // the layers validate every call, i.e. they distort the build times
+
+    try {
+        engine::LBVHBenchmark::Settings settings;
+        if (!engine::LBVHBenchmark::parseArguments(argc, argv, settings, gpu)) {
+            printUsage();
+            return EXIT_SUCCESS;
+        }
+
+        gpu.init();
+
+        auto benchmark = std::make_shared<engine::LBVHBenchmark>(settings);
+        benchmark->execute(&gpu);
+
+        gpu.shutdown();
+    } catch (const std::exception &e) {
+        std::cerr << e.what() << std::endl;
+        printUsage();
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
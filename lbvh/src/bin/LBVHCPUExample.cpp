@@ -0,0 +1,129 @@
+#include "LBVHCPUBuilder.h"
+#include "LBVHQualityAnalyzer.h"
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <random>
+#include <stdexcept>
+#include <string>
+
+// builds and verifies LBVHs with the CPU builder only, i.e. it runs without a GPU (e.g. on CI machines without a Vulkan device)
+
+static const char *PRINT_PREFIX = "[LBVHCPU] ";
+
+static void generateElements(std::vector<engine::Element> &elements, uint32_t numElements, std::mt19937 &generator) {
+    // half of the elements uniformly distributed, half in a few dense clusters (duplicate morton codes)
+    std::uniform_real_distribution<float> position(-100.0f, 100.0f);
+    std::uniform_real_distribution<float> size(0.0f, 1.0f);
+    std::normal_distribution<float> cluster(0.0f, 0.01f);
+    std::vector<glm::vec3> clusterCenters(8);
+    for (glm::vec3 &center: clusterCenters) {
+        center = glm::vec3(position(generator), position(generator), position(generator));
+    }
+    elements.resize(numElements);
+    for (uint32_t i = 0; i < numElements; i++) {
+        glm::vec3 min = i % 2 == 0 ? glm::vec3(position(generator), position(generator), position(generator)) : clusterCenters[i % clusterCenters.size()] + glm::vec3(cluster(generator), cluster(generator), cluster(generator));
+        glm::vec3 max = min + glm::vec3(size(generator), size(generator), size(generator));
+        elements[i] = {i, min.x, min.y, min.z, max.x, max.y, max.z};
+    }
+}
+
+static uint32_t getChild(uint32_t index, int32_t pointer, bool absolutePointers) {
+    return absolutePointers ? static_cast<uint32_t>(pointer) : index + pointer;
+}
+
+static bool isUnion(const engine::LBVHNode &parent, const engine::LBVHNode &a, const engine::LBVHNode &b) {
+    return parent.aabbMinX == std::min(a.aabbMinX, b.aabbMinX) && parent.aabbMinY == std::min(a.aabbMinY, b.aabbMinY) && parent.aabbMinZ == std::min(a.aabbMinZ, b.aabbMinZ) &&
+           parent.aabbMaxX == std::max(a.aabbMaxX, b.aabbMaxX) && parent.aabbMaxY == std::max(a.aabbMaxY, b.aabbMaxY) && parent.aabbMaxZ == std::max(a.aabbMaxZ, b.aabbMaxZ);
+}
+
+// every node is reached exactly once from the root, the leaves are the elements in morton order and every internal node is the union of its children
+static void verify(const std::vector<engine::Element> &elements, const std::vector<engine::LBVHNode> &LBVH, const std::vector<uint64_t> &sortedMortonCodes, bool absolutePointers) {
+    const auto numElements = static_cast<uint32_t>(elements.size());
+    if (LBVH.size() != 2 * numElements - 1) {
+        std::cout << PRINT_PREFIX << "Error: " << LBVH.size() << " nodes instead of " << 2 * numElements - 1 << "." << std::endl;
+        throw std::runtime_error("TEST FAILED.");
+    }
+    for (uint32_t i = 1; i < sortedMortonCodes.size(); i++) {
+        if (sortedMortonCodes[i - 1] > sortedMortonCodes[i]) {
+            std::cout << PRINT_PREFIX << "Error: Morton codes not sorted at " << i << "." << std::endl;
+            throw std::runtime_error("TEST FAILED.");
+        }
+    }
+
+    std::vector<bool> visited(LBVH.size(), false);
+    std::vector<bool> visitedPrimitives(numElements, false);
+    std::vector<uint32_t> stack = {0};
+    while (!stack.empty()) {
+        const uint32_t index = stack.back();
+        stack.pop_back();
+        if (index >= LBVH.size() || visited[index]) {
+            std::cout << PRINT_PREFIX << "Error: Node " << index << " out of range or visited twice." << std::endl;
+            throw std::runtime_error("TEST FAILED.");
+        }
+        visited[index] = true;
+        const engine::LBVHNode &node = LBVH[index];
+
+        if (node.left == INVALID_POINTER) {
+            if (index < numElements - 1 || node.right != INVALID_POINTER || node.primitiveIdx >= numElements || visitedPrimitives[node.primitiveIdx]) {
+                std::cout << PRINT_PREFIX << "Error: Leaf " << index << " is invalid." << std::endl;
+                throw std::runtime_error("TEST FAILED.");
+            }
+            visitedPrimitives[node.primitiveIdx] = true;
+            const engine::Element &element = elements[node.primitiveIdx]; // the primitive ids of generateElements are the element indices
+            if (node.aabbMinX != element.aabbMinX || node.aabbMinY != element.aabbMinY || node.aabbMinZ != element.aabbMinZ || node.aabbMaxX != element.aabbMaxX || node.aabbMaxY != element.aabbMaxY || node.aabbMaxZ != element.aabbMaxZ) {
+                std::cout << PRINT_PREFIX << "Error: AABB of leaf " << index << " differs from its element." << std::endl;
+                throw std::runtime_error("TEST FAILED.");
+            }
+            continue;
+        }
+
+        const uint32_t left = getChild(index, node.left, absolutePointers);
+        const uint32_t right = getChild(index, node.right, absolutePointers);
+        if (left >= LBVH.size() || right >= LBVH.size() || !isUnion(node, LBVH[left], LBVH[right])) {
+            std::cout << PRINT_PREFIX << "Error: AABB of node " << index << " is not the union of its children." << std::endl;
+            throw std::runtime_error("TEST FAILED.");
+        }
+        stack.push_back(left);
+        stack.push_back(right);
+    }
+    if (std::find(visited.begin(), visited.end(), false) != visited.end() || std::find(visitedPrimitives.begin(), visitedPrimitives.end(), false) != visitedPrimitives.end()) {
+        std::cout << PRINT_PREFIX << "Error: Node or primitive not visited." << std::endl;
+        throw std::runtime_error("TEST FAILED.");
+    }
+}
+
+int main(int argc, char *argv[]) {
+    try {
+        const uint32_t numElements = argc > 1 ? static_cast<uint32_t>(std::stoul(argv[1])) : 1000000;
+        const uint32_t numThreads = argc > 2 ? static_cast<uint32_t>(std::stoul(argv[2])) : std::thread::hardware_concurrency();
+        if (numElements < 2) {
+            throw std::runtime_error("Usage: lbvhcpuexample [numElements >= 2] [numThreads]");
+        }
+
+        std::mt19937 generator(42);
+        std::vector<engine::Element> elements;
+        generateElements(elements, numElements, generator);
+
+        engine::LBVHQualityAnalyzer analyzer(numThreads);
+        std::vector<engine::LBVHNode> LBVH;
+        for (bool mortonCodes64: {false, true}) {
+            engine::LBVHCPUBuilder builder(numThreads, mortonCodes64);
+            for (bool absolutePointers: {true, false}) {
+                std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+                builder.build(elements, LBVH, absolutePointers);
+                std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+                verify(elements, LBVH, builder.getSortedMortonCodes(), absolutePointers);
+                std::cout << PRINT_PREFIX << numElements << " elements built in " << static_cast<double>(std::chrono::duration_cast<std::chrono::microseconds>(end - begin).count()) * 1e-3 << "[ms] with " << builder.getNumThreads() << " threads ("
+                          << (mortonCodes64 ? "63" : "30") << "-bit morton codes, " << (absolutePointers ? "absolute" : "relative") << " pointers), verified." << std::endl;
+            }
+            engine::LBVHQualityAnalyzer::print(analyzer.analyze(LBVH, false));
+        }
+    } catch (const std::exception &e) {
+        std::cerr << e.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}